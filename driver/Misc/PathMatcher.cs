@@ -0,0 +1,112 @@
+﻿//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+using System.Collections.Generic;
+
+namespace Misc {
+
+   /// <summary>
+   /// Match strings against a set of substring patterns in a single pass
+   /// (Aho-Corasick automaton). The cost of a lookup depends on the length of
+   /// the string only, not on the number of patterns.
+   /// </summary>
+   public class PathMatcher {
+
+      public PathMatcher(IEnumerable<string> patterns) {
+         m_nodes.Add(new Node());
+         foreach (var p in patterns)
+            Add(p);
+         Build();
+      }
+
+      public bool Empty {
+         get { return m_patterns == 0; }
+      }
+
+      public bool Matches(string path) {
+         int state = 0;
+         foreach (var c in path) {
+            state = Step(state, c);
+            if (m_nodes[state].Terminal)
+               return true;
+         }
+         return false;
+      }
+
+      void Add(string pattern) {
+         if (pattern.Length == 0)
+            return;
+
+         int state = 0;
+         foreach (var c in pattern) {
+            int next;
+            if (!m_nodes[state].Next.TryGetValue(c, out next)) {
+               next = m_nodes.Count;
+               m_nodes.Add(new Node());
+               m_nodes[state].Next.Add(c, next);
+            }
+            state = next;
+         }
+         m_nodes[state].Terminal = true;
+         ++m_patterns;
+      }
+
+      void Build() {
+         var queue = new Queue<int>();
+         foreach (var child in m_nodes[0].Next.Values)
+            queue.Enqueue(child);
+
+         while (queue.Count != 0) {
+            var state = queue.Dequeue();
+            foreach (var edge in m_nodes[state].Next) {
+               var child = edge.Value;
+               var fail = Step(m_nodes[state].Fail, edge.Key);
+               m_nodes[child].Fail = fail;
+               m_nodes[child].Terminal |= m_nodes[fail].Terminal;
+               queue.Enqueue(child);
+            }
+         }
+      }
+
+      int Step(int state, char c) {
+         for (;;) {
+            int next;
+            if (m_nodes[state].Next.TryGetValue(c, out next))
+               return next;
+            if (state == 0)
+               return 0;
+            state = m_nodes[state].Fail;
+         }
+      }
+
+      class Node {
+         public Dictionary<char, int> Next = new Dictionary<char, int>();
+         public int Fail = 0;
+         public bool Terminal = false;
+      }
+
+      List<Node> m_nodes = new List<Node>();
+      int m_patterns = 0;
+   }
+}
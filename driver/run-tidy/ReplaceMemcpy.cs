@@ -34,7 +34,8 @@ namespace RunTidy {
 
       public override void Process(ClangSource src, Misc.Patch yr, Options options) {
          var content = System.IO.File.ReadAllText(src.file);
-         if (!content.Contains("memcpy"))
+         if (!content.Contains("memcpy") && !content.Contains("memmove") &&
+             !content.Contains("memset"))
             return;
 
          Process_c_file(src.file, new List<string> { "-" + OptionName }, options);
@@ -45,7 +46,7 @@ namespace RunTidy {
       }
 
       public override string OptionDesc {
-         get { return "Replace memcpy to assignment operator on POD."; }
+         get { return "Replace memcpy, memmove and memset of POD with typed assignments, std::copy_n or std::fill_n."; }
       }
    }
 
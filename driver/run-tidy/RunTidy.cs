@@ -64,18 +64,13 @@ namespace RunTidy {
          var filtered = sources;
 
          if (filefilter.Any()) {
-            var filter = new HashSet<string>(filefilter
+            var filter = new PathMatcher(filefilter
                .Where(f => f.StartsWith("@"))
                .SelectMany(f => File.ReadAllLines(f.Substring(1)))
                .Union(filefilter.Where(f => !f.StartsWith("@")))
                .Select(f => f.PosixPath()));
 
-            var xs = from s in sources
-                     from f in filter
-                     where s.file.PosixPath().Contains(f)
-                     select s;
-
-            filtered = xs.ToList();
+            filtered = sources.Where(s => filter.Matches(s.file.PosixPath())).ToList();
          }
          return filtered;
       }
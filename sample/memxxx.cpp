@@ -32,3 +32,19 @@ void pair_like() {
    foo f;
    f.x.a = f.x.b = 0;
 }
+
+
+void loops(char* __restrict dst, const char* __restrict src, unsigned n) {
+   for (unsigned i = 0; i < n; ++i)
+      dst[i] = src[i];
+
+   char buf[64];
+   for (int i = 0; i < 64; ++i)
+      buf[i] = 0;
+
+   a_b abs2[8];
+   a_b abs3[8];
+   for (int i = 0; i < 8; i++) {
+      abs2[i] = abs3[i];
+   }
+}
@@ -22,6 +22,10 @@
 // SOFTWARE.
 //
 
+#include "AstCache.hpp"
+#include "OptionsParser.hpp"
+#include "TransformAction.hpp"
+
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
@@ -30,7 +34,6 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Index/USRGeneration.h"
-#include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/Support/CommandLine.h"
@@ -39,6 +42,7 @@
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <chrono>
 #include <iostream>
 #include <memory>
 
@@ -52,6 +56,13 @@ static cl::OptionCategory IndexerCategory("Indexer");
 static cl::opt<bool> Quiet("quiet",
                            cl::desc("Do not report compiler warnings."));
 
+static cl::opt<bool> DeclarationsOnly(
+   "declarations-only",
+   cl::desc("Only index declarations, function bodies are not parsed."));
+
+static cl::opt<bool> ReportTime("report-time",
+                                cl::desc("Report time spent on the run."));
+
 
 template <typename NodeT>
 bool isFromSystemHeader(const NodeT& Node, const SourceManager& SM) {
@@ -131,6 +142,12 @@ public:
 
 class IndexerFrontendAction : public ASTFrontendAction {
 public:
+   bool BeginInvocation(CompilerInstance& CI) override {
+      if (DeclarationsOnly)
+         CI.getFrontendOpts().SkipFunctionBodies = true;
+      return true;
+   }
+
    std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance& CI,
                                                   StringRef file) override {
       return llvm::make_unique<IndexerConsumer>(CI);
@@ -138,7 +155,7 @@ public:
 };
 
 int main(int argc, const char** argv) {
-   CommonOptionsParser op(argc, argv, IndexerCategory);
+   tidy::OptionsParser op(argc, argv, IndexerCategory);
    ClangTool           Tool(op.getCompilations(), op.getSourcePathList());
 
    std::unique_ptr<IgnoringDiagConsumer> diagConsumer;
@@ -147,6 +164,16 @@ int main(int argc, const char** argv) {
 
    Tool.setDiagnosticConsumer(diagConsumer.get());
 
-   int res = Tool.run(newFrontendActionFactory<IndexerFrontendAction>().get());
+   auto actions = newFrontendActionFactory<IndexerFrontendAction>();
+
+   tidy::AstCacheActionFactory factory(actions.get(), op.getAstCache());
+
+   auto start   = std::chrono::steady_clock::now();
+   int  res     = Tool.run(&factory);
+   auto elapsed = std::chrono::steady_clock::now() - start;
+
+   if (ReportTime)
+      tidy::ReportElapsedTime(std::cerr, op.getSourcePathList().size(),
+                              elapsed, DeclarationsOnly);
    return res;
 }
@@ -0,0 +1,156 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef BUDGET_HPP
+#define BUDGET_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/Support/Process.h"
+
+namespace constifier {
+
+/// Wall-clock and heap budget of one translation unit.
+///
+/// The constifier checks it cooperatively between its phases and in its
+/// loops. Once exceeded, it stays so until the next start(), and the
+/// translation unit is abandoned. A zero limit disables the check.
+class Budget {
+public:
+   typedef std::chrono::steady_clock Clock;
+
+   Budget(std::chrono::milliseconds Time, std::size_t MemoryBytes)
+      : m_time(Time)
+      , m_memory(MemoryBytes)
+      , m_start()
+      , m_phaseStart()
+      , m_startMemory(0)
+      , m_calls(0)
+      , m_exceeded(false)
+      , m_reason()
+      , m_phase()
+      , m_timings() {}
+
+   bool enabled() const {
+      return m_time.count() != 0 || m_memory != 0;
+   }
+
+   void start(const char* Phase) {
+      m_start       = Clock::now();
+      m_phaseStart  = m_start;
+      m_startMemory = llvm::sys::Process::GetMallocUsage();
+      m_calls       = 0;
+      m_exceeded    = false;
+      m_reason.clear();
+      m_phase = Phase;
+      m_timings.clear();
+   }
+
+   /// Close the current phase and start \p Phase.
+   void phase(const char* Phase) {
+      closePhase();
+      m_phase = Phase;
+   }
+
+   /// Return true once the budget is exceeded. Only every 256th call looks
+   /// at the clock and the heap, so it can be called in inner loops.
+   bool exceeded() {
+      if (m_exceeded || !enabled())
+         return m_exceeded;
+      if ((m_calls++ & 255) != 0)
+         return false;
+      return check();
+   }
+
+   /// Same as exceeded(), always looking at the clock and the heap.
+   bool check() {
+      if (m_exceeded || !enabled())
+         return m_exceeded;
+
+      auto elapsed = Clock::now() - m_start;
+      if (m_time.count() != 0 && elapsed > m_time) {
+         m_exceeded = true;
+         m_reason   = "time budget of " + std::to_string(m_time.count()) +
+                    " ms exceeded";
+      }
+      else if (m_memory != 0 &&
+               llvm::sys::Process::GetMallocUsage() > m_startMemory + m_memory) {
+         m_exceeded = true;
+         m_reason   = "memory budget of " +
+                    std::to_string(m_memory / (1024 * 1024)) + " MB exceeded";
+      }
+      if (m_exceeded)
+         closePhase();
+      return m_exceeded;
+   }
+
+   const std::string& reason() const {
+      return m_reason;
+   }
+
+   /// Time spent in each phase, e.g. "visit 1200 ms, merge 30000 ms".
+   void printTimings(std::ostream& ostr) const {
+      const char* separator = "";
+      for (auto& timing : m_timings) {
+         ostr << separator << timing.first << " " << timing.second << " ms";
+         separator = ", ";
+      }
+   }
+
+private:
+   void closePhase() {
+      if (m_phase.empty())
+         return;
+
+      auto now = Clock::now();
+      auto ms  = std::chrono::duration_cast<std::chrono::milliseconds>(
+                   now - m_phaseStart)
+                   .count();
+      m_timings.emplace_back(m_phase, static_cast<long long>(ms));
+      m_phaseStart = now;
+      m_phase.clear();
+   }
+
+   std::chrono::milliseconds                      m_time;
+   std::size_t                                    m_memory;
+   Clock::time_point                              m_start;
+   Clock::time_point                              m_phaseStart;
+   std::size_t                                    m_startMemory;
+   std::uint64_t                                  m_calls;
+   bool                                           m_exceeded;
+   std::string                                    m_reason;
+   std::string                                    m_phase;
+   std::vector<std::pair<std::string, long long>> m_timings;
+};
+
+}  // namespace constifier
+
+#endif
@@ -29,6 +29,7 @@
 #include <map>
 #include <memory>
 #include <numeric>
+#include <set>
 #include <sstream>
 #include <stack>
 #include <string>
@@ -45,19 +46,28 @@
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Lex/Lexer.h"
 #include "clang/Rewrite/Core/Rewriter.h"
-#include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/ReplacementsYaml.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include "AstCache.hpp"
+#include "Budget.hpp"
+#include "Census.hpp"
 #include "Graph.hpp"
+#include "IncludeMap.hpp"
+#include "JsonLines.hpp"
+#include "OptionsParser.hpp"
+#include "PathMatcher.hpp"
+#include "Statistics.hpp"
+#include "WorkerPool.hpp"
 #include "utils.hpp"
 
 using namespace clang;
@@ -82,10 +92,42 @@ static cl::opt<bool> PropagateToStaticFunction(
 static cl::opt<bool> Quiet(
    "quiet", cl::desc("Do not report colored AST in case of error"));
 
+static cl::opt<bool> CensusOnly(
+   "census",
+   cl::desc("Only count the variables to constify, per directory, without "
+            "producing any replacement file."));
+static cl::opt<unsigned> CensusDepth(
+   "census-depth",
+   cl::desc("Number of directory levels in the census histogram."),
+   cl::init(2));
+
 static cl::opt<std::string> OutputDir("outputdir",
                                       cl::desc("<path> output dir."));
 static cl::opt<std::string> Prefix(
    "prefix", cl::desc("<prefix> replacement file prefix."));
+static cl::opt<bool> Stats("stats",
+                           cl::desc("Print the run statistics on exit."));
+static cl::opt<std::string> StatsJson(
+   "stats-json", cl::desc("Write the run statistics as JSON to <path>."),
+   cl::value_desc("path"));
+static cl::opt<std::string> JsonLines(
+   "jsonl",
+   cl::desc("Stream replacements as JSON lines to <path> ('-' for stdout) "
+            "instead of replacement files."),
+   cl::value_desc("path"));
+static cl::opt<unsigned> Workers(
+   "workers",
+   cl::desc("Process the sources in <N> worker processes, so that a crash "
+            "only loses its source (POSIX only)."),
+   cl::value_desc("N"), cl::init(0));
+static cl::opt<unsigned> TuTimeout(
+   "tu-timeout",
+   cl::desc("Skip the translation units taking more than <seconds>."),
+   cl::value_desc("seconds"), cl::init(0));
+static cl::opt<unsigned> TuMemory(
+   "tu-memory",
+   cl::desc("Skip the translation units allocating more than <MB>."),
+   cl::value_desc("MB"), cl::init(0));
 
 cl::list<std::string> ExcludePaths("exclude", cl::desc("<path> [... <path>]"),
                                    cl::ZeroOrMore);
@@ -105,6 +147,33 @@ std::string GetOutputDir() {
 
 static int GlobalIndex = 0;
 
+static tidy::Statistic NumNodes("clang-constifier", "nodes",
+                               "Use-def graph nodes created");
+static tidy::Statistic NumEdges("clang-constifier", "edges",
+                               "Use-def graph edges created");
+static tidy::Statistic NumSccsMerged("clang-constifier", "sccs-merged",
+                                    "Strongly connected components merged");
+static tidy::Statistic NumConstified("clang-constifier", "constified",
+                                    "Nodes constified");
+static tidy::Statistic NumStayUnconst("clang-constifier", "stay-unconst",
+                                     "Constifiable nodes left unconst");
+static tidy::Statistic NumSkipped("clang-constifier", "skipped",
+                                 "Translation units over budget");
+
+// Set in census mode: nodes to constify are counted instead of written.
+static tidy::Census* CensusCounter = nullptr;
+
+// Set with -jsonl: replacements are streamed instead of written to files.
+static tidy::JsonLinesWriter* JsonLinesOutput = nullptr;
+
+// Set with -include-map: includes of each translation unit are recorded.
+static tidy::IncludeMap* IncludeMapOutput = nullptr;
+
+// Worker messages sent when the tool failed on a source, and once it is
+// done with it.
+static const char MessageFailed = 'f';
+static const char MessageDone   = 'd';
+
 namespace {
 
 struct Parameter {
@@ -1188,13 +1257,16 @@ std::string replace_all(const std::string& str, const std::string& what,
 
 static llvm::cl::OptionCategory ConstifyCategory("Constify 'char*'");
 
+const tidy::PathMatcher& ExcludeMatcher() {
+   static const tidy::PathMatcher matcher(std::begin(ExcludePaths),
+                                          std::end(ExcludePaths));
+   return matcher;
+}
+
 bool IsInExcludeList(const std::string& path) {
    if (path.empty())
       return true;
-   return std::any_of(std::begin(ExcludePaths), std::end(ExcludePaths),
-                      [&path](const std::string& e) {
-                         return strstr(path.c_str(), e.c_str()) != nullptr;
-                      });
+   return ExcludeMatcher().matches(path);
 }
 
 
@@ -1206,12 +1278,14 @@ public:
 
    ConstifyVisitor(UseDefGraph& G, NodeManager& nodes, SourceManager& SM,
                    std::vector<Replacement>&      replacements,
-                   std::set<const FunctionDecl*>& lockedFunctions)
+                   std::set<const FunctionDecl*>& lockedFunctions,
+                   Budget&                        budget)
       : m_graph(G)
       , m_nodes(nodes)
       , m_sourceManager(SM)
       , m_replacements(replacements)
       , m_lockedFunctions(lockedFunctions)
+      , m_budget(budget)
       , m_current(nullptr)
       , m_tufunctions() {}
 
@@ -1245,6 +1319,9 @@ public:
    }
 
    bool VisitVarDecl(VarDecl* vardecl) {
+      if (m_budget.exceeded())
+         return false;
+
       bool modifiable = !IsOutsideSources(vardecl);
 
       auto                 type        = vardecl->getType();
@@ -1328,6 +1405,8 @@ public:
 
 
    bool VisitCallExpr(CallExpr* callexpr) {
+      if (m_budget.exceeded())
+         return false;
       if (IsOutsideSources(callexpr))
          return true;
 
@@ -1553,6 +1632,8 @@ public:
    }
 
    bool VisitBinaryOperator(BinaryOperator* binop) {
+      if (m_budget.exceeded())
+         return false;
 
       if (IsOutsideSources(binop))
          return true;
@@ -1809,6 +1890,8 @@ public:
    }
 
    bool VisitReturnStmt(ReturnStmt* returnstmt) {
+      if (m_budget.exceeded())
+         return false;
       if (!m_current)
          return true;
 
@@ -1953,6 +2036,7 @@ private:
    SourceManager&                 m_sourceManager;
    std::vector<Replacement>&      m_replacements;
    std::set<const FunctionDecl*>& m_lockedFunctions;
+   Budget&                        m_budget;
    FunctionDecl*                  m_current;
    std::set<FunctionDecl*>        m_tufunctions;
 };
@@ -1963,13 +2047,19 @@ class ConstifyConsumer : public ASTConsumer {
 public:
    ConstifyConsumer(UseDefGraph& G, NodeManager& nodes, SourceManager& SM,
                     std::vector<Replacement>&      replacements,
-                    std::set<const FunctionDecl*>& lockedFunctions)
-      : m_visitor(G, nodes, SM, replacements, lockedFunctions) {}
+                    std::set<const FunctionDecl*>& lockedFunctions,
+                    Budget&                        budget)
+      : m_visitor(G, nodes, SM, replacements, lockedFunctions, budget)
+      , m_budget(budget) {}
 
    // Override the method that gets called for each parsed top-level
    // declaration.
    bool HandleTopLevelDecl(DeclGroupRef DR) override {
       for (DeclGroupRef::iterator b = DR.begin(), e = DR.end(); b != e; ++b) {
+         // Over budget: stop parsing, the translation unit is skipped.
+         if (m_budget.check())
+            return false;
+
          // Traverse the declaration using our AST visitor.
          // if b is functionDecl --> switch current function in visitor.
          m_visitor.TraverseDecl(*b);
@@ -1981,6 +2071,7 @@ public:
 
 private:
    ConstifyVisitor m_visitor;
+   Budget&         m_budget;
 };
 
 
@@ -1992,7 +2083,9 @@ public:
       , m_graph()
       , m_entries()
       , m_extraReplacements()
-      , m_lockedFunctions() {}
+      , m_lockedFunctions()
+      , m_budget(std::chrono::seconds(TuTimeout),
+                 static_cast<std::size_t>(TuMemory) * 1024 * 1024) {}
 
    void EndSourceFileAction() override {
       // Do All the rewrite here.
@@ -2001,25 +2094,85 @@ public:
       // merge assignment node together.
 
       SourceManager& SM = m_rewriter.getSourceMgr();
+      if (IncludeMapOutput)
+         IncludeMapOutput->record(getCompilerInstance().getSourceManager());
       if (Verbose || GraphDump)
          dumpGraph(SM);
+      if (tidy::AreStatisticsEnabled())
+         countGraph();
+
+      // What an over budget translation unit produced is thrown away.
+      m_budget.phase("merge");
+      if (overBudget())
+         return;
       mergeAssignmentNodes();
       if (Verbose || GraphDump)
          dumpGraph(SM);
-      auto replacements = computeReplacements(SM);
+
+      m_budget.phase("replacements");
+      if (overBudget())
+         return;
+      std::vector<CensusSite> censusSites;
+      auto replacements = computeReplacements(SM, censusSites);
+      if (overBudget())
+         return;
+
+      if (CensusCounter) {
+         // Nothing is written: only count the constified declarations and
+         // the casts made useless.
+         for (auto& site : censusSites)
+            CensusCounter->record("constify", site.first, 1, site.second);
+         for (auto& r : m_extraReplacements)
+            CensusCounter->record("constify", r.getFilePath(), 0, 1);
+         return;
+      }
+
+      if (JsonLinesOutput) {
+         tidy::JsonLinesRecords records;
+         records.setTranslationUnit(getCurrentFile());
+         for (auto& r : replacements)
+            records.fix("constify", r);
+         JsonLinesOutput->write(records);
+         return;
+      }
       writeReplacements(SM, replacements);
    }
 
    std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance& CI,
                                                   StringRef file) override {
       m_graph.clear();
+      m_budget.start("visit");
       if (Verbose)
          std::cerr << "============ Compute ============\n    " << file.str()
                    << "\n";
       m_rewriter.setSourceMgr(CI.getSourceManager(), CI.getLangOpts());
       return llvm::make_unique<ConstifyConsumer>(
          m_graph, m_nodes, CI.getSourceManager(), m_extraReplacements,
-         m_lockedFunctions);
+         m_lockedFunctions, m_budget);
+   }
+
+   /// Report the translation unit as skipped once over budget.
+   bool overBudget() {
+      if (!m_budget.check())
+         return false;
+
+      ++NumSkipped;
+
+      std::stringstream message;
+      message << m_budget.reason() << " (";
+      m_budget.printTimings(message);
+      message << ")";
+
+      std::cerr << "Skipped " << getCurrentFile().str() << ": "
+                << message.str() << "\n";
+
+      if (JsonLinesOutput) {
+         tidy::JsonLinesRecords records;
+         records.setTranslationUnit(getCurrentFile());
+         records.diagnostic("skipped", getCurrentFile(), 0, 0, message.str());
+         JsonLinesOutput->write(records);
+      }
+      return true;
    }
 
    class Tarjan {
@@ -2030,7 +2183,13 @@ public:
 
       typedef std::list<std::vector<const UseDefGraph::Node_t*>> SCCS;
 
-
+      /// Stop early once \p budget is exceeded, the result is then partial.
+      explicit Tarjan(Budget& budget)
+         : infos()
+         , index(0)
+         , S()
+         , sccs()
+         , budget(budget) {}
 
       SCCS operator()(const UseDefGraph& G) {
          std::for_each(G.beginNodes(), G.endNodes(),
@@ -2049,6 +2208,9 @@ public:
 
    private:
       void strongconnect(const UseDefGraph::Node_t* v) {
+         if (budget.exceeded())
+            return;
+
          infos[v] = std::make_pair(index, index);
          ++index;
          S.push_back(v);
@@ -2079,6 +2241,7 @@ public:
       int                                     index;
       std::vector<const UseDefGraph::Node_t*> S;
       SCCS                                    sccs;
+      Budget&                                 budget;
    };
 
 
@@ -2117,7 +2280,9 @@ public:
       if (Verbose)
          std::cerr << "\n============= SCCs ==============\n";
 
-      auto sccs = Tarjan()(m_graph);
+      auto sccs = Tarjan(m_budget)(m_graph);
+      if (m_budget.check())
+         return;
 
       if (Verbose) {
          std::stringstream buffer;
@@ -2137,8 +2302,12 @@ public:
                         [](const std::vector<const UseDefGraph::Node_t*>& scc) {
                            return scc.size() < 2;
                         });
+      NumSccsMerged += sccs.size();
 
       for (auto scc : sccs) {
+         if (m_budget.exceeded())
+            return;
+
          std::vector<UseDefNode*> contributors = ExtractContributors(scc);
          std::vector<UseDefNode*> predecessors = ExtractPredecessors(scc);
          std::vector<UseDefNode*> neighbors    = ExtractNeighbors(scc);
@@ -2161,6 +2330,13 @@ public:
       }
    }
 
+   void countGraph() {
+      for (auto n = m_graph.beginNodes(); n != m_graph.endNodes(); ++n) {
+         ++NumNodes;
+         NumEdges += (*n)->Neighbors().size();
+      }
+   }
+
    void dumpGraph(SourceManager& SM) {
       std::stringstream graphstr;
       graphstr << make_named_graph(
@@ -2170,19 +2346,27 @@ public:
                 << graphstr.str() << "\n";
    }
 
-   std::vector<Replacement> computeReplacements(SourceManager& SM) {
+   /// File of a constified declaration and its number of replacements.
+   typedef std::pair<std::string, unsigned> CensusSite;
+
+   std::vector<Replacement> computeReplacements(
+      SourceManager& SM, std::vector<CensusSite>& censusSites) {
       if (Verbose)
          std::cerr << "\n============ Actions ============\n";
 
       std::vector<Replacement>       replacements(m_extraReplacements);
       std::set<const FileEntry*>&    entries         = m_entries;
       std::set<const FunctionDecl*>& lockedFunctions = m_lockedFunctions;
+      Budget&                        budget          = m_budget;
 
       m_entries.insert(SM.getFileEntryForID(SM.getMainFileID()));
 
       TopologicalVisit(
-         m_graph, [&replacements, &SM, &entries,
-                   &lockedFunctions](const UseDefGraph::Node_t& n) {
+         m_graph, [&replacements, &SM, &entries, &lockedFunctions, &budget,
+                   &censusSites](const UseDefGraph::Node_t& n) {
+            if (budget.exceeded())
+               return;
+
             std::stringstream buffer;
 
             const UseDefNode* current = n.value();
@@ -2200,15 +2384,24 @@ public:
                   couldbeconst &= next.value()->isConst();
 
                if (couldbeconst) {
+                  auto previousCount = replacements.size();
                   current->constify(SM, replacements);
+                  ++NumConstified;
                   if (auto decl = current->getDecl()) {
                      auto fileid    = SM.getFileID(decl->getLocation());
                      auto fileentry = SM.getFileEntryForID(fileid);
                      entries.insert(fileentry);
+
+                     if (CensusCounter)
+                        censusSites.emplace_back(
+                           SM.getFilename(SM.getFileLoc(decl->getLocation()))
+                              .str(),
+                           replacements.size() - previousCount);
                   }
                   buffer << " <-- to constify";
                }
                else {
+                  ++NumStayUnconst;
                   buffer << " <-- stay unconst";
                }
             }
@@ -2318,12 +2511,13 @@ private:
    std::set<const FileEntry*>    m_entries;
    std::vector<Replacement>      m_extraReplacements;
    std::set<const FunctionDecl*> m_lockedFunctions;
+   Budget                        m_budget;
 };
 
 
 
 int main(int argc, const char** argv) {
-   CommonOptionsParser op(argc, argv, ConstifyCategory);
+   tidy::OptionsParser op(argc, argv, ConstifyCategory);
 
    std::unique_ptr<IgnoringDiagConsumer> diagConsumer;
    if (!Quiet)
@@ -2332,6 +2526,127 @@ int main(int argc, const char** argv) {
    ClangTool Tool(op.getCompilations(), op.getSourcePathList());
    Tool.setDiagnosticConsumer(diagConsumer.get());
 
-   int res = Tool.run(newFrontendActionFactory<ConstifyFrontendAction>().get());
+   if (Stats || !StatsJson.empty())
+      tidy::EnableStatistics();
+
+   std::unique_ptr<tidy::JsonLinesWriter> jsonLines;
+   if (!JsonLines.empty()) {
+      std::error_code EC;
+      jsonLines = llvm::make_unique<tidy::JsonLinesWriter>(JsonLines, EC);
+      if (EC) {
+         std::cerr << "Error opening file: " << EC.message() << "\n";
+         return 1;
+      }
+      JsonLinesOutput = jsonLines.get();
+   }
+
+   std::unique_ptr<tidy::Census> census;
+   if (CensusOnly) {
+      census        = llvm::make_unique<tidy::Census>(CensusDepth);
+      CensusCounter = census.get();
+   }
+
+   // The include map is created by the first run, an existing one must load.
+   tidy::IncludeMap includeMap;
+   if (!op.getIncludeMapPath().empty()) {
+      std::string error;
+      if (sys::fs::exists(op.getIncludeMapPath()) &&
+          !includeMap.load(op.getIncludeMapPath(), error)) {
+         std::cerr << error << "\n";
+         return 1;
+      }
+      IncludeMapOutput = &includeMap;
+   }
+
+   auto actions = newFrontendActionFactory<ConstifyFrontendAction>();
+   auto factory = llvm::make_unique<tidy::AstCacheActionFactory>(
+      actions.get(), op.getAstCache());
+   factory->setIncludeMap(IncludeMapOutput);
+
+   int res = 0;
+   if (Workers > 0 && tidy::WorkerPool::isSupported()) {
+      auto& sources = op.getSourcePathList();
+
+      // Replacement files are numbered by source, not by worker.
+      std::map<std::string, int> indexes;
+      for (std::size_t i = 0; i < sources.size(); ++i)
+         indexes.insert(std::make_pair(sources[i], static_cast<int>(i)));
+
+      tidy::WorkerOutputs outputs;
+      outputs.JsonLines = JsonLinesOutput;
+      outputs.Counter   = CensusCounter;
+      outputs.Includes  = IncludeMapOutput;
+
+      auto runSource = [&](const std::string& source) {
+         GlobalIndex = indexes[source];
+
+         ClangTool local(op.getCompilations(), {source});
+         local.setDiagnosticConsumer(diagConsumer.get());
+         return local.run(factory.get());
+      };
+
+      std::set<std::string> processed;
+      tidy::WorkerPool      pool(Workers);
+      bool                  succeeded = pool.run(
+         sources,
+         [&](const std::string& source, const tidy::WorkerPool::Sender& send) {
+            outputs.beginSource();
+            if (runSource(source) != 0)
+               send(MessageFailed, StringRef());
+
+            outputs.send(send);
+            send(MessageDone, StringRef());
+         },
+         [&](const std::string& source, char kind, StringRef data) {
+            processed.insert(source);
+            if (kind == MessageFailed)
+               res = 1;
+            else if (kind != MessageDone)
+               outputs.merge(kind, data);
+         });
+      pool.printFailures(std::cerr);
+
+      // The workers could not be started or replaced: the sources they did
+      // not reach are processed here. The ones which crashed a worker are
+      // not tried again.
+      if (!succeeded) {
+         res = 1;
+         for (auto& failure : pool.failures())
+            processed.insert(failure.Source);
+
+         std::vector<std::string> remaining;
+         for (auto& source : sources) {
+            if (!processed.count(source))
+               remaining.push_back(source);
+         }
+         if (!remaining.empty()) {
+            std::cerr << remaining.size()
+                      << " source(s) not processed by the workers, "
+                         "processing them in process.\n";
+            for (auto& source : remaining)
+               runSource(source);
+         }
+      }
+   }
+   else {
+      if (Workers > 0)
+         std::cerr << "Worker processes are not supported, running in "
+                      "process.\n";
+      res = Tool.run(factory.get());
+   }
+
+   if (IncludeMapOutput) {
+      std::string error;
+      if (!includeMap.save(op.getIncludeMapPath(), error))
+         std::cerr << error << "\n";
+   }
+
+   if (census)
+      census->print(std::cout);
+
+   if (Stats)
+      tidy::PrintStatistics(std::cerr);
+   if (!StatsJson.empty())
+      tidy::WriteStatisticsJson(StatsJson);
    return res;
 }
@@ -26,12 +26,14 @@
  * Simple tool to print the overloads available during function selection.
  */
 
+#include "AstCache.hpp"
+#include "OptionsParser.hpp"
+
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Lex/Lexer.h"
-#include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/Support/CommandLine.h"
@@ -56,7 +58,7 @@ using namespace clang::tooling;
 using namespace llvm;
 
 // Set up the command line options
-static cl::extrahelp        CommonHelp(CommonOptionsParser::HelpMessage);
+static cl::extrahelp        CommonHelp(tidy::OptionsParser::HelpMessage);
 static cl::OptionCategory   ClangWhyCategory("clang-why options");
 static cl::opt<std::string> FctName(
    "function",
@@ -149,12 +151,16 @@ public:
 
 int main(int argc, const char** argv) {
    //  llvm::sys::PrintStackTraceOnErrorSignal();
-   CommonOptionsParser OptionsParser(argc, argv, ClangWhyCategory);
+   tidy::OptionsParser OptionsParser(argc, argv, ClangWhyCategory);
 
    if (FctName.empty())
       return 1;
 
    RefactoringTool Tool(OptionsParser.getCompilations(),
                         OptionsParser.getSourcePathList());
-   return Tool.run(newFrontendActionFactory<ConsumerAction>().get());
+   auto actions = newFrontendActionFactory<ConsumerAction>();
+
+   tidy::AstCacheActionFactory factory(actions.get(),
+                                       OptionsParser.getAstCache());
+   return Tool.run(&factory);
 }
@@ -0,0 +1,466 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "AstCache.hpp"
+#include "IncludeMap.hpp"
+#include "Statistics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclGroup.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Frontend/PCHContainerOperations.h"
+#include "clang/Serialization/ASTWriter.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+using namespace clang::tooling;
+using namespace llvm;
+
+namespace tidy {
+
+namespace {
+
+static Statistic NumHits("ast-cache", "hits", "Sources loaded from snapshots");
+static Statistic NumMisses("ast-cache", "misses", "Sources without snapshot");
+static Statistic NumStale("ast-cache", "stale",
+                          "Snapshots dropped because an input changed");
+static Statistic NumStored("ast-cache", "stored", "Snapshots stored");
+static Statistic NumEvicted("ast-cache", "evicted",
+                            "Snapshots evicted by the size limit");
+
+const char* const ManifestHeader = "# tidy ast snapshot v1";
+
+/// Absolute, dot-free and native form of \p Path, relative paths being
+/// resolved by the \p FM of the translation unit.
+std::string NormalizedPath(const FileManager& FM, StringRef Path) {
+   SmallString<256> absolute(Path);
+   FM.makeAbsolutePath(absolute);
+   sys::path::remove_dots(absolute, /*remove_dot_dot=*/true);
+   SmallString<256> native;
+   sys::path::native(absolute, native);
+   return native.str().str();
+}
+
+/// Write \p Data to \p Path through a temporary file, so that readers never
+/// see a partial file.
+bool WriteAtomically(StringRef Path, StringRef Data) {
+   int              FD;
+   SmallString<256> temporary;
+   if (sys::fs::createUniqueFile(Path + "-%%%%%%.tmp", FD, temporary))
+      return false;
+
+   {
+      raw_fd_ostream out(FD, /*shouldClose=*/true);
+      out << Data;
+      if (out.has_error()) {
+         out.clear_error();
+         sys::fs::remove(temporary);
+         return false;
+      }
+   }
+
+   if (sys::fs::rename(temporary, Path)) {
+      sys::fs::remove(temporary);
+      return false;
+   }
+   return true;
+}
+
+/// Mark \p Path as recently used.
+void Touch(StringRef Path) {
+   int FD;
+   if (sys::fs::openFileForRead(Path, FD))
+      return;
+   sys::fs::setLastModificationAndAccessTime(FD,
+                                             std::chrono::system_clock::now());
+   sys::Process::SafelyCloseFileDescriptor(FD);
+}
+
+/// Store the serialized AST of a translation unit once it is complete.
+class SnapshotWriter : public ASTConsumer {
+public:
+   SnapshotWriter(AstCache& Cache, StringRef Key,
+                  std::shared_ptr<PCHBuffer> Buffer, const SourceManager& SM)
+      : m_cache(Cache)
+      , m_key(Key)
+      , m_buffer(std::move(Buffer))
+      , m_sourceManager(SM) {}
+
+   void HandleTranslationUnit(ASTContext& Context) override {
+      if (!m_buffer->IsComplete || Context.getDiagnostics().hasErrorOccurred())
+         return;
+
+      auto& FM = m_sourceManager.getFileManager();
+
+      std::vector<AstCache::Input> inputs;
+      for (auto it = m_sourceManager.fileinfo_begin();
+           it != m_sourceManager.fileinfo_end();
+           ++it) {
+         inputs.push_back({NormalizedPath(FM, it->first->getName()),
+                           static_cast<std::uint64_t>(it->first->getSize()),
+                           it->first->getModificationTime()});
+      }
+
+      StringRef data(m_buffer->Data.data(), m_buffer->Data.size());
+      if (!m_cache.store(m_key, data, inputs))
+         std::cerr << "Cannot store the AST snapshot "
+                   << m_cache.snapshotPath(m_key) << "\n";
+   }
+
+private:
+   AstCache&                  m_cache;
+   std::string                m_key;
+   std::shared_ptr<PCHBuffer> m_buffer;
+   const SourceManager&       m_sourceManager;
+};
+
+/// Run the wrapped action, serializing its AST on the way as a PCH would.
+class SnapshotAction : public WrapperFrontendAction {
+public:
+   SnapshotAction(std::unique_ptr<FrontendAction> Action, AstCache& Cache,
+                  StringRef Key)
+      : WrapperFrontendAction(std::move(Action))
+      , m_cache(Cache)
+      , m_key(Key) {}
+
+protected:
+   std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance& CI,
+                                                  StringRef InFile) override {
+      auto consumer = WrapperFrontendAction::CreateASTConsumer(CI, InFile);
+
+      // A snapshot without bodies would not do for every tool.
+      if (!consumer || CI.getFrontendOpts().SkipFunctionBodies)
+         return consumer;
+
+      auto buffer = std::make_shared<PCHBuffer>();
+
+      std::vector<std::unique_ptr<ASTConsumer>> consumers;
+      consumers.push_back(std::move(consumer));
+      consumers.push_back(llvm::make_unique<PCHGenerator>(
+         CI.getPreprocessor(), m_cache.snapshotPath(m_key), "", buffer,
+         CI.getFrontendOpts().ModuleFileExtensions));
+      consumers.push_back(llvm::make_unique<SnapshotWriter>(
+         m_cache, m_key, buffer, CI.getSourceManager()));
+      return llvm::make_unique<MultiplexConsumer>(std::move(consumers));
+   }
+
+private:
+   AstCache&   m_cache;
+   std::string m_key;
+};
+
+/// Hand the top-level declarations of a snapshot to \p Consumer as the parser
+/// would, the AST reader only passing the ones code generation needs.
+class ReplayConsumer : public ASTConsumer {
+public:
+   explicit ReplayConsumer(std::unique_ptr<ASTConsumer> Consumer)
+      : m_consumer(std::move(Consumer)) {}
+
+   void Initialize(ASTContext& Context) override {
+      m_consumer->Initialize(Context);
+   }
+
+   bool HandleTopLevelDecl(DeclGroupRef) override {
+      return true;
+   }
+
+   void HandleInterestingDecl(DeclGroupRef) override {}
+
+   void HandleTranslationUnit(ASTContext& Context) override {
+      for (auto decl : Context.getTranslationUnitDecl()->decls()) {
+         if (!m_consumer->HandleTopLevelDecl(DeclGroupRef(decl)))
+            break;
+      }
+      m_consumer->HandleTranslationUnit(Context);
+   }
+
+private:
+   std::unique_ptr<ASTConsumer> m_consumer;
+};
+
+class ReplayAction : public WrapperFrontendAction {
+public:
+   explicit ReplayAction(std::unique_ptr<FrontendAction> Action)
+      : WrapperFrontendAction(std::move(Action)) {}
+
+protected:
+   std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance& CI,
+                                                  StringRef InFile) override {
+      auto consumer = WrapperFrontendAction::CreateASTConsumer(CI, InFile);
+      if (!consumer)
+         return consumer;
+      return llvm::make_unique<ReplayConsumer>(std::move(consumer));
+   }
+};
+
+}  // namespace
+
+AstCache::AstCache(StringRef Directory, std::uint64_t MaxBytes)
+   : m_directory(Directory)
+   , m_maxBytes(MaxBytes) {
+   if (auto EC = sys::fs::create_directories(m_directory))
+      std::cerr << "Cannot create " << m_directory << ": " << EC.message()
+                << "\n";
+}
+
+std::string AstCache::key(const CompilerInvocation& Invocation,
+                          StringRef                 MainFile) {
+   // The module hash covers the language and target options and the macros,
+   // not the include paths nor the forced includes.
+   std::string        text;
+   raw_string_ostream out(text);
+   out << getClangFullRepositoryVersion() << "\n"
+       << Invocation.getModuleHash() << "\n";
+   for (auto& entry : Invocation.getHeaderSearchOpts().UserEntries)
+      out << "-I" << static_cast<int>(entry.Group) << entry.Path << "\n";
+   for (auto& include : Invocation.getPreprocessorOpts().Includes)
+      out << "-include" << include << "\n";
+   for (auto& macro : Invocation.getPreprocessorOpts().Macros)
+      out << (macro.second ? "-U" : "-D") << macro.first << "\n";
+   out << MainFile;
+   out.flush();
+
+   MD5 hash;
+   hash.update(text);
+   MD5::MD5Result result;
+   hash.final(result);
+   SmallString<32> digest;
+   MD5::stringifyResult(result, digest);
+   return digest.str().str();
+}
+
+std::string AstCache::snapshotPath(StringRef Key) const {
+   SmallString<256> path(m_directory);
+   sys::path::append(path, Key + ".ast");
+   return path.str().str();
+}
+
+std::string AstCache::manifestPath(StringRef Key) const {
+   SmallString<256> path(m_directory);
+   sys::path::append(path, Key + ".inputs");
+   return path.str().str();
+}
+
+std::string AstCache::lookup(StringRef                 Key,
+                             std::vector<std::string>* Inputs) {
+   auto snapshot = snapshotPath(Key);
+   auto manifest = MemoryBuffer::getFile(manifestPath(Key));
+   if (!manifest || !sys::fs::exists(snapshot)) {
+      ++NumMisses;
+      return std::string();
+   }
+
+   SmallVector<StringRef, 256> lines;
+   (*manifest)->getBuffer().split(lines, '\n', -1, false);
+   if (lines.empty() || lines.front() != ManifestHeader) {
+      ++NumMisses;
+      return std::string();
+   }
+
+   std::vector<std::string> paths;
+   for (auto line : makeArrayRef(lines).drop_front()) {
+      StringRef     size, time, path;
+      std::uint64_t expectedSize = 0;
+      std::int64_t  expectedTime = 0;
+      std::tie(size, line) = line.split('\t');
+      std::tie(time, path) = line.split('\t');
+
+      sys::fs::file_status status;
+      if (size.getAsInteger(10, expectedSize) ||
+          time.getAsInteger(10, expectedTime) ||
+          sys::fs::status(path, status) || status.getSize() != expectedSize ||
+          sys::toTimeT(status.getLastModificationTime()) != expectedTime) {
+         ++NumStale;
+         remove(Key);
+         return std::string();
+      }
+      paths.push_back(path.str());
+   }
+
+   if (Inputs)
+      Inputs->insert(Inputs->end(), paths.begin(), paths.end());
+   ++NumHits;
+   Touch(snapshot);
+   return snapshot;
+}
+
+bool AstCache::store(StringRef Key, StringRef Data,
+                     const std::vector<Input>& Inputs) {
+   std::string        manifest;
+   raw_string_ostream out(manifest);
+   out << ManifestHeader << "\n";
+   for (auto& input : Inputs)
+      out << input.Size << '\t' << input.ModificationTime << '\t'
+          << input.Path << "\n";
+   out.flush();
+
+   // The manifest is written last, a snapshot without one is not used.
+   if (!WriteAtomically(snapshotPath(Key), Data) ||
+       !WriteAtomically(manifestPath(Key), manifest))
+      return false;
+
+   ++NumStored;
+   evict();
+   return true;
+}
+
+void AstCache::remove(StringRef Key) {
+   sys::fs::remove(manifestPath(Key));
+   sys::fs::remove(snapshotPath(Key));
+}
+
+void AstCache::evict() {
+   struct Snapshot {
+      std::string      Key;
+      std::uint64_t    Size;
+      sys::TimePoint<> LastUse;
+   };
+
+   std::vector<Snapshot> snapshots;
+   std::uint64_t         total = 0;
+
+   std::error_code EC;
+   for (sys::fs::directory_iterator it(m_directory, EC), end;
+        it != end && !EC;
+        it.increment(EC)) {
+      StringRef path = it->path();
+      if (sys::path::extension(path) != ".ast")
+         continue;
+
+      sys::fs::file_status status;
+      if (sys::fs::status(path, status))
+         continue;
+      snapshots.push_back({sys::path::stem(path).str(), status.getSize(),
+                           status.getLastModificationTime()});
+      total += status.getSize();
+   }
+
+   if (total <= m_maxBytes)
+      return;
+
+   std::sort(snapshots.begin(), snapshots.end(),
+             [](const Snapshot& lhs, const Snapshot& rhs) {
+                return lhs.LastUse < rhs.LastUse;
+             });
+   for (auto& snapshot : snapshots) {
+      if (total <= m_maxBytes)
+         break;
+      remove(snapshot.Key);
+      total -= snapshot.Size;
+      ++NumEvicted;
+   }
+}
+
+
+bool AstCacheActionFactory::runInvocation(
+   std::shared_ptr<CompilerInvocation>     Invocation,
+   FileManager*                            Files,
+   std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+   DiagnosticConsumer*                     DiagConsumer) {
+   m_mode = Mode::Forward;
+
+   auto& inputs = Invocation->getFrontendOpts().Inputs;
+   if (!m_cache || inputs.size() != 1 || !inputs.front().isFile() ||
+       inputs.front().getKind().getFormat() != InputKind::Source)
+      return FrontendActionFactory::runInvocation(
+         std::move(Invocation), Files, std::move(PCHContainerOps),
+         DiagConsumer);
+
+   auto mainFile = NormalizedPath(*Files, inputs.front().getFile());
+   m_key         = AstCache::key(*Invocation, mainFile);
+
+   std::vector<std::string> includes;
+   auto snapshot = m_cache->lookup(m_key, &includes);
+   if (snapshot.empty() || !m_loadSnapshots) {
+      // An up-to-date snapshot is kept as is.
+      if (snapshot.empty())
+         m_mode = Mode::Store;
+      return FrontendActionFactory::runInvocation(
+         std::move(Invocation), Files, std::move(PCHContainerOps),
+         DiagConsumer);
+   }
+
+   // The options of the parse are read back from the snapshot.
+   m_mode         = Mode::Load;
+   inputs.front() = FrontendInputFile(
+      snapshot, InputKind(InputKind::Unknown, InputKind::Precompiled));
+   bool succeeded = FrontendActionFactory::runInvocation(
+      std::move(Invocation), Files, std::move(PCHContainerOps), DiagConsumer);
+   if (!succeeded) {
+      std::cerr << "Dropping the AST snapshot of " << mainFile << "\n";
+      m_cache->remove(m_key);
+   }
+   else if (m_includes) {
+      // The preprocessor did not run, the snapshot manifest lists the files
+      // of the parse.
+      m_includes->record(mainFile, includes);
+   }
+   return succeeded;
+}
+
+FrontendAction* AstCacheActionFactory::create() {
+   std::unique_ptr<FrontendAction> action(m_inner->create());
+   switch (m_mode) {
+   case Mode::Store:
+      return new SnapshotAction(std::move(action), *m_cache, m_key);
+   case Mode::Load:
+      return new ReplayAction(std::move(action));
+   case Mode::Forward:
+      break;
+   }
+   return action.release();
+}
+
+StringRef GetMainSourceName(CompilerInstance& CI) {
+   auto& inputs = CI.getFrontendOpts().Inputs;
+   if (inputs.empty())
+      return StringRef();
+
+   if (inputs.front().getKind().getFormat() == InputKind::Precompiled &&
+       CI.hasSourceManager()) {
+      auto& SM   = CI.getSourceManager();
+      auto  main = SM.getFileEntryForID(SM.getMainFileID());
+      if (main)
+         return main->getName();
+   }
+   return inputs.front().getFile();
+}
+
+}  // namespace tidy
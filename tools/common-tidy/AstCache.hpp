@@ -0,0 +1,151 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef AST_CACHE_HPP
+#define AST_CACHE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace tidy {
+
+class IncludeMap;
+
+/// On-disk cache of serialized ASTs, shared by the tools running over the
+/// same sources.
+///
+/// A snapshot is keyed by a hash of the compiler invocation of its source
+/// (language and target options, macros, include paths) and of the clang
+/// version. A manifest next to it lists the files read by the parse with
+/// their size and modification time, and the snapshot is only used while
+/// none of them changed: the AST reader would reject it anyway. Once the
+/// cache grows over its size limit, the least recently used snapshots are
+/// removed.
+///
+/// Tools read and fill it through AstCacheActionFactory.
+class AstCache {
+public:
+   struct Input {
+      std::string   Path;
+      std::uint64_t Size;
+      std::int64_t  ModificationTime;
+   };
+
+   AstCache(llvm::StringRef Directory, std::uint64_t MaxBytes);
+
+   /// Key of the snapshot of \p MainFile parsed with \p Invocation.
+   static std::string key(const clang::CompilerInvocation& Invocation,
+                          llvm::StringRef                  MainFile);
+
+   /// Path of the up-to-date snapshot of \p Key, empty if there is none.
+   /// The files read by its parse are added to \p Inputs, unless null.
+   std::string lookup(llvm::StringRef           Key,
+                      std::vector<std::string>* Inputs = nullptr);
+
+   /// Store \p Data as the snapshot of \p Key, parsed from \p Inputs.
+   bool store(llvm::StringRef Key, llvm::StringRef Data,
+              const std::vector<Input>& Inputs);
+
+   void remove(llvm::StringRef Key);
+
+   std::string snapshotPath(llvm::StringRef Key) const;
+
+private:
+   std::string manifestPath(llvm::StringRef Key) const;
+
+   void evict();
+
+private:
+   std::string   m_directory;
+   std::uint64_t m_maxBytes;
+};
+
+/// Frontend action factory running the actions of \p Inner on the snapshots
+/// of \p Cache when they are up to date. Otherwise, the source is parsed and
+/// its AST is stored in the cache, unless function bodies are skipped or
+/// errors occurred.
+///
+/// A snapshot is not parsed again: its top-level declarations are handed to
+/// the consumer of the action in order, before the end of the translation
+/// unit, and preprocessor callbacks are not called. The includes of a
+/// snapshot are recorded in the include map set by setIncludeMap() from its
+/// manifest instead, and actions relying on other callbacks turn snapshot
+/// loading off.
+///
+/// Without a cache, it only forwards to \p Inner.
+class AstCacheActionFactory : public clang::tooling::FrontendActionFactory {
+public:
+   AstCacheActionFactory(clang::tooling::FrontendActionFactory* Inner,
+                         AstCache*                              Cache)
+      : m_inner(Inner)
+      , m_cache(Cache)
+      , m_includes(nullptr)
+      , m_loadSnapshots(true)
+      , m_mode(Mode::Forward)
+      , m_key() {}
+
+   /// Record the includes of the sources loaded from snapshots in \p Map.
+   void setIncludeMap(IncludeMap* Map) {
+      m_includes = Map;
+   }
+
+   /// When false, up-to-date snapshots are not loaded and their sources are
+   /// parsed, e.g. for the preprocessor callbacks of clang-tidy checks.
+   void setLoadSnapshots(bool Load) {
+      m_loadSnapshots = Load;
+   }
+
+   bool runInvocation(
+      std::shared_ptr<clang::CompilerInvocation>     Invocation,
+      clang::FileManager*                            Files,
+      std::shared_ptr<clang::PCHContainerOperations> PCHContainerOps,
+      clang::DiagnosticConsumer*                     DiagConsumer) override;
+
+   clang::FrontendAction* create() override;
+
+private:
+   enum class Mode { Forward, Store, Load };
+
+   clang::tooling::FrontendActionFactory* m_inner;
+   AstCache*                              m_cache;
+   IncludeMap*                            m_includes;
+   bool                                   m_loadSnapshots;
+   Mode                                   m_mode;
+   std::string                            m_key;
+};
+
+/// Name of the source processed by \p CI, the source a snapshot was built
+/// from rather than the snapshot itself.
+llvm::StringRef GetMainSourceName(clang::CompilerInstance& CI);
+
+}  // namespace tidy
+
+#endif
@@ -0,0 +1,183 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Census.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+
+namespace tidy {
+
+namespace {
+
+const unsigned HistogramWidth = 40;
+
+SmallVector<StringRef, 16> Components(StringRef Directory) {
+   SmallVector<StringRef, 16> components(sys::path::begin(Directory),
+                                         sys::path::end(Directory));
+   return components;
+}
+
+}  // namespace
+
+Census::Census(unsigned Depth)
+   : m_mutex()
+   , m_depth(Depth)
+   , m_counts() {}
+
+void Census::record(StringRef Transform, StringRef File, unsigned Matches,
+                    unsigned Replacements) {
+   auto directory = sys::path::parent_path(File);
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   auto& counts = m_counts[Transform.str()][directory.str()];
+   counts.Matches += Matches;
+   counts.Replacements += Replacements;
+}
+
+std::string Census::take() {
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   // One "transform<TAB>directory<TAB>matches<TAB>replacements" per line.
+   std::string data;
+   for (auto& transform : m_counts) {
+      for (auto& directory : transform.second) {
+         data += transform.first + "\t" + directory.first + "\t" +
+                 std::to_string(directory.second.Matches) + "\t" +
+                 std::to_string(directory.second.Replacements) + "\n";
+      }
+   }
+   m_counts.clear();
+   return data;
+}
+
+void Census::merge(StringRef Data) {
+   SmallVector<StringRef, 64> lines;
+   Data.split(lines, '\n', -1, false);
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   for (auto line : lines) {
+      SmallVector<StringRef, 4> fields;
+      line.split(fields, '\t');
+      if (fields.size() != 4)
+         continue;
+
+      unsigned long matches      = 0;
+      unsigned long replacements = 0;
+      fields[2].getAsInteger(10, matches);
+      fields[3].getAsInteger(10, replacements);
+
+      auto& counts = m_counts[fields[0].str()][fields[1].str()];
+      counts.Matches += matches;
+      counts.Replacements += replacements;
+   }
+}
+
+void Census::print(std::ostream& ostr) const {
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   // Directory shared by every recorded site, prefixes are relative to it.
+   bool                       first = true;
+   SmallVector<StringRef, 16> root;
+   for (auto& transform : m_counts) {
+      for (auto& directory : transform.second) {
+         auto components = Components(directory.first);
+         if (first) {
+            root  = components;
+            first = false;
+            continue;
+         }
+         auto mismatch =
+            std::mismatch(root.begin(), root.end(), components.begin(),
+                          components.end());
+         root.erase(mismatch.first, root.end());
+      }
+   }
+
+   SmallString<256> rootPath;
+   for (auto& c : root)
+      sys::path::append(rootPath, c);
+   ostr << "Census of " << (rootPath.empty() ? "." : rootPath.str().str())
+        << "\n";
+
+   for (auto& transform : m_counts) {
+      std::map<std::string, Counts> byPrefix;
+      Counts                        total;
+      for (auto& directory : transform.second) {
+         auto components = Components(directory.first);
+
+         std::string prefix;
+         for (std::size_t i = root.size();
+              i < components.size() && i < root.size() + m_depth;
+              ++i) {
+            if (!prefix.empty())
+               prefix += '/';
+            prefix += components[i];
+         }
+         if (prefix.empty())
+            prefix = ".";
+
+         auto& counts = byPrefix[prefix];
+         counts.Matches += directory.second.Matches;
+         counts.Replacements += directory.second.Replacements;
+         total.Matches += directory.second.Matches;
+         total.Replacements += directory.second.Replacements;
+      }
+
+      ostr << "\n"
+           << transform.first << ": " << total.Matches << " matches, "
+           << total.Replacements << " replacements\n";
+
+      std::vector<std::pair<std::string, Counts>> sorted(byPrefix.begin(),
+                                                         byPrefix.end());
+      std::stable_sort(sorted.begin(), sorted.end(),
+                       [](const std::pair<std::string, Counts>& lhs,
+                          const std::pair<std::string, Counts>& rhs) {
+                          return lhs.second.Matches > rhs.second.Matches;
+                       });
+
+      std::size_t nameWidth = 0;
+      for (auto& p : sorted)
+         nameWidth = std::max(nameWidth, p.first.size());
+
+      unsigned long highest = sorted.empty() ? 0 : sorted.front().second.Matches;
+      for (auto& p : sorted) {
+         auto bar = highest ? p.second.Matches * HistogramWidth / highest : 0;
+         ostr << "   " << std::left << std::setw(nameWidth) << p.first
+              << std::right << std::setw(9) << p.second.Matches
+              << std::setw(9) << p.second.Replacements << "  "
+              << std::string(bar, '#') << "\n";
+      }
+   }
+}
+
+}  // namespace tidy
@@ -0,0 +1,72 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef CENSUS_HPP
+#define CENSUS_HPP
+
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace tidy {
+
+/// Count the sites a transform would touch, without producing any fix.
+///
+/// Sites are recorded per transform and per directory, and printed as a
+/// histogram grouped by the first \c Depth directory levels below the
+/// directory shared by every recorded site.
+class Census {
+public:
+   explicit Census(unsigned Depth = 2);
+
+   void record(llvm::StringRef Transform, llvm::StringRef File,
+               unsigned Matches, unsigned Replacements);
+
+   void print(std::ostream& ostr) const;
+
+   /// Return the recorded counts as text and reset them, to be added to
+   /// another census with merge(), e.g. across worker processes.
+   std::string take();
+
+   void merge(llvm::StringRef Data);
+
+private:
+   struct Counts {
+      unsigned long Matches      = 0;
+      unsigned long Replacements = 0;
+   };
+
+   typedef std::map<std::string, Counts> CountsByDirectory;
+
+   mutable std::mutex                       m_mutex;
+   unsigned                                 m_depth;
+   std::map<std::string, CountsByDirectory> m_counts;
+};
+
+}  // namespace tidy
+
+#endif
@@ -0,0 +1,210 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "ClangTidyTransform.hpp"
+#include "AstCache.hpp"
+#include "Census.hpp"
+
+#include <iostream>
+
+#include "ClangTidy.h"
+#include "ClangTidyDiagnosticConsumer.h"
+#include "ClangTidyModuleRegistry.h"
+
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/CompilerInstance.h"
+
+// ClangTidyDiagnosticConsumer::take() appeared in clang-tidy 7; clang-tidy 9
+// moved Diagnostic::Fix into the message and changed createChecks and
+// registerPPCallbacks.
+#if CLANG_VERSION_MAJOR < 7 || CLANG_VERSION_MAJOR > 8
+#error "TIDY_WITH_CLANG_TIDY requires clang-tidy 7 or 8"
+#endif
+
+using namespace clang;
+using namespace clang::tidy;
+using namespace llvm;
+
+// Modules are registered by static objects of their libraries, which are
+// only linked when referenced.
+namespace clang {
+namespace tidy {
+extern volatile int BugproneModuleAnchorSource;
+extern volatile int CppCoreGuidelinesModuleAnchorSource;
+extern volatile int GoogleModuleAnchorSource;
+extern volatile int LLVMModuleAnchorSource;
+extern volatile int MiscModuleAnchorSource;
+extern volatile int ModernizeModuleAnchorSource;
+extern volatile int PerformanceModuleAnchorSource;
+extern volatile int ReadabilityModuleAnchorSource;
+}  // namespace tidy
+}  // namespace clang
+
+namespace tidy {
+
+namespace {
+
+LLVM_ATTRIBUTE_UNUSED int ModuleAnchors[] = {
+   clang::tidy::BugproneModuleAnchorSource,
+   clang::tidy::CppCoreGuidelinesModuleAnchorSource,
+   clang::tidy::GoogleModuleAnchorSource,
+   clang::tidy::LLVMModuleAnchorSource,
+   clang::tidy::MiscModuleAnchorSource,
+   clang::tidy::ModernizeModuleAnchorSource,
+   clang::tidy::PerformanceModuleAnchorSource,
+   clang::tidy::ReadabilityModuleAnchorSource};
+
+std::unique_ptr<ClangTidyOptionsProvider> CreateOptionsProvider(
+   StringRef Checks) {
+   ClangTidyOptions options = ClangTidyOptions::getDefaults();
+   options.Checks           = Checks.str();
+   return llvm::make_unique<DefaultOptionsProvider>(ClangTidyGlobalOptions(),
+                                                    options);
+}
+
+class ClangTidyTransform : public Transform {
+public:
+   ClangTidyTransform(StringRef Checks, TransformContext* ctx)
+      : Transform("clang-tidy", ctx)
+      , m_tidyContext(CreateOptionsProvider(Checks))
+      , m_consumer(m_tidyContext)
+      , m_diagEngine(IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()),
+                     new DiagnosticOptions(), &m_consumer, false)
+      , m_checks()
+      , m_finder(nullptr)
+      , m_compiler(nullptr) {
+      m_tidyContext.setDiagnosticsEngine(&m_diagEngine);
+
+      ClangTidyCheckFactories factories;
+      for (auto I = ClangTidyModuleRegistry::begin(),
+                E = ClangTidyModuleRegistry::end();
+           I != E; ++I)
+         I->instantiate()->addCheckFactories(factories);
+      factories.createChecks(&m_tidyContext, m_checks);
+   }
+
+   bool empty() const {
+      return m_checks.empty();
+   }
+
+   void registerMatchers(MatchFinder* Finder) override {
+      m_finder = Finder;
+   }
+
+   void beginSourceFile(CompilerInstance& CI) override {
+      m_compiler = &CI;
+
+      m_tidyContext.setSourceManager(&CI.getSourceManager());
+      m_tidyContext.setCurrentFile(GetMainSourceName(CI));
+      m_tidyContext.setASTContext(&CI.getASTContext());
+      auto directory = CI.getVirtualFileSystem().getCurrentWorkingDirectory();
+      if (directory)
+         m_tidyContext.setCurrentBuildDirectory(*directory);
+
+      // Checks look at the language options when they register their
+      // matchers, which cannot be removed from the finder: the options of
+      // the first translation unit are used for the whole run.
+      if (m_finder) {
+         for (auto& check : m_checks)
+            check->registerMatchers(m_finder);
+         m_finder = nullptr;
+      }
+
+      for (auto& check : m_checks)
+         check->registerPPCallbacks(CI);
+   }
+
+   void endSourceFile() override {
+      m_consumer.finish();
+      auto errors = m_consumer.take();
+
+      for (auto& error : errors)
+         report(error);
+      m_compiler = nullptr;
+   }
+
+private:
+   /// Report \p error as the other transforms do, in the diagnostics of the
+   /// translation unit, with its fixes in the transform context.
+   void report(const ClangTidyError& error) {
+      ++m_matches;
+
+      unsigned replacements = 0;
+      for (auto& file : error.Fix)
+         replacements += file.second.size();
+
+      if (auto census = m_ctx->census()) {
+         census->record(error.DiagnosticName, error.Message.FilePath, 1,
+                        replacements);
+         return;
+      }
+
+      auto& SM          = m_compiler->getSourceManager();
+      auto& diagnostics = m_compiler->getDiagnostics();
+      auto  loc         = SourceLocation();
+      if (auto entry = SM.getFileManager().getFile(error.Message.FilePath)) {
+         auto id = SM.translateFile(entry);
+         if (id.isValid())
+            loc = SM.getLocForStartOfFile(id).getLocWithOffset(
+               error.Message.FileOffset);
+      }
+
+      if (loc.isValid()) {
+         unsigned ID = diagnostics.getDiagnosticIDs()->getCustomDiagID(
+            DiagnosticIDs::Warning,
+            (error.Message.Message + " [" + error.DiagnosticName + "]")
+               .str());
+         diagnostics.Report(loc, ID);
+      }
+
+      for (auto& file : error.Fix) {
+         for (auto& replacement : file.second) {
+            if (m_ctx->push_back(replacement, error.DiagnosticName))
+               ++m_fixIts;
+         }
+      }
+   }
+
+   ClangTidyContext                             m_tidyContext;
+   ClangTidyDiagnosticConsumer                  m_consumer;
+   DiagnosticsEngine                            m_diagEngine;
+   std::vector<std::unique_ptr<ClangTidyCheck>> m_checks;
+   MatchFinder*                                 m_finder;
+   CompilerInstance*                            m_compiler;
+};
+
+}  // namespace
+
+std::unique_ptr<Transform> createClangTidyTransform(StringRef         Checks,
+                                                   TransformContext* Context) {
+   auto transform = llvm::make_unique<ClangTidyTransform>(Checks, Context);
+   if (transform->empty()) {
+      std::cerr << "No clang-tidy check enabled by '" << Checks.str()
+                << "'.\n";
+      return nullptr;
+   }
+   return std::move(transform);
+}
+
+}  // namespace tidy
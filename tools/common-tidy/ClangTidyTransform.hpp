@@ -0,0 +1,49 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef CLANG_TIDY_TRANSFORM_HPP
+#define CLANG_TIDY_TRANSFORM_HPP
+
+#include <memory>
+
+#include "Transform.hpp"
+
+#include "llvm/ADT/StringRef.h"
+
+namespace tidy {
+
+/// Create a transform running the clang-tidy checks enabled by \p Checks,
+/// a clang-tidy glob list, in process.
+///
+/// Their matchers go in the MatchFinder of the other transforms and their
+/// fixes in \p Context, so a mixed run parses each translation unit once.
+/// Return nullptr if no check is enabled.
+///
+/// Only available when built with TIDY_WITH_CLANG_TIDY.
+std::unique_ptr<Transform> createClangTidyTransform(llvm::StringRef   Checks,
+                                                    TransformContext* Context);
+
+}  // namespace tidy
+
+#endif
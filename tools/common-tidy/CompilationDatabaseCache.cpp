@@ -0,0 +1,390 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "CompilationDatabaseCache.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#include "clang/Tooling/FileMatchTrie.h"
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace clang::tooling;
+using namespace llvm;
+
+namespace tidy {
+
+namespace {
+
+const char     CacheMagic[8] = {'T', 'I', 'D', 'Y', 'C', 'D', 'B', '\0'};
+// Version 2 stores the file paths without dots.
+const uint64_t CacheVersion  = 2;
+
+// Layout of the cache file, in native byte order:
+//    CacheHeader
+//    CacheEntry  [EntryCount]   sorted by file path
+//    CacheString [StringCount]  interned strings, as offset/length in blob
+//    uint32_t    [ArgCount]     command line arguments, as string ids
+//    char        [BlobSize]     strings contents
+struct CacheHeader {
+   char     Magic[8];
+   uint64_t Version;
+   uint64_t SourceSize;
+   uint64_t SourceModificationTime;
+   uint64_t SourceHash;
+   uint64_t EntryCount;
+   uint64_t StringCount;
+   uint64_t ArgCount;
+   uint64_t BlobSize;
+};
+
+struct CacheEntry {
+   uint32_t File;
+   uint32_t Directory;
+   uint32_t Output;
+   uint32_t FirstArg;
+   uint32_t ArgCount;
+};
+
+struct CacheString {
+   uint32_t Offset;
+   uint32_t Length;
+};
+
+const CacheHeader* ValidHeader(const MemoryBuffer& Buffer) {
+   if (Buffer.getBufferSize() < sizeof(CacheHeader))
+      return nullptr;
+
+   auto header = reinterpret_cast<const CacheHeader*>(Buffer.getBufferStart());
+   if (std::memcmp(header->Magic, CacheMagic, sizeof(CacheMagic)) != 0 ||
+       header->Version != CacheVersion)
+      return nullptr;
+
+   uint64_t expected = sizeof(CacheHeader) +
+                       header->EntryCount * sizeof(CacheEntry) +
+                       header->StringCount * sizeof(CacheString) +
+                       header->ArgCount * sizeof(uint32_t) + header->BlobSize;
+   if (expected != Buffer.getBufferSize())
+      return nullptr;
+   return header;
+}
+
+std::string NativeAbsolutePath(StringRef Directory, StringRef File) {
+   SmallString<256> Absolute;
+   if (sys::path::is_relative(File)) {
+      Absolute = Directory;
+      sys::path::append(Absolute, File);
+   }
+   else {
+      Absolute = File;
+   }
+   sys::path::remove_dots(Absolute, /*remove_dot_dot=*/true);
+   SmallString<256> Native;
+   sys::path::native(Absolute, Native);
+   return Native.str().str();
+}
+
+
+class BinaryCompilationDatabase : public CompilationDatabase {
+public:
+   explicit BinaryCompilationDatabase(std::unique_ptr<MemoryBuffer> Buffer)
+      : m_buffer(std::move(Buffer)) {
+      auto data = m_buffer->getBufferStart();
+      m_header  = reinterpret_cast<const CacheHeader*>(data);
+      m_entries =
+         reinterpret_cast<const CacheEntry*>(data + sizeof(CacheHeader));
+      m_strings = reinterpret_cast<const CacheString*>(m_entries +
+                                                       m_header->EntryCount);
+      m_args =
+         reinterpret_cast<const uint32_t*>(m_strings + m_header->StringCount);
+      m_blob = reinterpret_cast<const char*>(m_args + m_header->ArgCount);
+   }
+
+   std::vector<CompileCommand> getCompileCommands(
+      StringRef FilePath) const override {
+      SmallString<256> Absolute(FilePath);
+      sys::path::remove_dots(Absolute, /*remove_dot_dot=*/true);
+      SmallString<256> Native;
+      sys::path::native(Absolute, Native);
+
+      auto range = std::equal_range(entriesBegin(), entriesEnd(), Native.str(),
+                                    ByFile{this});
+      if (range.first == range.second) {
+         // As the JSON database does, fall back on an equivalent file of the
+         // database, e.g. reached through a symbolic link.
+         std::call_once(m_matchTrieBuilt, [this] {
+            for (auto& file : getAllFiles())
+               m_matchTrie.insert(file);
+         });
+         std::string        error;
+         raw_string_ostream errorStream(error);
+         auto match = m_matchTrie.findEquivalent(Native, errorStream);
+         if (match.empty())
+            return std::vector<CompileCommand>();
+         range = std::equal_range(entriesBegin(), entriesEnd(), match,
+                                  ByFile{this});
+      }
+
+      std::vector<CompileCommand> commands;
+      std::for_each(range.first, range.second, [&](const CacheEntry& e) {
+         commands.push_back(command(e));
+      });
+      return commands;
+   }
+
+   std::vector<std::string> getAllFiles() const override {
+      std::vector<std::string> files;
+      files.reserve(m_header->EntryCount);
+      for (auto e = entriesBegin(); e != entriesEnd(); ++e) {
+         if (files.empty() || files.back() != string(e->File))
+            files.push_back(string(e->File).str());
+      }
+      return files;
+   }
+
+   std::vector<CompileCommand> getAllCompileCommands() const override {
+      std::vector<CompileCommand> commands;
+      commands.reserve(m_header->EntryCount);
+      std::transform(entriesBegin(), entriesEnd(), std::back_inserter(commands),
+                     [this](const CacheEntry& e) { return command(e); });
+      return commands;
+   }
+
+private:
+   struct ByFile {
+      const BinaryCompilationDatabase* db;
+
+      bool operator()(const CacheEntry& e, StringRef file) const {
+         return db->string(e.File) < file;
+      }
+      bool operator()(StringRef file, const CacheEntry& e) const {
+         return file < db->string(e.File);
+      }
+   };
+
+   const CacheEntry* entriesBegin() const {
+      return m_entries;
+   }
+
+   const CacheEntry* entriesEnd() const {
+      return m_entries + m_header->EntryCount;
+   }
+
+   StringRef string(uint32_t id) const {
+      auto& s = m_strings[id];
+      return StringRef(m_blob + s.Offset, s.Length);
+   }
+
+   CompileCommand command(const CacheEntry& e) const {
+      std::vector<std::string> commandLine;
+      commandLine.reserve(e.ArgCount);
+      for (uint32_t i = 0; i < e.ArgCount; ++i)
+         commandLine.push_back(string(m_args[e.FirstArg + i]).str());
+      return CompileCommand(string(e.Directory), string(e.File),
+                            std::move(commandLine), string(e.Output));
+   }
+
+   std::unique_ptr<MemoryBuffer> m_buffer;
+   const CacheHeader*            m_header;
+   const CacheEntry*             m_entries;
+   const CacheString*            m_strings;
+   const uint32_t*               m_args;
+   const char*                   m_blob;
+
+   // Built on the first file missing from the entries.
+   mutable FileMatchTrie  m_matchTrie;
+   mutable std::once_flag m_matchTrieBuilt;
+};
+
+
+class CacheBuilder {
+public:
+   bool add(const CompileCommand& command) {
+      CacheEntry e;
+      e.File      = intern(NativeAbsolutePath(command.Directory,
+                                              command.Filename));
+      e.Directory = intern(command.Directory);
+      e.Output    = intern(command.Output);
+      e.FirstArg  = m_args.size();
+      e.ArgCount  = command.CommandLine.size();
+      for (auto& arg : command.CommandLine)
+         m_args.push_back(intern(arg));
+      m_entries.push_back(e);
+
+      // Offsets are stored on 32 bits.
+      return m_blob.size() <= UINT32_MAX && m_args.size() <= UINT32_MAX;
+   }
+
+   std::string serialize(uint64_t size, uint64_t modificationTime,
+                         uint64_t hash) {
+      std::stable_sort(m_entries.begin(), m_entries.end(),
+                       [this](const CacheEntry& lhs, const CacheEntry& rhs) {
+                          return string(lhs.File) < string(rhs.File);
+                       });
+
+      CacheHeader header;
+      std::memcpy(header.Magic, CacheMagic, sizeof(CacheMagic));
+      header.Version                = CacheVersion;
+      header.SourceSize             = size;
+      header.SourceModificationTime = modificationTime;
+      header.SourceHash             = hash;
+      header.EntryCount             = m_entries.size();
+      header.StringCount            = m_strings.size();
+      header.ArgCount               = m_args.size();
+      header.BlobSize               = m_blob.size();
+
+      std::string out;
+      append(out, &header, 1);
+      append(out, m_entries.data(), m_entries.size());
+      append(out, m_strings.data(), m_strings.size());
+      append(out, m_args.data(), m_args.size());
+      out.append(m_blob);
+      return out;
+   }
+
+private:
+   template <typename T>
+   static void append(std::string& out, const T* data, std::size_t count) {
+      out.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+   }
+
+   uint32_t intern(StringRef s) {
+      auto inserted = m_ids.insert(std::make_pair(s, m_strings.size()));
+      if (inserted.second) {
+         m_strings.push_back(CacheString{static_cast<uint32_t>(m_blob.size()),
+                                         static_cast<uint32_t>(s.size())});
+         m_blob.append(s.begin(), s.end());
+      }
+      return inserted.first->second;
+   }
+
+   StringRef string(uint32_t id) const {
+      auto& s = m_strings[id];
+      return StringRef(m_blob.data() + s.Offset, s.Length);
+   }
+
+   StringMap<uint32_t>      m_ids;
+   std::vector<CacheString> m_strings;
+   std::vector<CacheEntry>  m_entries;
+   std::vector<uint32_t>    m_args;
+   std::string              m_blob;
+};
+
+bool WriteAtomically(StringRef Path, StringRef Contents) {
+   int              FD;
+   SmallString<256> TempPath;
+   if (sys::fs::createUniqueFile(Path + ".%%%%%%", FD, TempPath))
+      return false;
+
+   {
+      raw_fd_ostream out(FD, /*shouldClose=*/true);
+      out << Contents;
+      out.close();
+      if (out.has_error()) {
+         out.clear_error();
+         sys::fs::remove(TempPath);
+         return false;
+      }
+   }
+
+   if (sys::fs::rename(TempPath, Path)) {
+      sys::fs::remove(TempPath);
+      return false;
+   }
+   return true;
+}
+
+}  // namespace
+
+
+std::unique_ptr<CompilationDatabase> loadCachedCompilationDatabase(
+   StringRef BuildDirectory, std::string& ErrorMessage) {
+   SmallString<256> JsonPath(BuildDirectory);
+   sys::path::append(JsonPath, "compile_commands.json");
+   SmallString<256> CachePath(BuildDirectory);
+   sys::path::append(CachePath, "compile_commands.tidy-cache");
+
+   sys::fs::file_status Status;
+   if (std::error_code EC = sys::fs::status(JsonPath, Status)) {
+      ErrorMessage = "Cannot access " + JsonPath.str().str() + ": " +
+                     EC.message();
+      return nullptr;
+   }
+   uint64_t size = Status.getSize();
+   uint64_t modificationTime =
+      Status.getLastModificationTime().time_since_epoch().count();
+
+   auto Cache  = MemoryBuffer::getFile(CachePath, -1, false);
+   auto header = Cache ? ValidHeader(**Cache) : nullptr;
+   if (header && header->SourceSize == size &&
+       header->SourceModificationTime == modificationTime)
+      return llvm::make_unique<BinaryCompilationDatabase>(std::move(*Cache));
+
+   auto Json = MemoryBuffer::getFile(JsonPath);
+   if (!Json) {
+      ErrorMessage = "Cannot read " + JsonPath.str().str() + ": " +
+                     Json.getError().message();
+      return nullptr;
+   }
+   uint64_t hash = xxHash64((*Json)->getBuffer());
+
+   if (header && header->SourceSize == size && header->SourceHash == hash) {
+      // Only touched: record the new modification time and keep the cache.
+      std::string contents = (*Cache)->getBuffer().str();
+      auto        updated  = reinterpret_cast<CacheHeader*>(&contents[0]);
+      updated->SourceModificationTime = modificationTime;
+      WriteAtomically(CachePath, contents);
+      return llvm::make_unique<BinaryCompilationDatabase>(std::move(*Cache));
+   }
+
+   auto Database = JSONCompilationDatabase::loadFromBuffer(
+      (*Json)->getBuffer(), ErrorMessage, JSONCommandLineSyntax::AutoDetect);
+   if (!Database)
+      return nullptr;
+
+   CacheBuilder builder;
+   for (auto& command : Database->getAllCompileCommands()) {
+      if (!builder.add(command))
+         return std::move(Database);
+   }
+
+   if (!WriteAtomically(CachePath,
+                        builder.serialize(size, modificationTime, hash)))
+      std::cerr << "Cannot write compilation database cache "
+                << CachePath.str().str() << "\n";
+
+   return std::move(Database);
+}
+
+}  // namespace tidy
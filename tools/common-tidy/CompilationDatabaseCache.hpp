@@ -0,0 +1,51 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef COMPILATION_DATABASE_CACHE_HPP
+#define COMPILATION_DATABASE_CACHE_HPP
+
+#include <memory>
+#include <string>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace tidy {
+
+/// Load the compile_commands.json of \p BuildDirectory through a binary
+/// cache stored next to it.
+///
+/// The cache is memory mapped and looked up in place, so loading it does not
+/// depend on the size of the database. It is rebuilt when the size,
+/// modification time and content hash of the JSON file do not match the ones
+/// recorded in the cache.
+///
+/// Fall back on the JSON database itself when the cache cannot be written.
+std::unique_ptr<clang::tooling::CompilationDatabase>
+loadCachedCompilationDatabase(llvm::StringRef BuildDirectory,
+                              std::string&    ErrorMessage);
+
+}  // namespace tidy
+
+#endif
@@ -0,0 +1,188 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "FileCache.hpp"
+
+#include <iostream>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang;
+using namespace llvm;
+
+namespace tidy {
+
+namespace {
+
+std::string AbsolutePath(const Twine& Path, vfs::FileSystem& FS) {
+   SmallString<256> Absolute;
+   Path.toVector(Absolute);
+   if (!sys::path::is_absolute(Absolute)) {
+      auto CWD = FS.getCurrentWorkingDirectory();
+      if (CWD) {
+         SmallString<256> Full(*CWD);
+         sys::path::append(Full, Absolute);
+         Absolute = Full;
+      }
+   }
+   sys::path::remove_dots(Absolute);
+   return Absolute.str();
+}
+
+class CachedFile : public vfs::File {
+public:
+   CachedFile(const vfs::Status& Status, const MemoryBuffer* Buffer)
+      : m_status(Status)
+      , m_buffer(Buffer) {}
+
+   ErrorOr<vfs::Status> status() override {
+      return m_status;
+   }
+
+   ErrorOr<std::unique_ptr<MemoryBuffer>> getBuffer(
+      const Twine& Name, int64_t FileSize, bool RequiresNullTerminator,
+      bool IsVolatile) override {
+      // The cache keeps ownership, hand out a view on its buffer.
+      return MemoryBuffer::getMemBuffer(m_buffer->getBuffer(), Name.str(),
+                                        RequiresNullTerminator);
+   }
+
+   std::error_code close() override {
+      return std::error_code();
+   }
+
+private:
+   vfs::Status         m_status;
+   const MemoryBuffer* m_buffer;
+};
+
+class CachingFileSystem : public vfs::FileSystem {
+public:
+   CachingFileSystem(std::shared_ptr<SharedFileCache>     Cache,
+                     IntrusiveRefCntPtr<vfs::FileSystem> Base)
+      : m_cache(std::move(Cache))
+      , m_base(std::move(Base)) {}
+
+   ErrorOr<vfs::Status> status(const Twine& Path) override {
+      auto S = m_cache->status(AbsolutePath(Path, *m_base), *m_base);
+      if (!S)
+         return S.getError();
+      return vfs::Status::copyWithNewName(*S, Path.str());
+   }
+
+   ErrorOr<std::unique_ptr<vfs::File>> openFileForRead(
+      const Twine& Path) override {
+      auto absolute = AbsolutePath(Path, *m_base);
+      auto S        = m_cache->status(absolute, *m_base);
+      if (!S)
+         return S.getError();
+      if (!S->isRegularFile())
+         return m_base->openFileForRead(Path);
+
+      auto Buffer = m_cache->contents(absolute, *m_base);
+      if (!Buffer)
+         return Buffer.getError();
+
+      return std::unique_ptr<vfs::File>(new CachedFile(
+         vfs::Status::copyWithNewName(*S, Path.str()), *Buffer));
+   }
+
+   vfs::directory_iterator dir_begin(const Twine&     Dir,
+                                     std::error_code& EC) override {
+      return m_base->dir_begin(Dir, EC);
+   }
+
+   ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+      return m_base->getCurrentWorkingDirectory();
+   }
+
+   std::error_code setCurrentWorkingDirectory(const Twine& Path) override {
+      return m_base->setCurrentWorkingDirectory(Path);
+   }
+
+private:
+   std::shared_ptr<SharedFileCache>    m_cache;
+   IntrusiveRefCntPtr<vfs::FileSystem> m_base;
+};
+
+}  // namespace
+
+
+ErrorOr<vfs::Status> SharedFileCache::status(const std::string& Path,
+                                             vfs::FileSystem&   FS) {
+   ++m_stats;
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto                        found = m_status.find(Path);
+      if (found != m_status.end()) {
+         ++m_statHits;
+         return found->second;
+      }
+   }
+
+   // Missing files are cached as well: header search probes the same
+   // non-existing paths for every translation unit.
+   auto S = FS.status(Path);
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   return m_status.try_emplace(Path, std::move(S)).first->second;
+}
+
+ErrorOr<const MemoryBuffer*> SharedFileCache::contents(const std::string& Path,
+                                                       vfs::FileSystem&   FS) {
+   ++m_reads;
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto                        found = m_contents.find(Path);
+      if (found != m_contents.end()) {
+         ++m_readHits;
+         if (!found->second)
+            return found->second.getError();
+         return found->second->get();
+      }
+   }
+
+   auto Buffer = FS.getBufferForFile(Path);
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   auto& entry = m_contents.try_emplace(Path, std::move(Buffer)).first->second;
+   if (!entry)
+      return entry.getError();
+   return entry->get();
+}
+
+void SharedFileCache::printStats(std::ostream& ostr) const {
+   ostr << "file cache: " << m_reads << " read(s), " << m_readHits
+        << " from cache; " << m_stats << " stat(s), " << m_statHits
+        << " from cache\n";
+}
+
+IntrusiveRefCntPtr<vfs::FileSystem> createCachingFileSystem(
+   std::shared_ptr<SharedFileCache>    Cache,
+   IntrusiveRefCntPtr<vfs::FileSystem> Base) {
+   return new CachingFileSystem(std::move(Cache), std::move(Base));
+}
+
+}  // namespace tidy
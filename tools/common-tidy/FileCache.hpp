@@ -0,0 +1,91 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef FILE_CACHE_HPP
+#define FILE_CACHE_HPP
+
+#include <atomic>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace tidy {
+
+/// Status and contents of the files read during a run.
+///
+/// A single cache is shared by every translation unit processed by a tool,
+/// so that system and project headers are read from disk once per run
+/// instead of once per translation unit. Lookups are thread-safe.
+///
+/// Entries are keyed by absolute path and are never invalidated: files are
+/// not expected to change while a tool is running.
+class SharedFileCache {
+public:
+   SharedFileCache()
+      : m_reads(0)
+      , m_readHits(0)
+      , m_stats(0)
+      , m_statHits(0) {}
+
+   llvm::ErrorOr<clang::vfs::Status> status(const std::string&     Path,
+                                            clang::vfs::FileSystem& FS);
+
+   /// Return the cached contents of \p Path, reading it through \p FS on the
+   /// first access. The buffer is owned by the cache.
+   llvm::ErrorOr<const llvm::MemoryBuffer*> contents(
+      const std::string& Path, clang::vfs::FileSystem& FS);
+
+   void printStats(std::ostream& ostr) const;
+
+private:
+   typedef llvm::ErrorOr<clang::vfs::Status>                  StatusEntry;
+   typedef llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> ContentsEntry;
+
+   mutable std::mutex             m_mutex;
+   llvm::StringMap<StatusEntry>   m_status;
+   llvm::StringMap<ContentsEntry> m_contents;
+
+   std::atomic<unsigned> m_reads;
+   std::atomic<unsigned> m_readHits;
+   std::atomic<unsigned> m_stats;
+   std::atomic<unsigned> m_statHits;
+};
+
+/// Create a file system answering status and read requests from \p Cache,
+/// falling back on \p Base for anything not cached yet.
+llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> createCachingFileSystem(
+   std::shared_ptr<SharedFileCache>                 Cache,
+   llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> Base =
+      clang::vfs::getRealFileSystem());
+
+}  // namespace tidy
+
+#endif
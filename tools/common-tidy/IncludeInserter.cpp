@@ -0,0 +1,126 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "IncludeInserter.hpp"
+
+#include "clang/Lex/Lexer.h"
+
+using namespace clang;
+using namespace llvm;
+
+namespace tidy {
+
+Optional<FixItHint> IncludeInserter::insert(const SourceManager& SM,
+                                            const LangOptions&   LangOpts,
+                                            StringRef            Header) {
+   auto entry = SM.getFileEntryForID(SM.getMainFileID());
+   if (!entry)
+      return None;
+
+   auto found = m_files.find(entry->getName());
+   if (found == m_files.end()) {
+      found = m_files.emplace(entry->getName(), MainFile()).first;
+      scan(SM, LangOpts, found->second);
+   }
+
+   auto& file = found->second;
+   if (file.Slots.empty() || !file.Headers.insert(Header.str()).second)
+      return None;
+
+   auto loc = SM.getLocForStartOfFile(SM.getMainFileID())
+                 .getLocWithOffset(file.Slots.back());
+   file.Slots.pop_back();
+   return FixItHint::CreateInsertion(loc, ("#include " + Header + "\n").str());
+}
+
+void IncludeInserter::scan(const SourceManager& SM, const LangOptions& LangOpts,
+                           MainFile& file) {
+   auto fid    = SM.getMainFileID();
+   auto buffer = SM.getBufferData(fid);
+   auto start  = SM.getLocForStartOfFile(fid);
+   Lexer lexer(start, LangOpts, buffer.begin(), buffer.begin(), buffer.end());
+
+   auto lineStart = [&](SourceLocation Loc) {
+      auto offset = SM.getFileOffset(Loc);
+      auto eol    = buffer.rfind('\n', offset);
+      return eol == StringRef::npos ? 0u : static_cast<unsigned>(eol + 1);
+   };
+
+   // A file which includes nothing gets its header before its first token.
+   Token tok;
+   lexer.LexFromRawLexer(tok);
+   if (tok.isNot(tok::eof))
+      file.Slots.push_back(lineStart(tok.getLocation()));
+
+   // Only the directives out of any #if are considered, e.g. not the ones of
+   // a header guard or of a platform.
+   unsigned depth    = 0;
+   bool     included = false;
+   unsigned after    = 0;
+   while (tok.isNot(tok::eof)) {
+      if (tok.isNot(tok::hash) || !tok.isAtStartOfLine()) {
+         lexer.LexFromRawLexer(tok);
+         continue;
+      }
+
+      auto hash = tok.getLocation();
+      lexer.LexFromRawLexer(tok);
+      if (tok.isAtStartOfLine() || tok.isNot(tok::raw_identifier))
+         continue;
+
+      auto directive = tok.getRawIdentifier();
+      if (directive.startswith("if")) {
+         ++depth;
+      }
+      else if (directive == "endif") {
+         if (depth)
+            --depth;
+      }
+      else if (!depth && (directive == "include" || directive == "import")) {
+         auto offset = SM.getFileOffset(tok.getLocation()) + tok.getLength();
+         auto eol    = buffer.find('\n', offset);
+         auto header = buffer.slice(offset, eol).trim();
+         auto close  = header.startswith("<") ? header.find('>')
+                                              : header.find('"', 1);
+         if (close != StringRef::npos)
+            file.Headers.insert(header.substr(0, close + 1).str());
+
+         if (!included)
+            file.Slots.clear();
+         included = true;
+         file.Slots.push_back(lineStart(hash));
+         after = eol == StringRef::npos ? 0 : eol + 1;
+      }
+
+      // The rest of the directive.
+      do
+         lexer.LexFromRawLexer(tok);
+      while (tok.isNot(tok::eof) && !tok.isAtStartOfLine());
+   }
+
+   if (after)
+      file.Slots.push_back(after);
+}
+
+}  // namespace tidy
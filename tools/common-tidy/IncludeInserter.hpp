@@ -0,0 +1,73 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef INCLUDE_INSERTER_HPP
+#define INCLUDE_INSERTER_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace tidy {
+
+/// Add the #include directives a fix needs to the main file, at most once
+/// per header and file whatever the number of fixes and transforms.
+///
+/// The main file is scanned for its top-level #include directives the first
+/// time it needs one. A header goes after its last #include, the next ones
+/// before the previous #include lines: two insertions at the same place
+/// would conflict.
+class IncludeInserter {
+public:
+   /// Hint adding `#include Header` to the main file of \p SM, \p Header
+   /// being spelled with its angle brackets or quotes. None when the main
+   /// file already includes it, it was given by an earlier hint, or there is
+   /// no place left to insert it.
+   llvm::Optional<clang::FixItHint> insert(const clang::SourceManager& SM,
+                                           const clang::LangOptions& LangOpts,
+                                           llvm::StringRef           Header);
+
+private:
+   struct MainFile {
+      std::set<std::string> Headers;
+      /// Offsets where headers can be inserted, the next one last.
+      std::vector<unsigned> Slots;
+   };
+
+   static void scan(const clang::SourceManager& SM,
+                    const clang::LangOptions& LangOpts, MainFile& file);
+
+   std::map<std::string, MainFile> m_files;
+};
+
+}  // namespace tidy
+
+#endif
@@ -0,0 +1,215 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "IncludeMap.hpp"
+
+#include <algorithm>
+#include <set>
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+using namespace llvm;
+
+namespace tidy {
+
+namespace {
+
+const char* const IncludeMapHeader = "# tidy include map v1";
+
+/// Absolute, dot-free and native form of \p Path used as include map key.
+std::string NormalizedPath(StringRef Path) {
+   SmallString<256> absolute(Path);
+   sys::fs::make_absolute(absolute);
+   sys::path::remove_dots(absolute, /*remove_dot_dot=*/true);
+   SmallString<256> native;
+   sys::path::native(absolute, native);
+   return native.str().str();
+}
+
+/// Same as above, relative paths being resolved by the \p FM of the
+/// translation unit.
+std::string NormalizedPath(const FileManager& FM, StringRef Path) {
+   SmallString<256> absolute(Path);
+   FM.makeAbsolutePath(absolute);
+   sys::path::remove_dots(absolute, /*remove_dot_dot=*/true);
+   SmallString<256> native;
+   sys::path::native(absolute, native);
+   return native.str().str();
+}
+
+}  // namespace
+
+bool IncludeMap::load(StringRef Path, std::string& ErrorMessage) {
+   auto Buffer = MemoryBuffer::getFile(Path);
+   if (!Buffer) {
+      ErrorMessage = "Cannot read " + Path.str() + ": " +
+                     Buffer.getError().message();
+      return false;
+   }
+
+   clear();
+   if (!merge((*Buffer)->getBuffer())) {
+      ErrorMessage = Path.str() + " is not an include map";
+      return false;
+   }
+   return true;
+}
+
+bool IncludeMap::save(StringRef Path, std::string& ErrorMessage) const {
+   std::error_code EC;
+   raw_fd_ostream  out(Path, EC, sys::fs::F_Text);
+   if (EC) {
+      ErrorMessage = "Cannot write " + Path.str() + ": " + EC.message();
+      return false;
+   }
+   write(out);
+   return true;
+}
+
+bool IncludeMap::merge(StringRef Data) {
+   auto lines = Data.split('\n');
+   if (lines.first.rtrim() != IncludeMapHeader)
+      return false;
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   // One translation unit per line, followed by its files indented by a tab.
+   std::vector<std::string>* current = nullptr;
+   StringRef                 rest    = lines.second;
+   while (!rest.empty()) {
+      auto line = rest.split('\n');
+      rest      = line.second;
+
+      auto entry = line.first.rtrim("\r");
+      if (entry.empty())
+         continue;
+      if (entry.front() == '\t') {
+         if (current)
+            current->push_back(entry.drop_front().str());
+      }
+      else {
+         current = &m_includes[entry.str()];
+         current->clear();
+      }
+   }
+   return true;
+}
+
+void IncludeMap::write(raw_ostream& out) const {
+   std::lock_guard<std::mutex> lock(m_mutex);
+   out << IncludeMapHeader << "\n";
+   for (auto& tu : m_includes) {
+      out << tu.first << "\n";
+      for (auto& file : tu.second)
+         out << "\t" << file << "\n";
+   }
+}
+
+void IncludeMap::clear() {
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_includes.clear();
+}
+
+void IncludeMap::record(const SourceManager& SM) {
+   auto& FM   = SM.getFileManager();
+   auto  main = SM.getFileEntryForID(SM.getMainFileID());
+   if (!main)
+      return;
+
+   std::vector<std::string> files;
+   for (auto it = SM.fileinfo_begin(); it != SM.fileinfo_end(); ++it) {
+      if (it->first != main)
+         files.push_back(NormalizedPath(FM, it->first->getName()));
+   }
+   std::sort(files.begin(), files.end());
+   files.erase(std::unique(files.begin(), files.end()), files.end());
+
+   auto tu = NormalizedPath(FM, main->getName());
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_includes[tu].swap(files);
+}
+
+void IncludeMap::record(StringRef                       TranslationUnit,
+                        const std::vector<std::string>& Files) {
+   std::vector<std::string> files;
+   std::copy_if(Files.begin(), Files.end(), std::back_inserter(files),
+                [&](const std::string& file) {
+                   return file != TranslationUnit;
+                });
+   std::sort(files.begin(), files.end());
+   files.erase(std::unique(files.begin(), files.end()), files.end());
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_includes[TranslationUnit.str()].swap(files);
+}
+
+std::vector<std::string> IncludeMap::affected(
+   const std::vector<std::string>& Changed,
+   const std::vector<std::string>& TranslationUnits) const {
+   std::set<std::string> changed;
+   for (auto& c : Changed)
+      changed.insert(NormalizedPath(c));
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   std::vector<std::string> result;
+   std::copy_if(
+      TranslationUnits.begin(), TranslationUnits.end(),
+      std::back_inserter(result), [&](const std::string& tu) {
+         auto key = NormalizedPath(tu);
+         if (changed.count(key))
+            return true;
+
+         auto found = m_includes.find(key);
+         if (found == m_includes.end())
+            return true;
+
+         return std::any_of(
+            found->second.begin(), found->second.end(),
+            [&](const std::string& file) { return changed.count(file) != 0; });
+      });
+   return result;
+}
+
+
+bool IncludeMapRecorder::handleBeginSource(CompilerInstance& CI) {
+   m_sourceManager = &CI.getSourceManager();
+   return true;
+}
+
+void IncludeMapRecorder::handleEndSource() {
+   if (m_sourceManager)
+      m_map.record(*m_sourceManager);
+   m_sourceManager = nullptr;
+}
+
+}  // namespace tidy
@@ -0,0 +1,99 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef INCLUDE_MAP_HPP
+#define INCLUDE_MAP_HPP
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "clang/Basic/SourceManager.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace tidy {
+
+/// Files entered by each translation unit, persisted between runs to find
+/// the translation units affected by a set of changed files.
+///
+/// Paths are stored absolute, without dots and in native form.
+class IncludeMap {
+public:
+   /// Load the map saved at \p Path. Return false if it does not exist or
+   /// cannot be read.
+   bool load(llvm::StringRef Path, std::string& ErrorMessage);
+
+   bool save(llvm::StringRef Path, std::string& ErrorMessage) const;
+
+   /// Add the entries of \p Data, as written by write(), replacing the
+   /// entries of the same translation units. Return false if \p Data is not
+   /// an include map.
+   bool merge(llvm::StringRef Data);
+
+   void write(llvm::raw_ostream& out) const;
+
+   void clear();
+
+   /// Record every file entered by the translation unit of \p SM, replacing
+   /// the previous entry of this translation unit.
+   void record(const clang::SourceManager& SM);
+
+   /// Record \p Files as the files entered by \p TranslationUnit, e.g. the
+   /// inputs of its AST snapshot. Paths are already normalized.
+   void record(llvm::StringRef                 TranslationUnit,
+               const std::vector<std::string>& Files);
+
+   /// Return the translation units of \p TranslationUnits which are changed
+   /// or include a changed file. Translation units missing from the map are
+   /// kept, their includes being unknown.
+   std::vector<std::string> affected(
+      const std::vector<std::string>& Changed,
+      const std::vector<std::string>& TranslationUnits) const;
+
+private:
+   mutable std::mutex                              m_mutex;
+   std::map<std::string, std::vector<std::string>> m_includes;
+};
+
+/// Record the includes of each translation unit of a tool run.
+class IncludeMapRecorder : public clang::tooling::SourceFileCallbacks {
+public:
+   explicit IncludeMapRecorder(IncludeMap& Map)
+      : m_map(Map)
+      , m_sourceManager(nullptr) {}
+
+   bool handleBeginSource(clang::CompilerInstance& CI) override;
+   void handleEndSource() override;
+
+private:
+   IncludeMap&                 m_map;
+   const clang::SourceManager* m_sourceManager;
+};
+
+}  // namespace tidy
+
+#endif
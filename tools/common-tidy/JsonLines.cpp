@@ -0,0 +1,222 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "JsonLines.hpp"
+#include "AstCache.hpp"
+
+#include <cstdio>
+
+#include "clang/Basic/DiagnosticIDs.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/ConvertUTF.h"
+#include "llvm/Support/FileSystem.h"
+
+using namespace clang;
+using namespace llvm;
+
+namespace tidy {
+
+namespace {
+
+// Output is written in large chunks only.
+const std::size_t OutputBufferSize = 1 << 20;
+
+void AppendJsonEscape(std::string& out, unsigned char c) {
+   char escaped[8];
+   std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+   out += escaped;
+}
+
+StringRef LevelName(DiagnosticsEngine::Level Level) {
+   switch (Level) {
+      case DiagnosticsEngine::Ignored:
+         return "ignored";
+      case DiagnosticsEngine::Note:
+         return "note";
+      case DiagnosticsEngine::Remark:
+         return "remark";
+      case DiagnosticsEngine::Warning:
+         return "warning";
+      case DiagnosticsEngine::Error:
+         return "error";
+      case DiagnosticsEngine::Fatal:
+         return "fatal";
+   }
+   return "unknown";
+}
+
+}  // namespace
+
+void AppendJsonString(std::string& out, StringRef s) {
+   out += '"';
+   for (std::size_t i = 0; i < s.size(); ++i) {
+      char c = s[i];
+      switch (c) {
+         case '"':
+            out += "\\\"";
+            break;
+         case '\\':
+            out += "\\\\";
+            break;
+         case '\n':
+            out += "\\n";
+            break;
+         case '\r':
+            out += "\\r";
+            break;
+         case '\t':
+            out += "\\t";
+            break;
+         default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+               AppendJsonEscape(out, c);
+            }
+            else if (static_cast<unsigned char>(c) < 0x80) {
+               out += c;
+            }
+            else {
+               // Valid UTF-8 sequences are kept, a byte of an invalid one is
+               // escaped as the Latin-1 character of the same value, so that
+               // the line stays valid JSON.
+               auto     sequence = reinterpret_cast<const UTF8*>(&s[i]);
+               unsigned length   = getNumBytesForUTF8(*sequence);
+               if (length <= s.size() - i &&
+                   isLegalUTF8Sequence(sequence, sequence + length)) {
+                  out.append(s.data() + i, length);
+                  i += length - 1;
+               }
+               else {
+                  AppendJsonEscape(out, c);
+               }
+            }
+      }
+   }
+   out += '"';
+}
+
+
+void JsonLinesRecords::diagnostic(StringRef Level, StringRef File,
+                                  unsigned Line, unsigned Column,
+                                  StringRef Message) {
+   begin("diagnostic");
+   field("level", Level);
+   field("file", File);
+   field("line", Line);
+   field("column", Column);
+   field("message", Message);
+   m_data += "}\n";
+}
+
+void JsonLinesRecords::fix(StringRef Check, const tooling::Replacement& R) {
+   begin("fix");
+   field("check", Check);
+   field("file", R.getFilePath());
+   field("offset", R.getOffset());
+   field("length", R.getLength());
+   field("replacement", R.getReplacementText());
+   m_data += "}\n";
+}
+
+void JsonLinesRecords::begin(StringRef Kind) {
+   m_data += "{\"kind\":";
+   AppendJsonString(m_data, Kind);
+   field("tu", m_translationUnit);
+}
+
+void JsonLinesRecords::field(StringRef Name, StringRef Value) {
+   m_data += ',';
+   AppendJsonString(m_data, Name);
+   m_data += ':';
+   AppendJsonString(m_data, Value);
+}
+
+void JsonLinesRecords::field(StringRef Name, unsigned Value) {
+   m_data += ',';
+   AppendJsonString(m_data, Name);
+   m_data += ':';
+   m_data += std::to_string(Value);
+}
+
+
+JsonLinesWriter::JsonLinesWriter(StringRef Path, std::error_code& EC)
+   : m_mutex()
+   , m_out(Path, EC, sys::fs::F_None)
+   , m_capture(nullptr) {
+   if (!EC)
+      m_out.SetBufferSize(OutputBufferSize);
+}
+
+void JsonLinesWriter::write(const JsonLinesRecords& Records) {
+   if (!Records.empty())
+      write(Records.data());
+}
+
+void JsonLinesWriter::write(StringRef Data) {
+   std::lock_guard<std::mutex> lock(m_mutex);
+   if (m_capture)
+      m_capture->append(Data.begin(), Data.end());
+   else
+      m_out << Data;
+}
+
+
+bool JsonLinesCollector::handleBeginSource(CompilerInstance& CI) {
+   m_records.setTranslationUnit(GetMainSourceName(CI));
+   return true;
+}
+
+void JsonLinesCollector::handleEndSource() {
+   m_writer.write(m_records);
+   m_records.clear();
+}
+
+void JsonLinesCollector::HandleDiagnostic(DiagnosticsEngine::Level Level,
+                                          const Diagnostic&         Info) {
+   DiagnosticConsumer::HandleDiagnostic(Level, Info);
+
+   // Transforms report custom diagnostics, compiler ones are builtin.
+   if (m_transformDiagnosticsOnly && DiagnosticIDs::isBuiltinDiag(Info.getID()))
+      return;
+
+   SmallString<256> message;
+   Info.FormatDiagnostic(message);
+
+   StringRef file;
+   unsigned  line   = 0;
+   unsigned  column = 0;
+   if (Info.getLocation().isValid() && Info.hasSourceManager()) {
+      auto presumed = Info.getSourceManager().getPresumedLoc(Info.getLocation());
+      if (presumed.isValid()) {
+         file   = presumed.getFilename();
+         line   = presumed.getLine();
+         column = presumed.getColumn();
+      }
+   }
+
+   m_records.diagnostic(LevelName(Level), file, line, column, message);
+}
+
+}  // namespace tidy
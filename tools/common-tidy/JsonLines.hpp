@@ -0,0 +1,142 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef JSON_LINES_HPP
+#define JSON_LINES_HPP
+
+#include <mutex>
+#include <string>
+#include <system_error>
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace tidy {
+
+/// Append \p s to \p out as a quoted JSON string.
+void AppendJsonString(std::string& out, llvm::StringRef s);
+
+/// Records of one translation unit, one JSON object per line.
+///
+/// Records are built without any locking and handed to a JsonLinesWriter at
+/// once when the translation unit completes.
+class JsonLinesRecords {
+public:
+   JsonLinesRecords()
+      : m_translationUnit()
+      , m_data() {}
+
+   void setTranslationUnit(llvm::StringRef TranslationUnit) {
+      m_translationUnit = TranslationUnit;
+   }
+
+   void diagnostic(llvm::StringRef Level, llvm::StringRef File, unsigned Line,
+                   unsigned Column, llvm::StringRef Message);
+
+   void fix(llvm::StringRef                    Check,
+            const clang::tooling::Replacement& Replacement);
+
+   bool empty() const {
+      return m_data.empty();
+   }
+
+   void clear() {
+      m_data.clear();
+   }
+
+   llvm::StringRef data() const {
+      return m_data;
+   }
+
+private:
+   void begin(llvm::StringRef Kind);
+   void field(llvm::StringRef Name, llvm::StringRef Value);
+   void field(llvm::StringRef Name, unsigned Value);
+
+   std::string m_translationUnit;
+   std::string m_data;
+};
+
+/// Buffered JSON-lines output shared by every translation unit of a run.
+///
+/// Records are only copied into a large output buffer under a lock, the
+/// file is written when the buffer is full and on destruction.
+class JsonLinesWriter {
+public:
+   /// Open \p Path for writing, "-" is the standard output.
+   JsonLinesWriter(llvm::StringRef Path, std::error_code& EC);
+
+   void write(const JsonLinesRecords& Records);
+
+   /// Write records already formatted, e.g. captured in a worker process.
+   void write(llvm::StringRef Data);
+
+   /// When \p Buffer is set, records are appended to it instead of the file.
+   void capture(std::string* Buffer) {
+      m_capture = Buffer;
+   }
+
+private:
+   std::mutex           m_mutex;
+   llvm::raw_fd_ostream m_out;
+   std::string*         m_capture;
+};
+
+/// Collect the diagnostics of each translation unit, and the fixes pushed
+/// to records(), then write them when the translation unit completes.
+///
+/// Used both as the diagnostic consumer of a ClangTool and as the source
+/// file callbacks of its frontend action.
+class JsonLinesCollector : public clang::DiagnosticConsumer,
+                           public clang::tooling::SourceFileCallbacks {
+public:
+   /// When \p TransformDiagnosticsOnly is set, compiler diagnostics are
+   /// dropped and only the ones reported by transforms are recorded.
+   JsonLinesCollector(JsonLinesWriter& Writer, bool TransformDiagnosticsOnly)
+      : m_writer(Writer)
+      , m_transformDiagnosticsOnly(TransformDiagnosticsOnly)
+      , m_records() {}
+
+   JsonLinesRecords& records() {
+      return m_records;
+   }
+
+   bool handleBeginSource(clang::CompilerInstance& CI) override;
+   void handleEndSource() override;
+
+   void HandleDiagnostic(clang::DiagnosticsEngine::Level Level,
+                         const clang::Diagnostic&        Info) override;
+
+private:
+   JsonLinesWriter& m_writer;
+   bool             m_transformDiagnosticsOnly;
+   JsonLinesRecords m_records;
+};
+
+}  // namespace tidy
+
+#endif
@@ -0,0 +1,316 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "OptionsParser.hpp"
+#include "AstCache.hpp"
+#include "CompilationDatabaseCache.hpp"
+#include "IncludeMap.hpp"
+#include "PathMatcher.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CommonOptionsParser.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang::tooling;
+using namespace llvm;
+
+namespace tidy {
+
+const char* const OptionsParser::HelpMessage =
+   "\n"
+   "-p <build-path> is used to read a compile command database.\n"
+   "\n"
+   "\tFor example, it can be a CMake build directory in which a file named\n"
+   "\tcompile_commands.json exists (use -DCMAKE_EXPORT_COMPILE_COMMANDS=ON\n"
+   "\tCMake option to get this output). A binary cache of the database is\n"
+   "\tkept next to it in compile_commands.tidy-cache. When no build path\n"
+   "\tis specified, a search for compile_commands.json will be attempted\n"
+   "\tthrough all parent paths of the first input file or of the current\n"
+   "\tdirectory.\n"
+   "\n"
+   "<source0> ... specify the paths of source files. These paths are\n"
+   "\tlooked up in the compile command database. When none is given,\n"
+   "\t-filter and -filter-out select them among the database files.\n"
+   "\n"
+   "-filter=<pattern>,... / -filter-out=<pattern>,... keep only the sources\n"
+   "\tcontaining one of the patterns and drop the ones containing one of\n"
+   "\tthe excluded patterns. @<file> reads one pattern per line.\n"
+   "\n"
+   "-changed-files=<file> reads one changed path per line, e.g. from\n"
+   "\t'git diff --name-only' ('-' reads stdin), and keeps only the sources\n"
+   "\twhich are changed or include a changed file according to the map\n"
+   "\tgiven by -include-map=<file>. Each run records the includes of its\n"
+   "\tsources in that map; sources it does not know yet are kept.\n"
+   "\tRelative changed paths are relative to -changed-files-root=<dir>,\n"
+   "\tby default the top-level directory of the git work tree.\n"
+   "\n"
+   "-ast-cache=<dir> loads the sources from AST snapshots stored in <dir>\n"
+   "\twhen none of their inputs changed, and stores a snapshot of the\n"
+   "\tother ones. The tools share the snapshots, -ast-cache-size=<MB>\n"
+   "\tbounds the directory size.\n"
+   "\n";
+
+namespace {
+
+std::unique_ptr<CompilationDatabase> LoadFromDirectory(
+   StringRef Directory, std::string& ErrorMessage) {
+   SmallString<256> JsonPath(Directory);
+   sys::path::append(JsonPath, "compile_commands.json");
+   if (sys::fs::exists(JsonPath))
+      return loadCachedCompilationDatabase(Directory, ErrorMessage);
+
+   // Let the other compilation database plugins have a look.
+   return CompilationDatabase::loadFromDirectory(Directory, ErrorMessage);
+}
+
+std::unique_ptr<CompilationDatabase> DetectFromPath(
+   StringRef Path, std::string& ErrorMessage) {
+   SmallString<256> AbsolutePath(Path);
+   sys::fs::make_absolute(AbsolutePath);
+
+   for (StringRef Directory = AbsolutePath; !Directory.empty();
+        Directory = sys::path::parent_path(Directory)) {
+      SmallString<256> JsonPath(Directory);
+      sys::path::append(JsonPath, "compile_commands.json");
+      if (sys::fs::exists(JsonPath))
+         return loadCachedCompilationDatabase(Directory, ErrorMessage);
+   }
+
+   return CompilationDatabase::autoDetectFromSource(AbsolutePath,
+                                                    ErrorMessage);
+}
+
+/// Top-level directory of the git work tree holding the current directory,
+/// as 'git rev-parse --show-toplevel' prints it, or the current directory
+/// outside of a work tree.
+std::string FindWorkTreeRoot() {
+   SmallString<256> Current;
+   sys::fs::current_path(Current);
+
+   for (StringRef Directory = Current; !Directory.empty();
+        Directory = sys::path::parent_path(Directory)) {
+      SmallString<256> GitPath(Directory);
+      sys::path::append(GitPath, ".git");
+      if (sys::fs::exists(GitPath))
+         return Directory.str();
+   }
+   return Current.str().str();
+}
+
+/// Read the changed paths listed in \p Path, the relative ones being
+/// relative to \p Root as in 'git diff --name-only'.
+bool ReadChangedFiles(StringRef Path, StringRef Root,
+                      std::vector<std::string>& Changed) {
+   auto Buffer =
+      Path == "-" ? MemoryBuffer::getSTDIN() : MemoryBuffer::getFile(Path);
+   if (!Buffer) {
+      std::cerr << "Cannot read " << Path.str() << ": "
+                << Buffer.getError().message() << "\n";
+      return false;
+   }
+
+   SmallVector<StringRef, 64> Lines;
+   (*Buffer)->getBuffer().split(Lines, '\n', -1, false);
+   for (auto Line : Lines) {
+      Line = Line.trim();
+      if (Line.empty())
+         continue;
+
+      SmallString<256> File(Line);
+      if (sys::path::is_relative(File)) {
+         File = Root;
+         sys::path::append(File, Line);
+      }
+      // A removed file still affects its includers, it is only reported in
+      // case the paths are not relative to the root.
+      if (!sys::fs::exists(File))
+         std::cerr << "Changed file " << File.str().str()
+                   << " does not exist.\n";
+      Changed.push_back(File.str().str());
+   }
+   return true;
+}
+
+}  // namespace
+
+OptionsParser::OptionsParser(int& argc, const char** argv,
+                             cl::OptionCategory& Category,
+                             const char*         Overview) {
+   static cl::opt<std::string> BuildPath("p", cl::desc("Build path"),
+                                         cl::Optional, cl::cat(Category));
+
+   static cl::list<std::string> SourcePaths(
+      cl::Positional, cl::desc("<source0> [... <sourceN>]"), cl::ZeroOrMore,
+      cl::cat(Category));
+
+   static cl::list<std::string> ArgsAfter(
+      "extra-arg",
+      cl::desc("Additional argument to append to the compiler command line"),
+      cl::cat(Category));
+
+   static cl::list<std::string> ArgsBefore(
+      "extra-arg-before",
+      cl::desc("Additional argument to prepend to the compiler command line"),
+      cl::cat(Category));
+
+   static cl::list<std::string> Filter(
+      "filter", cl::desc("Only process sources containing one of <pattern>"),
+      cl::value_desc("pattern"), cl::CommaSeparated, cl::cat(Category));
+
+   static cl::list<std::string> FilterOut(
+      "filter-out", cl::desc("Skip sources containing one of <pattern>"),
+      cl::value_desc("pattern"), cl::CommaSeparated, cl::cat(Category));
+
+   static cl::opt<std::string> ChangedFiles(
+      "changed-files",
+      cl::desc("Only process sources affected by the files listed in <file>"),
+      cl::value_desc("file"), cl::cat(Category));
+
+   static cl::opt<std::string> ChangedFilesRoot(
+      "changed-files-root",
+      cl::desc("Directory the relative paths of -changed-files are relative "
+               "to (default: the top-level directory of the git work tree)"),
+      cl::value_desc("dir"), cl::cat(Category));
+
+   static cl::opt<std::string> IncludeMapPath(
+      "include-map",
+      cl::desc("Include map used by -changed-files and updated by each run"),
+      cl::value_desc("file"), cl::cat(Category));
+
+   static cl::opt<std::string> AstCacheDirectory(
+      "ast-cache",
+      cl::desc("Load and store the ASTs of the sources as snapshots in <dir>"),
+      cl::value_desc("dir"), cl::cat(Category));
+
+   static cl::opt<unsigned> AstCacheSize(
+      "ast-cache-size",
+      cl::desc("Size limit of the AST snapshot cache (default 4096)"),
+      cl::value_desc("MB"), cl::init(4096), cl::cat(Category));
+
+   cl::ResetAllOptionOccurrences();
+   cl::HideUnrelatedOptions(Category);
+
+   std::string                          ErrorMessage;
+   std::unique_ptr<CompilationDatabase> Compilations =
+      FixedCompilationDatabase::loadFromCommandLine(argc, argv, ErrorMessage);
+   if (!Compilations && !ErrorMessage.empty()) {
+      std::cerr << ErrorMessage << "\n";
+      std::exit(1);
+   }
+
+   if (!cl::ParseCommandLineOptions(argc, argv, Overview, &llvm::errs()))
+      std::exit(1);
+   cl::PrintOptionValues();
+
+   if (!Compilations) {
+      if (!BuildPath.empty())
+         Compilations = LoadFromDirectory(BuildPath, ErrorMessage);
+      else
+         Compilations = DetectFromPath(
+            SourcePaths.empty() ? std::string(".") : SourcePaths.front(),
+            ErrorMessage);
+
+      if (!Compilations) {
+         std::cerr << "Error while trying to load a compilation database:\n"
+                   << ErrorMessage << "\n";
+         std::exit(1);
+      }
+   }
+
+   m_includeMapPath = IncludeMapPath;
+
+   if (!AstCacheDirectory.empty())
+      m_astCache = llvm::make_unique<AstCache>(
+         AstCacheDirectory, std::uint64_t(AstCacheSize) * 1024 * 1024);
+
+   if (Filter.empty() && FilterOut.empty() && ChangedFiles.empty()) {
+      m_sourcePathList.assign(SourcePaths.begin(), SourcePaths.end());
+   }
+   else {
+      PathMatcher include(Filter.begin(), Filter.end());
+      PathMatcher exclude(FilterOut.begin(), FilterOut.end());
+
+      std::vector<std::string> candidates =
+         SourcePaths.empty()
+            ? Compilations->getAllFiles()
+            : std::vector<std::string>(SourcePaths.begin(), SourcePaths.end());
+
+      std::copy_if(candidates.begin(), candidates.end(),
+                   std::back_inserter(m_sourcePathList),
+                   [&](const std::string& path) {
+                      return (include.empty() || include.matches(path)) &&
+                             !exclude.matches(path);
+                   });
+   }
+
+   if (!ChangedFiles.empty()) {
+      std::string root = ChangedFilesRoot.empty() ? FindWorkTreeRoot()
+                                                  : ChangedFilesRoot.getValue();
+      std::vector<std::string> changed;
+      if (!ReadChangedFiles(ChangedFiles, root, changed))
+         std::exit(1);
+
+      // Without a map nothing is known about the includes: keep everything.
+      IncludeMap map;
+      ErrorMessage.clear();
+      if (IncludeMapPath.empty() || !map.load(IncludeMapPath, ErrorMessage)) {
+         if (!ErrorMessage.empty())
+            std::cerr << ErrorMessage << "\n";
+         std::cerr << "No include map, all the sources are processed.\n";
+      }
+      else {
+         auto affected = map.affected(changed, m_sourcePathList);
+         std::cerr << affected.size() << " of " << m_sourcePathList.size()
+                   << " source(s) affected by " << changed.size()
+                   << " changed file(s).\n";
+         m_sourcePathList.swap(affected);
+      }
+   }
+
+   // Nothing to do is a valid outcome of a change, not of a selection.
+   if (m_sourcePathList.empty() && ChangedFiles.empty()) {
+      std::cerr << "No source file to process.\n";
+      std::exit(1);
+   }
+
+   auto AdjustingCompilations =
+      llvm::make_unique<ArgumentsAdjustingCompilations>(
+         std::move(Compilations));
+   AdjustingCompilations->appendArgumentsAdjuster(
+      getInsertArgumentAdjuster(ArgsBefore, ArgumentInsertPosition::BEGIN));
+   AdjustingCompilations->appendArgumentsAdjuster(
+      getInsertArgumentAdjuster(ArgsAfter, ArgumentInsertPosition::END));
+   m_compilations = std::move(AdjustingCompilations);
+}
+
+OptionsParser::~OptionsParser() {}
+
+}  // namespace tidy
@@ -0,0 +1,86 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef OPTIONS_PARSER_HPP
+#define OPTIONS_PARSER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/CommandLine.h"
+
+namespace tidy {
+
+class AstCache;
+
+/// Command line parser shared by the tools, used in place of
+/// clang::tooling::CommonOptionsParser.
+///
+/// It accepts the same -p, -extra-arg, -extra-arg-before and '--' options,
+/// loads compile_commands.json through the binary cache of
+/// CompilationDatabaseCache.hpp and adds -filter / -filter-out to select
+/// sources from the database with a PathMatcher, and -changed-files to keep
+/// only the sources affected by a change according to an IncludeMap.
+/// -ast-cache selects the AstCache shared by the tools.
+class OptionsParser {
+public:
+   OptionsParser(int& argc, const char** argv,
+                 llvm::cl::OptionCategory& Category,
+                 const char*               Overview = nullptr);
+
+   ~OptionsParser();
+
+   clang::tooling::CompilationDatabase& getCompilations() {
+      return *m_compilations;
+   }
+
+   const std::vector<std::string>& getSourcePathList() const {
+      return m_sourcePathList;
+   }
+
+   /// Path of the include map given by -include-map, empty if none. Tools
+   /// record the includes of the processed sources in it.
+   const std::string& getIncludeMapPath() const {
+      return m_includeMapPath;
+   }
+
+   /// AST snapshot cache given by -ast-cache, null if none.
+   AstCache* getAstCache() const {
+      return m_astCache.get();
+   }
+
+   static const char* const HelpMessage;
+
+private:
+   std::unique_ptr<clang::tooling::CompilationDatabase> m_compilations;
+   std::vector<std::string>                             m_sourcePathList;
+   std::string                                          m_includeMapPath;
+   std::unique_ptr<AstCache>                            m_astCache;
+};
+
+}  // namespace tidy
+
+#endif
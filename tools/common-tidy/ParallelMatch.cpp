@@ -0,0 +1,223 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "ParallelMatch.hpp"
+#include "Statistics.hpp"
+#include "Transform.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace tidy {
+
+namespace {
+
+static Statistic NumSplit("parallel-match", "split",
+                          "Translation units matched in chunks");
+static Statistic NumChunks("parallel-match", "chunks",
+                           "Chunks matched from threads");
+static Statistic NumRecorded("parallel-match", "recorded",
+                             "Matches recorded by threads and checked later");
+
+// Below that many declarations per chunk, threads cost more than they save.
+const std::size_t MinDeclsPerChunk = 256;
+
+// A declaration matched by a chunk. Namespaces are shallow, their
+// declarations are units of their own.
+struct Unit {
+   Decl* D;
+   bool  Shallow;
+};
+
+void CollectUnits(DeclContext* DC, std::vector<Unit>& units) {
+   for (Decl* D : DC->decls()) {
+      bool shallow = isa<NamespaceDecl>(D) || isa<LinkageSpecDecl>(D);
+      units.push_back({D, shallow});
+      if (shallow)
+         CollectUnits(cast<DeclContext>(D), units);
+   }
+}
+
+/// Traverse declarations as MatchFinder::matchAST does, matching each
+/// declaration and statement on the way.
+class ChunkVisitor : public RecursiveASTVisitor<ChunkVisitor> {
+public:
+   ChunkVisitor(MatchFinder& Finder, ASTContext& Context)
+      : m_finder(Finder)
+      , m_context(Context) {}
+
+   bool shouldVisitTemplateInstantiations() const {
+      return true;
+   }
+
+   bool shouldVisitImplicitCode() const {
+      return true;
+   }
+
+   bool VisitDecl(Decl* D) {
+      m_finder.match(*D, m_context);
+      return true;
+   }
+
+   bool VisitStmt(Stmt* S) {
+      m_finder.match(*S, m_context);
+      return true;
+   }
+
+private:
+   MatchFinder& m_finder;
+   ASTContext&  m_context;
+};
+
+// A match recorded by a chunk, checked once every chunk is matched.
+struct RecordedMatch {
+   MatchFinder::MatchCallback* Callback;
+   BoundNodes                  Nodes;
+};
+
+/// Record the matches of a transform in its chunk, in order.
+class RecordingCallback : public MatchFinder::MatchCallback {
+public:
+   RecordingCallback(Transform* T, std::vector<RecordedMatch>& Matches)
+      : m_transform(T)
+      , m_matches(Matches) {}
+
+   void run(const MatchFinder::MatchResult& Result) override {
+      m_matches.push_back({m_transform, Result.Nodes});
+   }
+
+private:
+   Transform*                  m_transform;
+   std::vector<RecordedMatch>& m_matches;
+};
+
+struct Chunk {
+   std::vector<Unit>::const_iterator               First;
+   std::vector<Unit>::const_iterator               Last;
+   MatchFinder                                     Finder;
+   std::vector<std::unique_ptr<RecordingCallback>> Callbacks;
+   std::vector<RecordedMatch>                      Matches;
+
+   void match(ASTContext& AST) {
+      ChunkVisitor visitor(Finder, AST);
+      for (auto unit = First; unit != Last; ++unit) {
+         if (unit->Shallow)
+            Finder.match(*unit->D, AST);
+         else
+            visitor.TraverseDecl(unit->D);
+      }
+   }
+
+   void check(ASTContext& AST) {
+      for (auto& match : Matches)
+         match.Callback->run(MatchFinder::MatchResult(match.Nodes, &AST));
+   }
+};
+
+class ParallelMatchConsumer : public ASTConsumer {
+public:
+   explicit ParallelMatchConsumer(ParallelMatcher* Matcher)
+      : m_matcher(Matcher) {}
+
+   void HandleTranslationUnit(ASTContext& Context) override {
+      m_matcher->matchAST(Context);
+   }
+
+private:
+   ParallelMatcher* m_matcher;
+};
+
+}  // namespace
+
+std::unique_ptr<ASTConsumer> ParallelMatcher::newASTConsumer() {
+   return llvm::make_unique<ParallelMatchConsumer>(this);
+}
+
+void ParallelMatcher::matchAST(ASTContext& Context) {
+   // The declarations of a snapshot are deserialized on first use, which is
+   // not thread-safe.
+   if (Context.getExternalSource()) {
+      m_finder->matchAST(Context);
+      return;
+   }
+
+   std::vector<Unit> units;
+   units.push_back({Context.getTranslationUnitDecl(), true});
+   CollectUnits(Context.getTranslationUnitDecl(), units);
+
+   std::size_t count =
+      std::min<std::size_t>(m_threads, units.size() / MinDeclsPerChunk);
+   if (count < 2) {
+      m_finder->matchAST(Context);
+      return;
+   }
+
+   ++NumSplit;
+
+   // The transforms which are not thread-safe read the source manager or
+   // fill caches of the AST context, they are matched before the threads
+   // start.
+   m_sequential->matchAST(Context);
+
+   // The parent map is built by the first hasParent() or hasAncestor()
+   // matcher, build it before the threads share it.
+   Context.getParents(*Context.getTranslationUnitDecl());
+
+   std::vector<std::unique_ptr<Chunk>> chunks;
+   for (std::size_t i = 0; i < count; ++i) {
+      auto chunk   = llvm::make_unique<Chunk>();
+      chunk->First = units.begin() + units.size() * i / count;
+      chunk->Last  = units.begin() + units.size() * (i + 1) / count;
+      for (auto t : m_transforms) {
+         chunk->Callbacks.push_back(
+            llvm::make_unique<RecordingCallback>(t, chunk->Matches));
+         t->redirectMatchers(&chunk->Finder, chunk->Callbacks.back().get());
+      }
+      chunks.push_back(std::move(chunk));
+   }
+
+   // The first chunk is matched by the calling thread.
+   std::vector<std::thread> threads;
+   for (std::size_t i = 1; i < count; ++i) {
+      Chunk* chunk = chunks[i].get();
+      threads.emplace_back([chunk, &Context] { chunk->match(Context); });
+   }
+   chunks.front()->match(Context);
+   for (auto& thread : threads)
+      thread.join();
+   NumChunks += count;
+
+   for (auto& chunk : chunks) {
+      NumRecorded += chunk->Matches.size();
+      chunk->check(Context);
+   }
+}
+
+}  // namespace tidy
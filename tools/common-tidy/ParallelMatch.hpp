@@ -0,0 +1,78 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef PARALLEL_MATCH_HPP
+#define PARALLEL_MATCH_HPP
+
+#include <memory>
+#include <vector>
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+
+namespace tidy {
+
+class Transform;
+
+/// Match the top-level declarations of big translation units from several
+/// threads.
+///
+/// The declarations are split in contiguous chunks, namespaces being opened
+/// so that a big one is shared between chunks. Each chunk is matched by its
+/// own MatchFinder, in which the matchers of the thread-safe \p Transforms
+/// are registered with a callback recording their matches (see
+/// Transform::isThreadSafe). Once every chunk is matched, the recorded
+/// matches are checked by the transforms from the calling thread, in the
+/// declaration order: the source manager is only used by the calling thread
+/// and the results do not depend on the scheduling.
+///
+/// Only the declarations and statements are matched in chunks, matchers on
+/// types, type locations or name specifiers are not run. The other
+/// transforms are matched beforehand by \p Sequential. Small translation
+/// units, and the ones read from a snapshot whose declarations are loaded
+/// lazily, are matched by the sequential \p Finder.
+class ParallelMatcher {
+public:
+   ParallelMatcher(clang::ast_matchers::MatchFinder* Finder,
+                   clang::ast_matchers::MatchFinder* Sequential,
+                   std::vector<Transform*> Transforms, unsigned Threads)
+      : m_finder(Finder)
+      , m_sequential(Sequential)
+      , m_transforms(std::move(Transforms))
+      , m_threads(Threads) {}
+
+   std::unique_ptr<clang::ASTConsumer> newASTConsumer();
+
+   void matchAST(clang::ASTContext& Context);
+
+private:
+   clang::ast_matchers::MatchFinder* m_finder;
+   clang::ast_matchers::MatchFinder* m_sequential;
+   std::vector<Transform*>           m_transforms;
+   unsigned                          m_threads;
+};
+
+}  // namespace tidy
+
+#endif
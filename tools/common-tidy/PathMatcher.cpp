@@ -0,0 +1,143 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "PathMatcher.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace llvm;
+
+namespace tidy {
+
+static const unsigned NoChild = ~0u;
+
+static char Normalize(char c) {
+   return c == '\\' ? '/' : c;
+}
+
+void PathMatcher::add(StringRef Pattern) {
+   if (Pattern.empty())
+      return;
+
+   unsigned node = 0;
+   for (char raw : Pattern) {
+      char  c    = Normalize(raw);
+      auto& next = m_nodes[node].Next;
+      auto  found =
+         std::lower_bound(next.begin(), next.end(), std::make_pair(c, 0u));
+      if (found != next.end() && found->first == c) {
+         node = found->second;
+         continue;
+      }
+      unsigned created = m_nodes.size();
+      next.insert(found, std::make_pair(c, created));
+      m_nodes.emplace_back();
+      node = created;
+   }
+   m_nodes[node].Terminal = true;
+   ++m_patterns;
+}
+
+void PathMatcher::addPatternOrFile(StringRef Pattern) {
+   if (!Pattern.startswith("@")) {
+      add(Pattern);
+      return;
+   }
+
+   auto Buffer = MemoryBuffer::getFile(Pattern.drop_front());
+   if (!Buffer) {
+      std::cerr << "Cannot read patterns from " << Pattern.drop_front().str()
+                << ": " << Buffer.getError().message() << "\n";
+      return;
+   }
+
+   SmallVector<StringRef, 64> Lines;
+   (*Buffer)->getBuffer().split(Lines, '\n', -1, false);
+   for (auto Line : Lines)
+      add(Line.trim());
+}
+
+unsigned PathMatcher::child(unsigned node, char c) const {
+   auto& next = m_nodes[node].Next;
+   auto  found =
+      std::lower_bound(next.begin(), next.end(), std::make_pair(c, 0u));
+   if (found != next.end() && found->first == c)
+      return found->second;
+   return NoChild;
+}
+
+void PathMatcher::build() {
+   // Breadth first walk of the trie: the failure link of a node points to the
+   // longest proper suffix of its prefix which is also a prefix in the trie.
+   std::deque<unsigned> queue;
+   for (auto& edge : m_nodes[0].Next) {
+      m_nodes[edge.second].Fail = 0;
+      queue.push_back(edge.second);
+   }
+
+   while (!queue.empty()) {
+      unsigned node = queue.front();
+      queue.pop_front();
+
+      for (auto& edge : m_nodes[node].Next) {
+         unsigned fail = m_nodes[node].Fail;
+         unsigned next = child(fail, edge.first);
+         while (next == NoChild && fail != 0) {
+            fail = m_nodes[fail].Fail;
+            next = child(fail, edge.first);
+         }
+         unsigned target = edge.second;
+         m_nodes[target].Fail =
+            (next != NoChild && next != target) ? next : 0;
+         m_nodes[target].Terminal |= m_nodes[m_nodes[target].Fail].Terminal;
+         queue.push_back(target);
+      }
+   }
+}
+
+bool PathMatcher::matches(StringRef Path) const {
+   if (empty())
+      return false;
+
+   unsigned node = 0;
+   for (char raw : Path) {
+      char     c    = Normalize(raw);
+      unsigned next = child(node, c);
+      while (next == NoChild && node != 0) {
+         node = m_nodes[node].Fail;
+         next = child(node, c);
+      }
+      node = next == NoChild ? 0 : next;
+      if (m_nodes[node].Terminal)
+         return true;
+   }
+   return false;
+}
+
+}  // namespace tidy
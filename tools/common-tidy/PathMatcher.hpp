@@ -0,0 +1,80 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef PATH_MATCHER_HPP
+#define PATH_MATCHER_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace tidy {
+
+/// Match paths against a set of substring patterns in a single pass.
+///
+/// Patterns are compiled into an Aho-Corasick automaton, so the cost of a
+/// lookup depends on the length of the path only, not on the number of
+/// patterns. Path separators are normalized to '/' on both sides.
+class PathMatcher {
+public:
+   /// Match the patterns of [\p first, \p last). A pattern starting with '@'
+   /// names a file holding one pattern per line. The automaton is complete
+   /// once constructed, lookups only read it and may run concurrently.
+   template <typename It>
+   PathMatcher(It first, It last)
+      : m_nodes(1)
+      , m_patterns(0) {
+      for (; first != last; ++first)
+         addPatternOrFile(*first);
+      build();
+   }
+
+   bool empty() const {
+      return m_patterns == 0;
+   }
+
+   /// Return true if any pattern is a substring of \p Path.
+   bool matches(llvm::StringRef Path) const;
+
+private:
+   struct Node {
+      std::vector<std::pair<char, unsigned>> Next;
+      unsigned                               Fail     = 0;
+      bool                                   Terminal = false;
+   };
+
+   void add(llvm::StringRef Pattern);
+   void addPatternOrFile(llvm::StringRef Pattern);
+   void build();
+   unsigned child(unsigned node, char c) const;
+
+   std::vector<Node> m_nodes;
+   unsigned          m_patterns;
+};
+
+}  // namespace tidy
+
+#endif
@@ -0,0 +1,272 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Pipeline.hpp"
+#include "Statistics.hpp"
+#include "Transform.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringExtras.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+using namespace clang::tooling;
+
+using namespace llvm;
+
+namespace tidy {
+
+namespace {
+
+static Statistic NumParses("pipeline", "parses", "Parses run by pipelines");
+static Statistic NumReparses(
+   "pipeline", "reparses",
+   "Parses needed by a stage overlapping the fixes of an earlier one");
+static Statistic NumRejected(
+   "pipeline", "rejected",
+   "Replacements rejected because of a conflict within their stage");
+
+using FileReplacements = std::map<std::string, Replacements>;
+
+struct Stage {
+   TransformContext         Context;
+   Pipeline::TransformsList Transforms;
+   MatchFinder              Finder;
+};
+
+/// Add the fixes of \p stage to \p pass, unless one of them overlaps the
+/// fixes of an earlier stage. The fixes are counted in the statistics of
+/// their transform once merged: a dropped stage is parsed again.
+bool AddStage(const Stage& stage, FileReplacements& pass) {
+   FileReplacements        fixes;
+   std::vector<Statistic*> counters;
+   for (auto& deferred : stage.Context.deferredDiagnostics()) {
+      for (auto& replacement : deferred.Replacements) {
+         auto error = fixes[replacement.getFilePath().str()].add(replacement);
+         if (error) {
+            consumeError(std::move(error));
+            ++NumRejected;
+            std::cerr << "Cannot apply " << replacement.toString() << '\n';
+            continue;
+         }
+         if (deferred.FixIts)
+            counters.push_back(deferred.FixIts);
+      }
+   }
+
+   FileReplacements merged = pass;
+   for (auto& file : fixes) {
+      for (auto& replacement : file.second) {
+         auto error = merged[file.first].add(replacement);
+         if (error) {
+            consumeError(std::move(error));
+            return false;
+         }
+      }
+   }
+   pass = std::move(merged);
+   for (auto counter : counters)
+      ++*counter;
+   return true;
+}
+
+/// Offset in the original code of the offset \p Rewritten of the code
+/// rewritten by \p Earlier. An offset within the text of a replacement is
+/// the offset of that replacement.
+unsigned OriginalOffset(const Replacements& Earlier, unsigned Rewritten) {
+   long position = Rewritten;
+   long shift    = 0;
+   for (auto& replacement : Earlier) {
+      long start = replacement.getOffset() + shift;
+      long size  = replacement.getReplacementText().size();
+      if (position < start)
+         break;
+      if (position < start + size)
+         return replacement.getOffset();
+      shift += size - static_cast<long>(replacement.getLength());
+   }
+   return static_cast<unsigned>(position - shift);
+}
+
+/// Stage which made a fix, at its offset in the original code.
+struct FixOrigin {
+   std::string File;
+   unsigned    Offset;
+   std::string Stage;
+};
+
+/// Names of the stages whose fixes were merged into \p Fix, separated by
+/// commas.
+std::string StageNames(const Replacement&            Fix,
+                       const std::vector<FixOrigin>& Origins) {
+   std::vector<StringRef> names;
+   for (auto& origin : Origins) {
+      if (origin.File == Fix.getFilePath() &&
+          origin.Offset >= Fix.getOffset() &&
+          origin.Offset <= Fix.getOffset() + Fix.getLength() &&
+          std::find(names.begin(), names.end(), origin.Stage) == names.end())
+         names.push_back(origin.Stage);
+   }
+   if (names.empty())
+      return "pipeline";
+   return join(names.begin(), names.end(), ",");
+}
+
+class PassConsumer : public ASTConsumer {
+public:
+   explicit PassConsumer(std::function<void(ASTContext&)> Pass)
+      : m_pass(std::move(Pass)) {}
+
+   void HandleTranslationUnit(ASTContext& Context) override {
+      m_pass(Context);
+   }
+
+private:
+   std::function<void(ASTContext&)> m_pass;
+};
+
+}  // namespace
+
+void Pipeline::run(const CompilationDatabase&                   Compilations,
+                   const std::string&                           Source,
+                   IntrusiveRefCntPtr<vfs::FileSystem>          FileSystem,
+                   DiagnosticConsumer*                          Consumer,
+                   const TransformActionFactory::CallbacksList& Callbacks,
+                   TransformContext&                            Target) {
+   // Fixes to the files on disk, the stages which made them, and the files
+   // they rewrite.
+   FileReplacements                   total;
+   std::vector<FixOrigin>             origins;
+   std::map<std::string, std::string> rewritten;
+
+   // The fixes of the parses done so far are kept when a rewrite fails.
+   auto pushTotal = [&] {
+      for (auto& file : total) {
+         for (auto& replacement : file.second)
+            Target.push_back(replacement, StageNames(replacement, origins));
+      }
+   };
+
+   std::size_t first = 0;
+   while (first < m_stages.size()) {
+      std::vector<std::unique_ptr<Stage>>    stages;
+      TransformActionFactory::TransformsList transforms;
+      for (std::size_t i = first; i < m_stages.size(); ++i) {
+         auto stage = llvm::make_unique<Stage>();
+         stage->Context.setDeferred(true);
+         stage->Context.setCensus(Target.census());
+         stage->Transforms = m_factory(m_stages[i], &stage->Context);
+         for (auto& t : stage->Transforms) {
+            t->registerMatchers(&stage->Finder);
+            transforms.push_back(t.get());
+         }
+         stages.push_back(std::move(stage));
+      }
+
+      // Fixes of this parse, to the rewritten files.
+      FileReplacements       pass;
+      std::vector<FixOrigin> passOrigins;
+      std::size_t            next = m_stages.size();
+
+      auto matchStages = [&](ASTContext& Context) {
+         for (std::size_t i = 0; i < stages.size(); ++i) {
+            stages[i]->Finder.matchAST(Context);
+            stages[i]->Context.resolveDeferred(Context.getSourceManager());
+            if (!AddStage(*stages[i], pass)) {
+               next = first + i;
+               return;
+            }
+            for (auto& fix : stages[i]->Context.deferredReplacements()) {
+               passOrigins.push_back({fix.getFilePath().str(), fix.getOffset(),
+                                      m_stages[first + i]});
+            }
+            stages[i]->Context.flushDeferred(nullptr, Context.getDiagnostics());
+         }
+      };
+
+      ClangTool Tool(Compilations, {Source},
+                     std::make_shared<PCHContainerOperations>(), FileSystem);
+      for (auto& file : rewritten)
+         Tool.mapVirtualFile(file.first, file.second);
+      if (Consumer)
+         Tool.setDiagnosticConsumer(Consumer);
+
+      TransformActionFactory Factory(nullptr, false, transforms, Callbacks);
+      Factory.setConsumerFactory([&](CompilerInstance&) {
+         return llvm::make_unique<PassConsumer>(matchStages);
+      });
+      ++NumParses;
+      Tool.run(&Factory);
+
+      for (auto& origin : passOrigins) {
+         origin.Offset = OriginalOffset(total[origin.File], origin.Offset);
+         origins.push_back(std::move(origin));
+      }
+      for (auto& file : pass)
+         total[file.first] = total[file.first].merge(file.second);
+
+      if (next < m_stages.size()) {
+         ++NumReparses;
+         for (auto& file : pass) {
+            auto found = rewritten.find(file.first);
+            if (found == rewritten.end()) {
+               auto buffer = FileSystem->getBufferForFile(file.first);
+               if (!buffer) {
+                  std::cerr << "Cannot read " << file.first << ": "
+                            << buffer.getError().message() << "\n";
+                  pushTotal();
+                  return;
+               }
+               found = rewritten
+                          .insert(std::make_pair(
+                             file.first, (*buffer)->getBuffer().str()))
+                          .first;
+            }
+
+            auto code = applyAllReplacements(found->second, file.second);
+            if (!code) {
+               std::cerr << "Cannot rewrite " << file.first << ": "
+                         << toString(code.takeError()) << "\n";
+               pushTotal();
+               return;
+            }
+            found->second = std::move(*code);
+         }
+      }
+      first = next;
+   }
+
+   pushTotal();
+}
+
+}  // namespace tidy
@@ -0,0 +1,85 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TransformAction.hpp"
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+
+namespace tidy {
+
+class Transform;
+class TransformContext;
+
+/// Run transforms as a sequence of stages over each source, with the fixes
+/// of each stage applied before the next one.
+///
+/// Stages share a parse as long as their fixes do not overlap the fixes of
+/// the earlier stages of that parse: they are then independent, and merged
+/// as is. A stage with an overlapping fix needs the rewritten code, its
+/// results are dropped and the source is parsed again, with the rewritten
+/// files mapped in memory, from that stage on. The fixes of each parse are
+/// rebased onto the earlier ones with Replacements::merge, so that the final
+/// fixes apply to the files on disk.
+class Pipeline {
+public:
+   using TransformsList = std::vector<std::unique_ptr<Transform>>;
+
+   /// Create the transforms of the stage \p Name, bound to \p Context.
+   using StageFactory = std::function<TransformsList(
+      llvm::StringRef Name, TransformContext* Context)>;
+
+   Pipeline(const std::vector<std::string>& Stages, StageFactory Factory)
+      : m_stages(Stages)
+      , m_factory(std::move(Factory)) {}
+
+   /// Run the stages over \p Source, then push the merged fixes into
+   /// \p Target, named after the stages which made them. When a rewrite
+   /// fails, the fixes of the earlier parses are still pushed. \p Consumer
+   /// and \p Callbacks, when set, see each parse.
+   void run(const clang::tooling::CompilationDatabase&       Compilations,
+            const std::string&                               Source,
+            llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> FileSystem,
+            clang::DiagnosticConsumer*                       Consumer,
+            const TransformActionFactory::CallbacksList&     Callbacks,
+            TransformContext&                                Target);
+
+private:
+   std::vector<std::string> m_stages;
+   StageFactory             m_factory;
+};
+
+}  // namespace tidy
+
+#endif
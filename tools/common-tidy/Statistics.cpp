@@ -0,0 +1,207 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "Statistics.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace tidy {
+
+namespace detail {
+std::atomic<bool> StatisticsEnabled(false);
+}  // namespace detail
+
+namespace {
+
+struct StatisticInfo {
+   std::string Group;
+   std::string Name;
+   std::string Description;
+};
+
+class StatisticsRegistry {
+public:
+   static StatisticsRegistry& instance() {
+      static StatisticsRegistry registry;
+      return registry;
+   }
+
+   unsigned add(StringRef Group, StringRef Name, StringRef Description) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto key      = (Group + "." + Name).str();
+      auto inserted = m_indexes.insert(std::make_pair(key, m_infos.size()));
+      if (inserted.second) {
+         m_infos.push_back({Group.str(), Name.str(), Description.str()});
+         m_totals.push_back(0);
+      }
+      return inserted.first->second;
+   }
+
+   void merge(std::vector<std::uint64_t>& counts) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (std::size_t i = 0; i < counts.size(); ++i)
+         m_totals[i] += counts[i];
+      counts.assign(counts.size(), 0);
+   }
+
+   /// Call \p f with each counter, sorted by group and name.
+   template <typename F>
+   void forEach(F f) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (auto& index : m_indexes)
+         f(m_infos[index.second], m_totals[index.second]);
+   }
+
+private:
+   std::mutex                      m_mutex;
+   std::map<std::string, unsigned> m_indexes;
+   std::vector<StatisticInfo>      m_infos;
+   std::vector<std::uint64_t>      m_totals;
+};
+
+/// Counters of the current thread, merged into the registry on exit.
+struct ThreadCounters {
+   ~ThreadCounters() {
+      StatisticsRegistry::instance().merge(Counts);
+   }
+
+   std::vector<std::uint64_t> Counts;
+};
+
+ThreadCounters& CurrentThreadCounters() {
+   static thread_local ThreadCounters counters;
+   return counters;
+}
+
+void MergeCurrentThread() {
+   StatisticsRegistry::instance().merge(CurrentThreadCounters().Counts);
+}
+
+void WriteJsonString(raw_ostream& out, StringRef s) {
+   out << '"';
+   for (char c : s) {
+      if (c == '"' || c == '\\')
+         out << '\\';
+      out << c;
+   }
+   out << '"';
+}
+
+}  // namespace
+
+namespace detail {
+void AddToStatistic(unsigned Index, std::uint64_t Value) {
+   auto& counts = CurrentThreadCounters().Counts;
+   if (Index >= counts.size())
+      counts.resize(Index + 1, 0);
+   counts[Index] += Value;
+}
+}  // namespace detail
+
+
+Statistic::Statistic(StringRef Group, StringRef Name, StringRef Description)
+   : m_index(StatisticsRegistry::instance().add(Group, Name, Description)) {}
+
+void EnableStatistics() {
+   detail::StatisticsEnabled = true;
+}
+
+void PrintStatistics(std::ostream& ostr) {
+   MergeCurrentThread();
+
+   std::string group;
+   StatisticsRegistry::instance().forEach(
+      [&](const StatisticInfo& info, std::uint64_t value) {
+         if (value == 0)
+            return;
+         if (info.Group != group) {
+            group = info.Group;
+            ostr << group << ":\n";
+         }
+         ostr << std::setw(12) << value << "  " << info.Name << " - "
+              << info.Description << "\n";
+      });
+}
+
+bool WriteStatisticsJson(StringRef Path) {
+   MergeCurrentThread();
+
+   std::error_code EC;
+   raw_fd_ostream  out(Path, EC, sys::fs::F_Text);
+   if (EC) {
+      std::cerr << "Error opening file: " << EC.message() << "\n";
+      return false;
+   }
+
+   bool first = true;
+   out << "{\n";
+   StatisticsRegistry::instance().forEach(
+      [&](const StatisticInfo& info, std::uint64_t value) {
+         out << (first ? "" : ",\n") << "   ";
+         WriteJsonString(out, info.Group + "." + info.Name);
+         out << ": " << value;
+         first = false;
+      });
+   out << "\n}\n";
+   return true;
+}
+
+std::string TakeThreadStatistics() {
+   // One "index value" pair per line, counters being registered in the same
+   // order by every process of the same binary.
+   std::string data;
+   auto&       counts = CurrentThreadCounters().Counts;
+   for (std::size_t i = 0; i < counts.size(); ++i) {
+      if (counts[i] != 0)
+         data += std::to_string(i) + " " + std::to_string(counts[i]) + "\n";
+   }
+   counts.assign(counts.size(), 0);
+   return data;
+}
+
+void MergeThreadStatistics(StringRef Data) {
+   SmallVector<StringRef, 64> lines;
+   Data.split(lines, '\n', -1, false);
+   for (auto line : lines) {
+      auto          fields = line.split(' ');
+      unsigned      index  = 0;
+      std::uint64_t value  = 0;
+      if (fields.first.getAsInteger(10, index) ||
+          fields.second.getAsInteger(10, value))
+         continue;
+      detail::AddToStatistic(index, value);
+   }
+}
+
+}  // namespace tidy
@@ -0,0 +1,101 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef STATISTICS_HPP
+#define STATISTICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace tidy {
+
+namespace detail {
+extern std::atomic<bool> StatisticsEnabled;
+
+void AddToStatistic(unsigned Index, std::uint64_t Value);
+}  // namespace detail
+
+/// Named run-wide counter.
+///
+/// Counters are registered once, usually at namespace scope, and counted in
+/// per-thread storage merged into the run totals when a thread exits or the
+/// statistics are printed. While statistics are disabled, counting is a
+/// single relaxed load.
+///
+///    static tidy::Statistic NumFoo("my-tool", "foo", "Number of foo");
+///    ++NumFoo;
+class Statistic {
+public:
+   Statistic(llvm::StringRef Group, llvm::StringRef Name,
+             llvm::StringRef Description);
+
+   Statistic& operator++() {
+      add(1);
+      return *this;
+   }
+
+   Statistic& operator+=(std::uint64_t Value) {
+      add(Value);
+      return *this;
+   }
+
+   void add(std::uint64_t Value) {
+      if (detail::StatisticsEnabled.load(std::memory_order_relaxed))
+         detail::AddToStatistic(m_index, Value);
+   }
+
+private:
+   unsigned m_index;
+};
+
+void EnableStatistics();
+
+inline bool AreStatisticsEnabled() {
+   return detail::StatisticsEnabled.load(std::memory_order_relaxed);
+}
+
+/// Print the non-zero counters, grouped.
+///
+/// Totals only include the counts of the calling thread and of the threads
+/// which have exited, so call it once the workers are joined.
+void PrintStatistics(std::ostream& ostr);
+
+/// Write every counter as a JSON object to \p Path ('-' for stdout).
+bool WriteStatisticsJson(llvm::StringRef Path);
+
+/// Return the counts of the calling thread as text and reset them.
+///
+/// Worker processes send them to their supervisor, which adds them to its
+/// own counts with MergeThreadStatistics(). Both must run the same binary.
+std::string TakeThreadStatistics();
+
+void MergeThreadStatistics(llvm::StringRef Data);
+
+}  // namespace tidy
+
+#endif
@@ -23,9 +23,25 @@
 //
 
 #include "Transform.hpp"
+#include "AstCache.hpp"
+#include "Census.hpp"
+#include "FileCache.hpp"
+#include "IncludeMap.hpp"
+#include "JsonLines.hpp"
+#include "ParallelMatch.hpp"
+#include "Pipeline.hpp"
+#include "TransformAction.hpp"
+#include "WorkerPool.hpp"
 #include "misc.hpp"
 
+#ifdef TIDY_WITH_CLANG_TIDY
+#include "ClangTidyTransform.hpp"
+#endif
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <set>
 #include <sstream>
 
 #include "clang/AST/AST.h"
@@ -36,6 +52,7 @@
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Tooling/ReplacementsYaml.h"
 
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/raw_os_ostream.h"
@@ -53,16 +70,111 @@ LLVM_INSTANTIATE_REGISTRY(tidy::TransformFactoryRegistry);
 
 namespace tidy {
 
-void TransformContext::push_back(
-   const clang::tooling::Replacement& replacement) {
+static Statistic NumRejected("transform-context", "rejected",
+                             "Replacements rejected because of a conflict");
+
+// Worker messages holding the replacements of a source, and telling it
+// failed.
+static const char MessageReplacements = 'r';
+static const char MessageFailed       = 'f';
+
+bool TransformContext::push_back(
+   const clang::tooling::Replacement& replacement, StringRef check) {
+   if (m_deferred) {
+      // A fix without diagnostic, it is only pushed at flush time.
+      defer(SourceLocation(), DiagnosticIDs::Ignored, "", check)
+         .Replacements.push_back(replacement);
+      return true;
+   }
+
 #if CLANG_38
    m_replacements.insert(replacement);
 #else
    auto error_code = m_replacements.add(replacement);
    if (error_code) {
+      consumeError(std::move(error_code));
+      ++NumRejected;
       std::cerr << "Cannot apply " << replacement.toString() << '\n';
+      return false;
    }
 #endif
+
+   // Only the fixes which will be applied are recorded.
+   if (m_records)
+      m_records->fix(check, replacement);
+   return true;
+}
+
+DeferredDiagnostic& TransformContext::defer(SourceLocation       Loc,
+                                            DiagnosticIDs::Level Level,
+                                            StringRef            Message,
+                                            StringRef            check) {
+   m_deferredDiagnostics.push_back(DeferredDiagnostic{
+      Loc, Level, Message.str(), check.str(), {}, {}, nullptr, 0});
+   return m_deferredDiagnostics.back();
+}
+
+void TransformContext::resolveDeferred(const SourceManager& SM) {
+   for (; m_resolved < m_deferredDiagnostics.size(); ++m_resolved) {
+      auto& deferred = m_deferredDiagnostics[m_resolved];
+      if (deferred.Level == DiagnosticIDs::Ignored)
+         continue;
+
+      // As in Transform::diag, diagnostics in system headers are dropped, and
+      // the others are only counted in census mode.
+      bool dropped = SM.isInSystemHeader(deferred.Loc);
+      if (!dropped && m_census) {
+         auto file = SM.getFilename(SM.getFileLoc(deferred.Loc));
+         m_census->record(deferred.Check, file, 1, deferred.Counted);
+         dropped = true;
+      }
+      if (dropped) {
+         deferred.Level = DiagnosticIDs::Ignored;
+         deferred.Hints.clear();
+         continue;
+      }
+
+      for (auto& hint : deferred.Hints)
+         deferred.Replacements.emplace_back(SM, hint.RemoveRange,
+                                            hint.CodeToInsert);
+   }
+}
+
+std::vector<Replacement> TransformContext::deferredReplacements() const {
+   std::vector<Replacement> replacements;
+   for (auto& deferred : m_deferredDiagnostics)
+      replacements.insert(replacements.end(), deferred.Replacements.begin(),
+                          deferred.Replacements.end());
+   return replacements;
+}
+
+void TransformContext::flushDeferred(TransformContext*  target,
+                                     DiagnosticsEngine& Diagnostics) {
+   resolveDeferred(Diagnostics.getSourceManager());
+   for (auto& deferred : m_deferredDiagnostics) {
+      if (deferred.Level == DiagnosticIDs::Ignored) {
+         for (auto& replacement : deferred.Replacements) {
+            if (target)
+               target->push_back(replacement, deferred.Check);
+         }
+         continue;
+      }
+
+      // As in Transform::diag, fixes are pushed before the diagnostic is
+      // emitted by the builder destructor.
+      unsigned ID = Diagnostics.getDiagnosticIDs()->getCustomDiagID(
+         deferred.Level, deferred.Message);
+      DiagnosticBuilder builder = Diagnostics.Report(deferred.Loc, ID);
+      for (auto& hint : deferred.Hints)
+         builder << hint;
+      for (auto& replacement : deferred.Replacements) {
+         if (target && target->push_back(replacement, deferred.Check) &&
+             deferred.FixIts)
+            ++*deferred.FixIts;
+      }
+   }
+   m_deferredDiagnostics.clear();
+   m_resolved = 0;
 }
 
 
@@ -106,12 +218,42 @@ static void WriteReplacements(const Replacements& replacements,
    YAML << turs;
 }
 
+std::string TransformContext::takeReplacements(const std::string& mainFile) {
+   std::string        yaml;
+   raw_string_ostream out(yaml);
+   yaml::Output       YAML(out);
+   auto turs = BuildTURs(mainFile, "", m_replacements.begin(),
+                         m_replacements.end());
+   YAML << turs;
+   out.flush();
+
+   m_replacements = Replacements();
+   return yaml;
+}
+
+void TransformContext::mergeReplacements(StringRef yaml) {
+   TranslationUnitReplacements turs;
+   yaml::Input                 YAML(yaml);
+   YAML >> turs;
+   if (YAML.error()) {
+      std::cerr << "Cannot read the replacements of " << turs.MainSourceFile
+                << "\n";
+      return;
+   }
+
+   auto records = m_records;
+   m_records    = nullptr;
+   for (auto& replacement : turs.Replacements)
+      push_back(replacement);
+   m_records = records;
+}
+
 void TransformContext::ExportReplacements(const std::string& outputDir) const {
    WriteReplacements(m_replacements, outputDir);
 }
 
-void TransformContext::PrintReplacements(std::ostream&    ostr,
-                                         RefactoringTool& Tool) const {
+void TransformContext::PrintReplacements(std::ostream& ostr,
+                                         ClangTool&    Tool) const {
    LangOptions                           DefaultLangOptions;
    IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts = new DiagnosticOptions();
    TextDiagnosticPrinter DiagnosticPrinter(llvm::errs(), &*DiagOpts);
@@ -133,12 +275,29 @@ void TransformContext::PrintReplacements(std::ostream&    ostr,
    }
 }
 
+// Create the transform registered as \p name, bound to \p context.
+static std::unique_ptr<Transform> CreateTransform(StringRef         name,
+                                                  TransformContext* context) {
+   for (TransformFactoryRegistry::iterator
+           I = TransformFactoryRegistry::begin(),
+           E = TransformFactoryRegistry::end();
+        I != E;
+        ++I) {
+
+      if (I->getName() == name)
+         return I->instantiate()->create(I->getName(), context);
+   }
+   return std::unique_ptr<Transform>();
+}
 
 
 Transforms::Transforms()
    : m_transforms()
    , m_options()
-   , m_context() {}
+   , m_clangTidyChecks()
+   , m_context()
+   , m_fileCache(std::make_shared<SharedFileCache>())
+   , m_traversal() {}
 
 void Transforms::registerOptions(const llvm::cl::cat& Category) {
    for (TransformFactoryRegistry::iterator
@@ -150,57 +309,347 @@ void Transforms::registerOptions(const llvm::cl::cat& Category) {
       m_options[I->getName()] = llvm::make_unique<cl::opt<bool>>(
          I->getName(), cl::desc(I->getDesc()), cl::cat(Category));
    }
+
+#ifdef TIDY_WITH_CLANG_TIDY
+   m_clangTidyChecks = llvm::make_unique<cl::opt<std::string>>(
+      "clang-tidy-checks",
+      cl::desc("Also run the clang-tidy checks matching <globs>, e.g. "
+               "\"-*,modernize-use-nullptr\", in the same parse."),
+      cl::value_desc("globs"), cl::cat(Category));
+#endif
 }
 
-void Transforms::apply(const CompilationDatabase&      Compilations,
-                       const std::vector<std::string>& SourcePaths, bool Quiet,
-                       bool StdOut, bool Export, std::string OutputDir) {
+int Transforms::apply(const CompilationDatabase&      Compilations,
+                      const std::vector<std::string>& SourcePaths,
+                      const ApplyOptions&             Options) {
    // made transform context local.
    // link the refactoring tool or at least the map of file/replacement to the
    // transform context
+   m_traversal = Options.Traversal;
    instanciateTransforms();
 
-   RefactoringTool Tool(Compilations, SourcePaths);
+   auto fileSystem = Options.CacheFiles
+                        ? createCachingFileSystem(m_fileCache)
+                        : vfs::getRealFileSystem();
+
+   ClangTool Tool(Compilations, SourcePaths,
+                  std::make_shared<PCHContainerOperations>(), fileSystem);
 
    auto diagConsumer = llvm::make_unique<IgnoringDiagConsumer>();
 
-   if (Quiet)
+   if (Options.Quiet)
       Tool.setDiagnosticConsumer(diagConsumer.get());
 
-   MatchFinder Finder;
+   TransformActionFactory::CallbacksList callbacks;
+
+   std::unique_ptr<JsonLinesWriter>    jsonLines;
+   std::unique_ptr<JsonLinesCollector> collector;
+   if (!Options.JsonLines.empty()) {
+      std::error_code EC;
+      jsonLines = llvm::make_unique<JsonLinesWriter>(Options.JsonLines, EC);
+      if (EC) {
+         std::cerr << "Error opening file: " << EC.message() << "\n";
+         return 1;
+      }
+      collector =
+         llvm::make_unique<JsonLinesCollector>(*jsonLines, Options.Quiet);
+      Tool.setDiagnosticConsumer(collector.get());
+      m_context.setRecords(&collector->records());
+      callbacks.push_back(collector.get());
+   }
+
+   // Entries of the processed sources are replaced, the others are kept. The
+   // map is created by the first run, an existing one must load.
+   IncludeMap                          includeMap;
+   std::unique_ptr<IncludeMapRecorder> includeRecorder;
+   if (!Options.IncludeMap.empty()) {
+      std::string error;
+      if (sys::fs::exists(Options.IncludeMap) &&
+          !includeMap.load(Options.IncludeMap, error)) {
+         std::cerr << error << "\n";
+         return 1;
+      }
+      includeRecorder = llvm::make_unique<IncludeMapRecorder>(includeMap);
+      callbacks.push_back(includeRecorder.get());
+   }
+
+   // Only the sequential matching is profiled, the chunk and stage finders
+   // are not.
+   llvm::StringMap<llvm::TimeRecord> matchTimes;
+   MatchFinder::MatchFinderOptions   finderOptions;
+   if (Options.ReportTime)
+      finderOptions.CheckProfiling.emplace(matchTimes);
+
+   MatchFinder Finder(std::move(finderOptions));
 
    for (auto& t : m_transforms)
       t->registerMatchers(&Finder);
 
-   Tool.run(newFrontendActionFactory(&Finder).get());
+   bool skipFunctionBodies =
+      !m_transforms.empty() &&
+      std::none_of(m_transforms.begin(), m_transforms.end(),
+                   [](const std::unique_ptr<Transform>& t) {
+                      return t->needsFunctionBodies();
+                   });
+
+   std::unique_ptr<Census> census;
+   if (Options.CensusOnly) {
+      census = llvm::make_unique<Census>(Options.CensusDepth);
+      m_context.setCensus(census.get());
+   }
+
+   TransformActionFactory::TransformsList transforms;
+   for (auto& t : m_transforms)
+      transforms.push_back(t.get());
+
+   TransformActionFactory Factory(&Finder, skipFunctionBodies, transforms,
+                                  callbacks);
+   AstCacheActionFactory  CachedFactory(&Factory, Options.Cache);
+   if (includeRecorder)
+      CachedFactory.setIncludeMap(&includeMap);
+   // The clang-tidy checks need the preprocessor callbacks of a parse.
+   if (m_clangTidyChecks && !m_clangTidyChecks->empty())
+      CachedFactory.setLoadSnapshots(false);
+
+   // Chunks only match the thread-safe small-tidy transforms, the others are
+   // matched by the sequential finder. The clang-tidy checks need their
+   // preprocessor callbacks.
+   std::unique_ptr<ParallelMatcher> parallelMatcher;
+   MatchFinder                      sequentialFinder;
+   if (Options.MatchThreads > 1) {
+      std::vector<Transform*> threadSafe;
+      for (auto& t : m_transforms) {
+         if (t->isThreadSafe())
+            threadSafe.push_back(t.get());
+         else
+            t->registerMatchers(&sequentialFinder);
+      }
+
+      if (m_clangTidyChecks && !m_clangTidyChecks->empty()) {
+         std::cerr << "Matching from threads is not supported with clang-tidy "
+                      "checks, matching sequentially.\n";
+      }
+      else if (threadSafe.empty()) {
+         std::cerr << "None of the transforms can be matched from threads, "
+                      "matching sequentially.\n";
+      }
+      else {
+         parallelMatcher = llvm::make_unique<ParallelMatcher>(
+            &Finder, &sequentialFinder, std::move(threadSafe),
+            Options.MatchThreads);
+         Factory.setConsumerFactory([&parallelMatcher](CompilerInstance&) {
+            return parallelMatcher->newASTConsumer();
+         });
+      }
+   }
+
+   std::unique_ptr<Pipeline> pipeline;
+   DiagnosticConsumer*       pipelineConsumer = nullptr;
+   if (!Options.Pipeline.empty()) {
+      for (auto& stage : Options.Pipeline) {
+         TransformContext scratch;
+         if (!CreateTransform(stage, &scratch)) {
+            std::cerr << "Unknown pipeline stage: " << stage << "\n";
+            return 1;
+         }
+      }
+      // Each stage parse is its own, with the stage transforms only.
+      if (m_clangTidyChecks && !m_clangTidyChecks->empty())
+         std::cerr << "The clang-tidy checks are not run by a pipeline.\n";
+      if (Options.MatchThreads > 1)
+         std::cerr << "A pipeline matches sequentially, ignoring "
+                      "-match-threads.\n";
+      if (Options.Cache)
+         std::cerr << "A pipeline parses every source, ignoring -ast-cache.\n";
+      pipeline = llvm::make_unique<Pipeline>(
+         Options.Pipeline, [this](StringRef name, TransformContext* context) {
+            TransformsInstances stage;
+            stage.push_back(CreateTransform(name, context));
+            if (m_traversal)
+               stage.back()->setTraversalKind(*m_traversal);
+            return stage;
+         });
+      if (collector)
+         pipelineConsumer = collector.get();
+      else if (Options.Quiet)
+         pipelineConsumer = diagConsumer.get();
+   }
+
+   bool useWorkers = Options.Workers > 0 && WorkerPool::isSupported();
+   if (Options.Workers > 0 && !useWorkers)
+      std::cerr << "Worker processes are not supported, running in process.\n";
 
-   if (StdOut)
+   auto runInProcess = [&](const std::vector<std::string>& sources) {
+      if (pipeline) {
+         for (auto& source : sources)
+            pipeline->run(Compilations, source, fileSystem, pipelineConsumer,
+                          callbacks, m_context);
+         return 0;
+      }
+
+      ClangTool local(Compilations, sources,
+                      std::make_shared<PCHContainerOperations>(), fileSystem);
+      if (collector)
+         local.setDiagnosticConsumer(collector.get());
+      else if (Options.Quiet)
+         local.setDiagnosticConsumer(diagConsumer.get());
+      return local.run(&CachedFactory);
+   };
+
+   int  res   = 0;
+   auto start = std::chrono::steady_clock::now();
+   if (useWorkers) {
+      WorkerOutputs outputs;
+      outputs.JsonLines = jsonLines.get();
+      outputs.Counter   = census.get();
+      outputs.Includes  = includeRecorder ? &includeMap : nullptr;
+
+      std::set<std::string> processed;
+      WorkerPool            pool(Options.Workers);
+      bool                  succeeded = pool.run(
+         SourcePaths,
+         [&](const std::string& source, const WorkerPool::Sender& send) {
+            outputs.beginSource();
+            // A worker forked after a crash starts with the replacements
+            // merged so far, they must not be sent again.
+            m_context.clearReplacements();
+            if (runInProcess({source}) != 0)
+               send(MessageFailed, StringRef());
+
+            send(MessageReplacements, m_context.takeReplacements(source));
+            outputs.send(send);
+         },
+         [&](const std::string& source, char kind, StringRef data) {
+            processed.insert(source);
+            if (kind == MessageReplacements)
+               m_context.mergeReplacements(data);
+            else if (kind == MessageFailed)
+               res = 1;
+            else
+               outputs.merge(kind, data);
+         });
+      pool.printFailures(std::cerr);
+
+      // The workers could not be started or replaced: the sources they did
+      // not reach are processed here. The ones which crashed a worker are
+      // not tried again.
+      if (!succeeded) {
+         res = 1;
+         for (auto& failure : pool.failures())
+            processed.insert(failure.Source);
+
+         std::vector<std::string> remaining;
+         for (auto& source : SourcePaths) {
+            if (!processed.count(source))
+               remaining.push_back(source);
+         }
+         if (!remaining.empty()) {
+            std::cerr << remaining.size()
+                      << " source(s) not processed by the workers, "
+                         "processing them in process.\n";
+            runInProcess(remaining);
+         }
+      }
+   }
+   else if (pipeline) {
+      res = runInProcess(SourcePaths);
+   }
+   else {
+      res = Tool.run(&CachedFactory);
+   }
+   auto elapsed = std::chrono::steady_clock::now() - start;
+
+   m_context.setRecords(nullptr);
+
+   if (includeRecorder) {
+      std::string error;
+      if (!includeMap.save(Options.IncludeMap, error))
+         std::cerr << error << "\n";
+   }
+
+   if (Options.ReportTime) {
+      ReportElapsedTime(std::cerr, SourcePaths.size(), elapsed,
+                        skipFunctionBodies);
+      ReportMatchTime(std::cerr, matchTimes, transforms);
+      if (Options.CacheFiles)
+         m_fileCache->printStats(std::cerr);
+   }
+
+   if (census) {
+      m_context.setCensus(nullptr);
+      census->print(std::cout);
+      return res;
+   }
+
+   if (Options.StdOut)
       m_context.PrintReplacements(std::cout, Tool);
 
-   if (Export)
-      m_context.ExportReplacements(OutputDir);
+   if (Options.Export)
+      m_context.ExportReplacements(Options.OutputDir);
+   return res;
 }
 
 
 void Transforms::instanciateTransforms() {
+   m_transforms = createTransforms(&m_context);
+
+#ifdef TIDY_WITH_CLANG_TIDY
+   if (!m_clangTidyChecks->empty()) {
+      auto checks = createClangTidyTransform(*m_clangTidyChecks, &m_context);
+      if (checks)
+         m_transforms.emplace_back(std::move(checks));
+   }
+#endif
+}
+
+Transforms::TransformsInstances
+Transforms::createTransforms(TransformContext* context) const {
+   TransformsInstances transforms;
    for (TransformFactoryRegistry::iterator
            I = TransformFactoryRegistry::begin(),
            E = TransformFactoryRegistry::end();
         I != E;
         ++I) {
 
-      if (*m_options[I->getName()]) {
+      if (*m_options.at(I->getName())) {
          auto factory = I->instantiate();
-         auto check   = factory->create(I->getName(), &m_context);
-         if (check)
-            m_transforms.emplace_back(std::move(check));
+         auto check   = factory->create(I->getName(), context);
+         if (!check)
+            continue;
+         if (m_traversal)
+            check->setTraversalKind(*m_traversal);
+         transforms.emplace_back(std::move(check));
       }
    }
+   return transforms;
+}
+
+std::mutex& SourceManagerMutex() {
+   static std::mutex mutex;
+   return mutex;
+}
+
+void Transform::addMatcher(MatchFinder*              Finder,
+                           const DeclarationMatcher& Matcher) {
+   if (m_traversal == TraversalKind::AsIs)
+      Finder->addMatcher(Matcher, m_callback);
+   else
+      Finder->addMatcher(decl(Matcher, unless(isInstantiated())), m_callback);
+}
+
+void Transform::addMatcher(MatchFinder*            Finder,
+                           const StatementMatcher& Matcher) {
+   if (m_traversal == TraversalKind::AsIs)
+      Finder->addMatcher(Matcher, m_callback);
+   else
+      Finder->addMatcher(stmt(Matcher, unless(isInTemplateInstantiation())),
+                         m_callback);
 }
 
 void Transform::run(
    const clang::ast_matchers::MatchFinder::MatchResult& Result) {
    // Context->setSourceManager(Result.SourceManager);
+   ++m_matches;
    check(Result);
 }
 
@@ -209,26 +658,60 @@ FixItHIntHelper Transform::diag(
    SourceLocation Loc, StringRef Description, DiagnosticIDs::Level Level) {
    assert(Loc.isValid());
 
+   // Deferred diagnostics only look at their location once resolved.
+   if (m_ctx->deferred()) {
+      auto& deferred = m_ctx->defer(
+         Loc, Level, (Description + " [" + CheckName + "]").str(), CheckName);
+      deferred.FixIts = &m_fixIts;
+      return FixItHIntHelper(&deferred, m_ctx->census() != nullptr);
+   }
+
    const SourceManager& Sources = *Result.SourceManager;
    if (Sources.isInSystemHeader(Loc))
       return FixItHIntHelper(nullptr, nullptr, DiagnosticBuilder::getEmpty());
 
+   if (auto census = m_ctx->census()) {
+      auto file = Sources.getFilename(Sources.getFileLoc(Loc));
+      census->record(CheckName, file, 1, 0);
+      return FixItHIntHelper(census, CheckName, file);
+   }
+
    DiagnosticsEngine& DiagEngine = Result.Context->getDiagnostics();
 
    unsigned ID = DiagEngine.getDiagnosticIDs()->getCustomDiagID(
       Level, (Description + " [" + CheckName + "]").str());
    return FixItHIntHelper(Result.SourceManager, m_ctx,
-                          DiagEngine.Report(Loc, ID));
+                          DiagEngine.Report(Loc, ID), CheckName, &m_fixIts);
 }
 
 void FixItHIntHelper::push_back(const FixItHint& Hint) {
+   if (Counter)
+      Counter->record(Check, File, 0, 1);
+
+   if (Deferred) {
+      if (CensusOnly)
+         ++Deferred->Counted;
+      else
+         Deferred->Hints.push_back(Hint);
+      return;
+   }
+
    if (!SM)
       return;
 
    Diag << Hint;
    Hints.push_back(Hint);
 
-   Ctx->push_back(Replacement(*SM, Hint.RemoveRange, Hint.CodeToInsert));
+   if (!Ctx->push_back(Replacement(*SM, Hint.RemoveRange, Hint.CodeToInsert),
+                       Check))
+      return;
+   ++Accepted;
+   if (FixIts)
+      ++*FixIts;
+}
+
+bool FixItHIntHelper::dropsHints() const {
+   return !SM && !Counter && !Deferred;
 }
 
 }  // namespace tidy
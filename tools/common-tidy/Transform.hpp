@@ -25,49 +25,221 @@
 #ifndef TRANSFORM_HPP
 #define TRANSFORM_HPP
 
+#include <deque>
 #include <iosfwd>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 
+#include "IncludeInserter.hpp"
+#include "Statistics.hpp"
+
+#include "clang/AST/ASTContext.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchersInternal.h"
+#include "clang/ASTMatchers/ASTMatchersMacros.h"
+#include "clang/Basic/SourceManager.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Refactoring.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Registry.h"
 //#include "llvm/Support/YAMLTraits.h"
 
 namespace tidy {
 
+class AstCache;
+class Census;
+class JsonLinesRecords;
+class SharedFileCache;
+
+/// Diagnostic kept by a deferred TransformContext, with its hints. The fixes
+/// of the hints are only built by TransformContext::resolveDeferred().
+struct DeferredDiagnostic {
+   clang::SourceLocation                    Loc;
+   clang::DiagnosticIDs::Level              Level;
+   std::string                              Message;
+   std::string                              Check;
+   std::vector<clang::FixItHint>            Hints;
+   std::vector<clang::tooling::Replacement> Replacements;
+   // Counter of the accepted fix-its of the transform, and the fix-its
+   // counted instead of kept in census mode.
+   Statistic* FixIts;
+   unsigned   Counted;
+};
+
 class TransformContext {
 public:
-   void push_back(const clang::tooling::Replacement& replacement);
+   TransformContext()
+      : m_replacements()
+      , m_census(nullptr)
+      , m_records(nullptr)
+      , m_deferred(false)
+      , m_includes()
+      , m_deferredDiagnostics()
+      , m_resolved(0) {}
+
+   /// Add \p replacement, made by \p check. Return false when it conflicts
+   /// with an earlier replacement and is dropped.
+   bool push_back(const clang::tooling::Replacement& replacement,
+                  llvm::StringRef                    check = "");
+
+   /// When set, transforms only count their matches in \p census.
+   void setCensus(Census* census) {
+      m_census = census;
+   }
+
+   Census* census() const {
+      return m_census;
+   }
+
+   /// When set, fixes are also recorded in \p records as they are pushed.
+   void setRecords(JsonLinesRecords* records) {
+      m_records = records;
+   }
+
+   /// When set, diagnostics and fixes are kept in order instead of being
+   /// reported, e.g. until a pipeline stage is known to apply.
+   void setDeferred(bool deferred) {
+      m_deferred = deferred;
+   }
+
+   bool deferred() const {
+      return m_deferred;
+   }
+
+   /// Headers inserted by the fixes, shared by the transforms so that each
+   /// is added once.
+   IncludeInserter& includes() {
+      return m_includes;
+   }
+
+   DeferredDiagnostic& defer(clang::SourceLocation       Loc,
+                             clang::DiagnosticIDs::Level Level,
+                             llvm::StringRef Message, llvm::StringRef check);
+
+   /// Build the fixes of the deferred diagnostics not resolved yet, dropping
+   /// the ones in system headers, or count them in census mode.
+   void resolveDeferred(const clang::SourceManager& SM);
+
+   /// Fixes of the resolved deferred diagnostics, in the order they were
+   /// made.
+   std::vector<clang::tooling::Replacement> deferredReplacements() const;
+
+   const std::deque<DeferredDiagnostic>& deferredDiagnostics() const {
+      return m_deferredDiagnostics;
+   }
+
+   /// Resolve the deferred diagnostics, report them in \p Diagnostics and
+   /// push their fixes into \p target, unless null, in the order they were
+   /// made. The fixes \p target accepts are counted in the statistics of
+   /// their transform, without target the caller counts the ones it keeps.
+   void flushDeferred(TransformContext*         target,
+                      clang::DiagnosticsEngine& Diagnostics);
+
+   /// Return the replacements as YAML and clear them, so that a worker
+   /// process can send them to mergeReplacements() in its supervisor.
+   std::string takeReplacements(const std::string& mainFile);
+
+   void mergeReplacements(llvm::StringRef yaml);
+
+   /// Drop the replacements, e.g. the ones a worker inherits from its
+   /// supervisor when it is forked.
+   void clearReplacements() {
+      m_replacements = clang::tooling::Replacements();
+   }
 
    void ExportReplacements(const std::string& outputDir) const;
 
-   void PrintReplacements(std::ostream&                    ostr,
-                          clang::tooling::RefactoringTool& Tool) const;
+   void PrintReplacements(std::ostream&              ostr,
+                          clang::tooling::ClangTool& Tool) const;
 
 private:
    clang::tooling::Replacements m_replacements;
+   Census*                      m_census;
+   JsonLinesRecords*            m_records;
+   bool                         m_deferred;
+   IncludeInserter              m_includes;
+   // A deque keeps the diagnostics in place, helpers point to them.
+   std::deque<DeferredDiagnostic> m_deferredDiagnostics;
+   std::size_t                    m_resolved;
 };
 
 class FixItHIntHelper {
 public:
    FixItHIntHelper(clang::SourceManager* sm, TransformContext* t,
-                   clang::DiagnosticBuilder diag)
+                   clang::DiagnosticBuilder diag, llvm::StringRef check = "",
+                   Statistic* fixIts = nullptr)
       : SM(sm)
       , Ctx(t)
       , Diag(diag)
-      , Hints() {}
+      , Hints()
+      , Counter(nullptr)
+      , Check(check)
+      , File()
+      , FixIts(fixIts)
+      , Deferred(nullptr)
+      , CensusOnly(false)
+      , Accepted(0) {}
+
+   /// Deferred mode: hints are kept in \p deferred, or only counted when
+   /// \p censusOnly.
+   FixItHIntHelper(DeferredDiagnostic* deferred, bool censusOnly)
+      : SM(nullptr)
+      , Ctx(nullptr)
+      , Diag(clang::DiagnosticBuilder::getEmpty())
+      , Hints()
+      , Counter(nullptr)
+      , Check(deferred->Check)
+      , File()
+      , FixIts(nullptr)
+      , Deferred(deferred)
+      , CensusOnly(censusOnly)
+      , Accepted(0) {}
+
+   /// Census mode: hints are only counted in \p counter.
+   FixItHIntHelper(Census* counter, llvm::StringRef check,
+                   llvm::StringRef file)
+      : SM(nullptr)
+      , Ctx(nullptr)
+      , Diag(clang::DiagnosticBuilder::getEmpty())
+      , Hints()
+      , Counter(counter)
+      , Check(check)
+      , File(file)
+      , FixIts(nullptr)
+      , Deferred(nullptr)
+      , CensusOnly(true)
+      , Accepted(0) {}
 
    void push_back(const clang::FixItHint& Hint);
 
+   /// Return true when hints would be dropped without being counted, e.g.
+   /// in a system header, so the caller can skip building their text. In
+   /// census mode the hints are still streamed, each one is counted.
+   bool dropsHints() const;
+
+   /// Number of the hints pushed so far whose replacement the context
+   /// accepted. Deferred hints are only pushed when flushed, they are not
+   /// counted.
+   unsigned accepted() const {
+      return Accepted;
+   }
+
 private:
    clang::SourceManager*         SM;
    TransformContext*             Ctx;
    clang::DiagnosticBuilder      Diag;
    std::vector<clang::FixItHint> Hints;
+   Census*                       Counter;
+   std::string                   Check;
+   std::string                   File;
+   Statistic*                    FixIts;
+   DeferredDiagnostic*           Deferred;
+   bool                          CensusOnly;
+   unsigned                      Accepted;
 };
 
 inline FixItHIntHelper& operator<<(FixItHIntHelper&        h,
@@ -76,31 +248,131 @@ inline FixItHIntHelper& operator<<(FixItHIntHelper&        h,
    return h;
 }
 
+/// Lock of the source manager while matching threads run, see
+/// isExpansionInMainFileLocked.
+std::mutex& SourceManagerMutex();
+
+/// Same as isExpansionInMainFile(), reading the source manager under
+/// SourceManagerMutex() so that matchers using it are thread-safe.
+AST_POLYMORPHIC_MATCHER(isExpansionInMainFileLocked,
+                        AST_POLYMORPHIC_SUPPORTED_TYPES(clang::Decl,
+                                                        clang::Stmt)) {
+   std::lock_guard<std::mutex> lock(SourceManagerMutex());
+   auto& SM = Finder->getASTContext().getSourceManager();
+   return SM.isInMainFile(SM.getExpansionLoc(Node.getLocStart()));
+}
+
+/// Nodes seen by the matchers of a transform.
+enum class TraversalKind {
+   /// Every node, including the ones of implicit template instantiations.
+   AsIs,
+   /// Only the nodes spelled in the source: template instantiations are not
+   /// matched, their patterns are.
+   SpelledInSource
+};
+
 class Transform : public clang::ast_matchers::MatchFinder::MatchCallback {
 public:
    using MatchFinder = clang::ast_matchers::MatchFinder;
 
-   Transform(llvm::StringRef CheckName, TransformContext* ctx)
+   Transform(llvm::StringRef CheckName, TransformContext* ctx,
+             TraversalKind Traversal = TraversalKind::SpelledInSource)
       : CheckName(CheckName)
-      , m_ctx(ctx) {}
+      , m_ctx(ctx)
+      , m_traversal(Traversal)
+      , m_callback(this)
+      , m_matches(CheckName, "matches", "Matches reported to the transform")
+      , m_fixIts(CheckName, "fix-its", "Fix-it hints accepted") {}
 
    virtual ~Transform() {}
 
+   /// Name of the transform, used to profile its matchers.
+   llvm::StringRef getID() const override {
+      return CheckName;
+   }
+
+   TraversalKind traversalKind() const {
+      return m_traversal;
+   }
+
+   /// Override the traversal kind the transform was created with, before its
+   /// matchers are registered.
+   void setTraversalKind(TraversalKind traversal) {
+      m_traversal = traversal;
+   }
+
    virtual void registerMatchers(MatchFinder* Finder) {}
 
+   /// Register the matchers of the transform in \p Finder, their matches
+   /// being handed to \p Callback instead of the transform, e.g. to be
+   /// recorded by a matching thread and checked later.
+   void redirectMatchers(MatchFinder*                Finder,
+                         MatchFinder::MatchCallback* Callback) {
+      m_callback = Callback;
+      registerMatchers(Finder);
+      m_callback = this;
+   }
+
    virtual void check(const MatchFinder::MatchResult& Result) {}
 
+   /// Transforms which only inspect declarations return false, so the
+   /// frontend can skip parsing of function bodies when none needs them.
+   virtual bool needsFunctionBodies() const {
+      return true;
+   }
+
+   /// Called around each translation unit, once its preprocessor and its
+   /// AST context exist, e.g. to register preprocessor callbacks.
+   virtual void beginSourceFile(clang::CompilerInstance& CI) {}
+
+   virtual void endSourceFile() {}
+
+   /// Transforms whose matchers only read the AST, without touching the
+   /// source manager (see isExpansionInMainFileLocked) or the caches of the
+   /// AST context, return true so that ParallelMatcher can match them from
+   /// several threads. Their checks still run from the calling thread, once
+   /// the threads are done. The others are matched sequentially.
+   virtual bool isThreadSafe() const {
+      return false;
+   }
+
    FixItHIntHelper diag(
       const MatchFinder::MatchResult& Result, clang::SourceLocation Loc,
       llvm::StringRef             Description,
       clang::DiagnosticIDs::Level Level = clang::DiagnosticIDs::Remark);
 
+protected:
+   /// Register \p Matcher in \p Finder for this transform, keeping it out of
+   /// template instantiations unless the transform traverses them as is.
+   void addMatcher(MatchFinder*                                   Finder,
+                   const clang::ast_matchers::DeclarationMatcher& Matcher);
+   void addMatcher(MatchFinder*                                 Finder,
+                   const clang::ast_matchers::StatementMatcher& Matcher);
+
+   /// Hint adding `#include Header` to the main file, unless it is already
+   /// included, see IncludeInserter.
+   llvm::Optional<clang::FixItHint>
+   includeHint(const MatchFinder::MatchResult& Result, llvm::StringRef Header) {
+      return m_ctx->includes().insert(*Result.SourceManager,
+                                      Result.Context->getLangOpts(), Header);
+   }
+
+   /// Callback of the matchers being registered, the transform itself unless
+   /// they are redirected.
+   MatchFinder::MatchCallback* callback() const {
+      return m_callback;
+   }
+
 private:
    void run(const MatchFinder::MatchResult& Result) override;
 
 protected:
-   std::string       CheckName;
-   TransformContext* m_ctx;
+   std::string                 CheckName;
+   TransformContext*           m_ctx;
+   TraversalKind               m_traversal;
+   MatchFinder::MatchCallback* m_callback;
+   Statistic                   m_matches;
+   Statistic                   m_fixIts;
 };
 
 struct TransformFactory {
@@ -113,30 +385,59 @@ struct TransformFactory {
 
 typedef llvm::Registry<TransformFactory> TransformFactoryRegistry;
 
+struct ApplyOptions {
+   bool        Quiet        = false;
+   bool        StdOut       = false;
+   bool        Export       = false;
+   bool        ReportTime   = false;
+   bool        CacheFiles   = true;
+   bool        CensusOnly   = false;
+   unsigned    CensusDepth  = 2;
+   unsigned    Workers      = 0;
+   unsigned    MatchThreads = 0;
+   std::string OutputDir;
+   std::string JsonLines;
+   std::string IncludeMap;
+   AstCache*   Cache        = nullptr;
+
+   // Traversal kind forced on every transform, instead of their own.
+   llvm::Optional<TraversalKind> Traversal;
+
+   // Transforms run as stages by Pipeline, instead of the selected ones.
+   std::vector<std::string> Pipeline;
+};
+
 class Transforms {
 public:
    Transforms();
 
    void registerOptions(const llvm::cl::cat& Category);
 
-   void apply(const clang::tooling::CompilationDatabase& Compilations,
-              const std::vector<std::string>&            SourcePaths,
-              bool                                       Quiet     = false,
-              bool                                       StdOut    = false,
-              bool                                       Export    = false,
-              std::string                                OutputDir = "");
+   /// Return 0 when every source was processed, 1 otherwise, as
+   /// ClangTool::run does.
+   int apply(const clang::tooling::CompilationDatabase& Compilations,
+             const std::vector<std::string>&            SourcePaths,
+             const ApplyOptions&                        Options);
 
 private:
+   typedef std::vector<std::unique_ptr<Transform>> TransformsInstances;
+
    void instanciateTransforms();
 
+   /// Create the selected small-tidy transforms, bound to \p context.
+   TransformsInstances createTransforms(TransformContext* context) const;
+
 private:
-   typedef std::vector<std::unique_ptr<Transform>> TransformsInstances;
    typedef std::map<std::string, std::unique_ptr<llvm::cl::opt<bool>>>
       OptionsMap;
+   typedef std::unique_ptr<llvm::cl::opt<std::string>> StringOption;
 
-   TransformsInstances m_transforms;
-   OptionsMap          m_options;
-   TransformContext    m_context;
+   TransformsInstances              m_transforms;
+   OptionsMap                       m_options;
+   StringOption                     m_clangTidyChecks;
+   TransformContext                 m_context;
+   std::shared_ptr<SharedFileCache> m_fileCache;
+   llvm::Optional<TraversalKind>    m_traversal;
 };
 
 
@@ -0,0 +1,135 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "TransformAction.hpp"
+#include "Transform.hpp"
+
+#include <iostream>
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+using namespace clang::tooling;
+
+namespace tidy {
+
+namespace {
+
+class TransformFrontendAction : public ASTFrontendAction {
+public:
+   TransformFrontendAction(
+      MatchFinder* Finder, bool SkipFunctionBodies,
+      const TransformActionFactory::TransformsList&  Transforms,
+      const TransformActionFactory::CallbacksList&   Callbacks,
+      const TransformActionFactory::ConsumerFactory& ConsumerFactory)
+      : m_finder(Finder)
+      , m_skipFunctionBodies(SkipFunctionBodies)
+      , m_transforms(Transforms)
+      , m_callbacks(Callbacks)
+      , m_consumerFactory(ConsumerFactory) {}
+
+   bool BeginInvocation(CompilerInstance& CI) override {
+      // Sema still sees every declaration, only the bodies are not parsed.
+      if (m_skipFunctionBodies)
+         CI.getFrontendOpts().SkipFunctionBodies = true;
+      return true;
+   }
+
+   bool BeginSourceFileAction(CompilerInstance& CI) override {
+      if (!ASTFrontendAction::BeginSourceFileAction(CI))
+         return false;
+      for (auto callbacks : m_callbacks) {
+         if (!callbacks->handleBeginSource(CI))
+            return false;
+      }
+      return true;
+   }
+
+   void EndSourceFileAction() override {
+      for (auto transform : m_transforms)
+         transform->endSourceFile();
+      for (auto callbacks : m_callbacks)
+         callbacks->handleEndSource();
+      ASTFrontendAction::EndSourceFileAction();
+   }
+
+   std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance& CI,
+                                                  StringRef file) override {
+      // Called once the AST context exists, unlike BeginSourceFileAction.
+      for (auto transform : m_transforms)
+         transform->beginSourceFile(CI);
+      if (m_consumerFactory)
+         return m_consumerFactory(CI);
+      return m_finder->newASTConsumer();
+   }
+
+private:
+   MatchFinder*                            m_finder;
+   bool                                    m_skipFunctionBodies;
+   TransformActionFactory::TransformsList  m_transforms;
+   TransformActionFactory::CallbacksList   m_callbacks;
+   TransformActionFactory::ConsumerFactory m_consumerFactory;
+};
+
+}  // namespace
+
+FrontendAction* TransformActionFactory::create() {
+   return new TransformFrontendAction(m_finder, m_skipFunctionBodies,
+                                      m_transforms, m_callbacks,
+                                      m_consumerFactory);
+}
+
+void ReportElapsedTime(std::ostream& ostr, std::size_t files,
+                       std::chrono::steady_clock::duration elapsed,
+                       bool skipFunctionBodies) {
+   auto ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+   ostr << files << " file(s) processed in " << ms << " ms";
+   if (skipFunctionBodies)
+      ostr << " (function bodies skipped)";
+   ostr << "\n";
+}
+
+void ReportMatchTime(
+   std::ostream& ostr, const llvm::StringMap<llvm::TimeRecord>& Records,
+   const TransformActionFactory::TransformsList& Transforms) {
+   for (auto transform : Transforms) {
+      auto record = Records.find(transform->getID());
+      if (record == Records.end())
+         continue;
+
+      auto ms = static_cast<long long>(record->second.getWallTime() * 1000);
+      ostr << transform->getID().str() << ": " << ms << " ms matching";
+      if (transform->traversalKind() == TraversalKind::AsIs)
+         ostr << " (template instantiations included)";
+      else
+         ostr << " (spelled source only)";
+      ostr << "\n";
+   }
+}
+
+}  // namespace tidy
@@ -0,0 +1,101 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef TRANSFORM_ACTION_HPP
+#define TRANSFORM_ACTION_HPP
+
+#include <chrono>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Timer.h"
+
+namespace tidy {
+
+class Transform;
+
+/// Frontend action factory used to run a MatchFinder over each translation
+/// unit.
+///
+/// Unlike clang::tooling::newFrontendActionFactory, it can tune the frontend
+/// for the transforms being run, e.g. skip parsing of function bodies when
+/// only declarations are inspected.
+///
+/// \p Transforms see the beginning of each translation unit once its AST
+/// context exists, and its end before the optional \p Callbacks, which are
+/// notified in order.
+///
+/// The AST consumer of each translation unit comes from \p Finder, unless a
+/// consumer factory is set, e.g. to match from several threads.
+class TransformActionFactory : public clang::tooling::FrontendActionFactory {
+public:
+   using TransformsList  = std::vector<Transform*>;
+   using CallbacksList   = std::vector<clang::tooling::SourceFileCallbacks*>;
+   using ConsumerFactory = std::function<std::unique_ptr<clang::ASTConsumer>(
+      clang::CompilerInstance& CI)>;
+
+   TransformActionFactory(clang::ast_matchers::MatchFinder* Finder,
+                          bool                  SkipFunctionBodies,
+                          const TransformsList& Transforms,
+                          const CallbacksList&  Callbacks = CallbacksList())
+      : m_finder(Finder)
+      , m_skipFunctionBodies(SkipFunctionBodies)
+      , m_transforms(Transforms)
+      , m_callbacks(Callbacks)
+      , m_consumerFactory() {}
+
+   void setConsumerFactory(ConsumerFactory Factory) {
+      m_consumerFactory = std::move(Factory);
+   }
+
+   clang::FrontendAction* create() override;
+
+private:
+   clang::ast_matchers::MatchFinder* m_finder;
+   bool                              m_skipFunctionBodies;
+   TransformsList                    m_transforms;
+   CallbacksList                     m_callbacks;
+   ConsumerFactory                   m_consumerFactory;
+};
+
+/// Print the wall-clock time spent by a tool run over \p files.
+void ReportElapsedTime(std::ostream& ostr, std::size_t files,
+                       std::chrono::steady_clock::duration elapsed,
+                       bool skipFunctionBodies);
+
+/// Print the time spent matching each of \p Transforms, with its traversal
+/// kind, from the \p Records profiled by their MatchFinder.
+void ReportMatchTime(
+   std::ostream& ostr, const llvm::StringMap<llvm::TimeRecord>& Records,
+   const TransformActionFactory::TransformsList& Transforms);
+
+}  // namespace tidy
+
+#endif
@@ -0,0 +1,431 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "WorkerPool.hpp"
+#include "Census.hpp"
+#include "IncludeMap.hpp"
+#include "JsonLines.hpp"
+#include "Statistics.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "llvm/Support/raw_ostream.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+
+namespace tidy {
+
+static Statistic NumFailed("worker-pool", "failed",
+                           "Sources lost with their worker");
+static Statistic NumSpawned("worker-pool", "spawned",
+                            "Worker processes started");
+
+#ifndef _WIN32
+
+namespace {
+
+// Frames are a kind, a 32 bits size and the data. The supervisor sends
+// FrameSource frames, workers answer with any frame but FrameDone, then
+// FrameDone once the source is complete.
+const char FrameSource = 'T';
+const char FrameDone   = '\0';
+
+bool WriteAll(int fd, const char* data, std::size_t size) {
+   while (size != 0) {
+      auto n = ::write(fd, data, size);
+      if (n < 0) {
+         if (errno == EINTR)
+            continue;
+         return false;
+      }
+      data += n;
+      size -= n;
+   }
+   return true;
+}
+
+bool ReadAll(int fd, char* data, std::size_t size) {
+   while (size != 0) {
+      auto n = ::read(fd, data, size);
+      if (n < 0) {
+         if (errno == EINTR)
+            continue;
+         return false;
+      }
+      if (n == 0)
+         return false;
+      data += n;
+      size -= n;
+   }
+   return true;
+}
+
+bool WriteFrame(int fd, char Kind, StringRef Data) {
+   char header[5];
+   auto size = static_cast<std::uint32_t>(Data.size());
+   header[0] = Kind;
+   std::memcpy(header + 1, &size, sizeof(size));
+   return WriteAll(fd, header, sizeof(header)) &&
+          WriteAll(fd, Data.data(), Data.size());
+}
+
+bool ReadFrame(int fd, char& Kind, std::string& Data) {
+   char header[5];
+   if (!ReadAll(fd, header, sizeof(header)))
+      return false;
+
+   std::uint32_t size;
+   std::memcpy(&size, header + 1, sizeof(size));
+   Kind = header[0];
+   Data.resize(size);
+   return size == 0 || ReadAll(fd, &Data[0], size);
+}
+
+std::string DescribeStatus(int status) {
+   if (WIFSIGNALED(status)) {
+      auto sig = WTERMSIG(status);
+      return "killed by signal " + std::to_string(sig) + " (" +
+             ::strsignal(sig) + ")";
+   }
+   if (WIFEXITED(status))
+      return "exited with status " + std::to_string(WEXITSTATUS(status));
+   return "stopped";
+}
+
+struct Worker {
+   pid_t                                     Pid        = -1;
+   int                                       ToWorker   = -1;
+   int                                       FromWorker = -1;
+   int                                       Source     = -1;
+   std::vector<std::pair<char, std::string>> Pending;
+};
+
+/// Process the sources sent on \p in until it is closed.
+void WorkerMain(int in, int out, const WorkerPool::Job& Job) {
+   WorkerPool::Sender send = [out](char Kind, StringRef Data) {
+      if (Kind == FrameDone || !WriteFrame(out, Kind, Data))
+         ::_exit(1);
+   };
+
+   char        kind;
+   std::string source;
+   while (ReadFrame(in, kind, source) && kind == FrameSource) {
+      Job(source, send);
+
+      // The worker leaves with _exit(), without flushing anything.
+      std::cout.flush();
+      std::cerr.flush();
+      llvm::outs().flush();
+      llvm::errs().flush();
+
+      if (!WriteFrame(out, FrameDone, StringRef()))
+         break;
+   }
+}
+
+class Supervisor {
+public:
+   Supervisor(const std::vector<std::string>& Sources,
+              const WorkerPool::Job& Job, const WorkerPool::Handler& OnMessage,
+              std::vector<WorkerPool::Failure>& Failures)
+      : m_sources(Sources)
+      , m_job(Job)
+      , m_onMessage(OnMessage)
+      , m_failures(Failures)
+      , m_workers()
+      , m_next(0) {}
+
+   bool run(unsigned Workers) {
+      m_workers.resize(std::min<std::size_t>(Workers, m_sources.size()));
+      for (auto& worker : m_workers) {
+         if (!spawn(worker))
+            return stop(false);
+         assign(worker);
+      }
+
+      std::vector<pollfd>  fds;
+      std::vector<Worker*> polled;
+      for (;;) {
+         fds.clear();
+         polled.clear();
+         for (auto& worker : m_workers) {
+            if (worker.Source >= 0) {
+               fds.push_back({worker.FromWorker, POLLIN, 0});
+               polled.push_back(&worker);
+            }
+         }
+         if (fds.empty())
+            break;
+
+         if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+               continue;
+            std::cerr << "poll: " << std::strerror(errno) << "\n";
+            return stop(false);
+         }
+
+         for (std::size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].revents != 0 && !receive(*polled[i]))
+               return stop(false);
+         }
+      }
+      return stop(true);
+   }
+
+private:
+   bool spawn(Worker& worker) {
+      int toWorker[2];
+      int fromWorker[2];
+      if (::pipe(toWorker) != 0)
+         return false;
+      if (::pipe(fromWorker) != 0) {
+         ::close(toWorker[0]);
+         ::close(toWorker[1]);
+         return false;
+      }
+
+      // Nothing buffered before the fork must be written twice.
+      std::cout.flush();
+      std::cerr.flush();
+      llvm::outs().flush();
+      llvm::errs().flush();
+
+      auto pid = ::fork();
+      if (pid < 0) {
+         std::cerr << "fork: " << std::strerror(errno) << "\n";
+         for (int fd : {toWorker[0], toWorker[1], fromWorker[0], fromWorker[1]})
+            ::close(fd);
+         return false;
+      }
+
+      if (pid == 0) {
+         // Other workers see the end of their input only once every copy of
+         // its write end is closed.
+         for (auto& other : m_workers) {
+            if (other.Pid > 0) {
+               ::close(other.ToWorker);
+               ::close(other.FromWorker);
+            }
+         }
+         ::close(toWorker[1]);
+         ::close(fromWorker[0]);
+         ::signal(SIGPIPE, SIG_DFL);
+         WorkerMain(toWorker[0], fromWorker[1], m_job);
+         ::_exit(0);
+      }
+
+      ::close(toWorker[0]);
+      ::close(fromWorker[1]);
+      worker.Pid        = pid;
+      worker.ToWorker   = toWorker[1];
+      worker.FromWorker = fromWorker[0];
+      worker.Source     = -1;
+      worker.Pending.clear();
+      ++NumSpawned;
+      return true;
+   }
+
+   /// Send the next source to \p worker, replacing it if it is dead.
+   bool assign(Worker& worker) {
+      if (m_next >= m_sources.size())
+         return true;
+
+      if (!WriteFrame(worker.ToWorker, FrameSource, m_sources[m_next])) {
+         // Died while idle, the source is not at fault.
+         reap(worker);
+         if (!spawn(worker) ||
+             !WriteFrame(worker.ToWorker, FrameSource, m_sources[m_next]))
+            return false;
+      }
+      worker.Source = m_next++;
+      return true;
+   }
+
+   bool receive(Worker& worker) {
+      char        kind;
+      std::string data;
+      if (!ReadFrame(worker.FromWorker, kind, data)) {
+         auto status = reap(worker);
+         ++NumFailed;
+         m_failures.push_back(
+            {m_sources[worker.Source], DescribeStatus(status)});
+         return spawn(worker) && assign(worker);
+      }
+
+      if (kind != FrameDone) {
+         worker.Pending.emplace_back(kind, std::move(data));
+         return true;
+      }
+
+      auto& source = m_sources[worker.Source];
+      for (auto& message : worker.Pending)
+         m_onMessage(source, message.first, message.second);
+      worker.Pending.clear();
+      worker.Source = -1;
+      return assign(worker);
+   }
+
+   int reap(Worker& worker) {
+      ::close(worker.ToWorker);
+      ::close(worker.FromWorker);
+
+      int status = 0;
+      while (::waitpid(worker.Pid, &status, 0) < 0 && errno == EINTR) {
+      }
+      worker.Pid = -1;
+      return status;
+   }
+
+   bool stop(bool result) {
+      for (auto& worker : m_workers) {
+         if (worker.Pid > 0)
+            reap(worker);
+      }
+      return result;
+   }
+
+   const std::vector<std::string>&   m_sources;
+   const WorkerPool::Job&            m_job;
+   const WorkerPool::Handler&        m_onMessage;
+   std::vector<WorkerPool::Failure>& m_failures;
+   std::vector<Worker>               m_workers;
+   std::size_t                       m_next;
+};
+
+}  // namespace
+
+bool WorkerPool::isSupported() {
+   return true;
+}
+
+bool WorkerPool::run(const std::vector<std::string>& Sources, const Job& Job,
+                     const Handler& OnMessage) {
+   // A worker dying while its input is written must not kill the supervisor.
+   auto previous = ::signal(SIGPIPE, SIG_IGN);
+
+   Supervisor supervisor(Sources, Job, OnMessage, m_failures);
+   bool       result = supervisor.run(std::max(m_workers, 1u));
+
+   ::signal(SIGPIPE, previous);
+   return result && m_failures.empty();
+}
+
+#else
+
+bool WorkerPool::isSupported() {
+   return false;
+}
+
+bool WorkerPool::run(const std::vector<std::string>& Sources, const Job& Job,
+                     const Handler& OnMessage) {
+   std::cerr << "Worker processes are not supported on this platform.\n";
+   return false;
+}
+
+#endif
+
+void WorkerPool::printFailures(std::ostream& ostr) const {
+   if (m_failures.empty())
+      return;
+
+   ostr << m_failures.size() << " source(s) lost with their worker:\n";
+   for (auto& failure : m_failures)
+      ostr << "   " << failure.Source << ": " << failure.Reason << "\n";
+}
+
+
+namespace {
+
+// Messages of WorkerOutputs, the ones of the tools use lowercase kinds.
+const char MessageJsonLines  = 'J';
+const char MessageCensus     = 'C';
+const char MessageIncludes   = 'I';
+const char MessageStatistics = 'S';
+
+}  // namespace
+
+void WorkerOutputs::beginSource() {
+   // Drop what a worker inherits from the supervisor when it is forked.
+   if (JsonLines)
+      JsonLines->capture(&m_jsonLines);
+   if (Counter)
+      Counter->take();
+   if (Includes)
+      Includes->clear();
+   TakeThreadStatistics();
+}
+
+void WorkerOutputs::send(const WorkerPool::Sender& Send) {
+   if (JsonLines && !m_jsonLines.empty()) {
+      Send(MessageJsonLines, m_jsonLines);
+      m_jsonLines.clear();
+   }
+   if (Counter) {
+      auto data = Counter->take();
+      if (!data.empty())
+         Send(MessageCensus, data);
+   }
+   if (Includes) {
+      std::string        data;
+      raw_string_ostream out(data);
+      Includes->write(out);
+      Send(MessageIncludes, out.str());
+   }
+   if (AreStatisticsEnabled())
+      Send(MessageStatistics, TakeThreadStatistics());
+}
+
+bool WorkerOutputs::merge(char Kind, StringRef Data) {
+   switch (Kind) {
+      case MessageJsonLines:
+         if (JsonLines)
+            JsonLines->write(Data);
+         return true;
+      case MessageCensus:
+         if (Counter)
+            Counter->merge(Data);
+         return true;
+      case MessageIncludes:
+         if (Includes)
+            Includes->merge(Data);
+         return true;
+      case MessageStatistics:
+         MergeThreadStatistics(Data);
+         return true;
+   }
+   return false;
+}
+
+}  // namespace tidy
@@ -0,0 +1,112 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace tidy {
+
+class Census;
+class IncludeMap;
+class JsonLinesWriter;
+
+/// Pre-forked worker processes, each processing many sources, so that a
+/// crash on one source only loses that source.
+///
+/// The supervisor hands one source at a time to each worker. The worker
+/// streams back tagged messages over a pipe, which the supervisor delivers
+/// once the source is complete. When a worker dies, its source is recorded
+/// as failed, its messages are dropped and a new worker replaces it.
+///
+/// Only available on POSIX systems, see isSupported().
+class WorkerPool {
+public:
+   using Sender = std::function<void(char Kind, llvm::StringRef Data)>;
+
+   /// Process \p Source in a worker, sending its results with \p Send.
+   using Job = std::function<void(const std::string& Source,
+                                  const Sender&      Send)>;
+
+   /// Called in the supervisor with each message of a completed source.
+   using Handler = std::function<void(const std::string& Source, char Kind,
+                                      llvm::StringRef Data)>;
+
+   struct Failure {
+      std::string Source;
+      std::string Reason;
+   };
+
+   explicit WorkerPool(unsigned Workers)
+      : m_workers(Workers)
+      , m_failures() {}
+
+   static bool isSupported();
+
+   /// Process every source of \p Sources with \p Job. Return false if a
+   /// source failed or the workers cannot be started.
+   bool run(const std::vector<std::string>& Sources, const Job& Job,
+            const Handler& OnMessage);
+
+   const std::vector<Failure>& failures() const {
+      return m_failures;
+   }
+
+   void printFailures(std::ostream& ostr) const;
+
+private:
+   unsigned             m_workers;
+   std::vector<Failure> m_failures;
+};
+
+/// Run-wide outputs shared by the translation units, which workers fill
+/// for each source and send to the supervisor to be merged.
+struct WorkerOutputs {
+   JsonLinesWriter* JsonLines = nullptr;
+   Census*          Counter   = nullptr;
+   IncludeMap*      Includes  = nullptr;
+
+   /// In a worker, before processing a source.
+   void beginSource();
+
+   /// In a worker, send what the source added to the outputs.
+   void send(const WorkerPool::Sender& Send);
+
+   /// In the supervisor, merge a message sent by send(). Return false if
+   /// \p Kind is not one of its messages.
+   bool merge(char Kind, llvm::StringRef Data);
+
+private:
+   std::string m_jsonLines;
+};
+
+}  // namespace tidy
+
+#endif
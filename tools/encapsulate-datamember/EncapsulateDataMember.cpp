@@ -47,33 +47,39 @@ using namespace clang::tooling;
 
 namespace tidy {
 
+// Accesses through a dependent object only become member expressions in the
+// template instantiations, so they are traversed.
 EncapsulateDataMember::EncapsulateDataMember(
    TransformContext* ctx, const EncapsulateDataMemberOptions* Options)
-   : Transform("encapsulate-datamember", ctx)
+   : Transform("encapsulate-datamember", ctx, TraversalKind::AsIs)
    , Options(Options) {}
 
 
 void EncapsulateDataMember::registerMatchers(MatchFinder* Finder) {
    for (const auto& Name : Options->Names) {
-      Finder->addMatcher(fieldDecl(hasName(Name)).bind("decl"),
-                         this);  // add getter & setter
+      addMatcher(Finder,
+                 fieldDecl(hasName(Name)).bind("decl"));  // add getter & setter
 
-      Finder->addMatcher(
+      if (Options->DeclarationsOnly)
+         continue;
+
+      addMatcher(
+         Finder,
          binaryOperator(hasOperatorName("="),
                         hasLHS(memberExpr(member(hasName(Name))).bind("lhs")))
-            .bind("binop"),
-         this);  // f.x = 42; => f.setX(42);
+            .bind("binop"));  // f.x = 42; => f.setX(42);
 
-      Finder->addMatcher(
+      addMatcher(
+         Finder,
          unaryOperator(hasUnaryOperand(memberExpr(member(hasName(Name)),
                                                   hasObjectExpression(
                                                      expr().bind("varaccess")))
                                           .bind("unary")),
                        anyOf(hasOperatorName("++"), hasOperatorName("--")))
-            .bind("unaryop"),
-         this);  // ++f.x; => f.setX(f.getX() + 1);
+            .bind("unaryop"));  // ++f.x; => f.setX(f.getX() + 1);
 
-      Finder->addMatcher(
+      addMatcher(
+         Finder,
          memberExpr(
             member(hasName(Name)),
             unless(
@@ -83,8 +89,7 @@ void EncapsulateDataMember::registerMatchers(MatchFinder* Finder) {
                      hasParent(unaryOperator(
                         hasUnaryOperand(memberExpr(member(hasName(Name)))),
                         anyOf(hasOperatorName("++"), hasOperatorName("--")))))))
-            .bind("getter"),
-         this);  // f.x => f.getX();
+            .bind("getter"));  // f.x => f.getX();
    }
 }
 
@@ -167,6 +172,11 @@ void EncapsulateDataMember::check(const MatchFinder::MatchResult& Result) {
    }
 }
 
+bool EncapsulateDataMember::needsFunctionBodies() const {
+   // Accesses to the data member only live in function bodies.
+   return !Options->DeclarationsOnly;
+}
+
 
 static std::string CamelGetterName(const NamedDecl* decl) {
    std::string getter = "get" + decl->getNameAsString();
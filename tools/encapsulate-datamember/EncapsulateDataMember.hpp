@@ -39,6 +39,7 @@ enum class CaseLevel { camel, snake };
 struct EncapsulateDataMemberOptions {
    llvm::SmallVector<std::string, 4> Names;
    CaseLevel                         Case;
+   bool                              DeclarationsOnly = false;
 };
 
 class EncapsulateDataMember : public Transform {
@@ -48,6 +49,7 @@ public:
 
    virtual void registerMatchers(MatchFinder* Finder) override;
    virtual void check(const MatchFinder::MatchResult& Result) override;
+   virtual bool needsFunctionBodies() const override;
 
 private:
    std::string getterName(const clang::NamedDecl* decl) const;
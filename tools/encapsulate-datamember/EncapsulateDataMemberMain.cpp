@@ -24,12 +24,21 @@
 
 #include "EncapsulateDataMember.hpp"
 
+#include <AstCache.hpp>
+#include <FileCache.hpp>
+#include <IncludeMap.hpp>
+#include <JsonLines.hpp>
+#include <OptionsParser.hpp>
+#include <Statistics.hpp>
 #include <Transform.hpp>
+#include <TransformAction.hpp>
 
-#include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Refactoring.h"
 
+#include <chrono>
+#include <iostream>
+
 using namespace clang;
 using namespace clang::tooling;
 using namespace llvm;
@@ -61,6 +70,25 @@ static cl::opt<CaseLevel> Case(
    cl::cat(Category));
 
 
+static cl::opt<TraversalKind> Traversal(
+   "traversal", cl::desc("Traversal of template instantiations:"),
+   cl::values(clEnumValN(TraversalKind::AsIs, "as-is",
+                         "match the template instantiations too (default)."),
+              clEnumValN(TraversalKind::SpelledInSource, "spelled-in-source",
+                         "only match the code spelled in the source.")
+#if defined(CLANG_38)
+                 ,
+              clEnumValEnd
+#endif
+              ),
+   cl::init(TraversalKind::AsIs), cl::cat(Category));
+
+static cl::opt<bool> DeclarationsOnly(
+   "declarations-only",
+   cl::desc("Only encapsulate the data member declarations, leave accesses "
+            "untouched. Function bodies are not parsed."),
+   cl::cat(Category));
+
 static cl::opt<bool> Quiet("quiet", cl::desc("Discard clang warnings."),
                            cl::cat(Category));
 
@@ -70,10 +98,34 @@ static cl::opt<bool> StdOut("stdout",
 static cl::opt<bool> Export("export", cl::desc("Export fixes to patches"),
                             cl::cat(Category));
 
+static cl::opt<bool> ReportTime("report-time",
+                                cl::desc("Report time spent on the run."),
+                                cl::cat(Category));
+
+static cl::opt<bool> CacheFiles(
+   "cache-files",
+   cl::desc("Read each file once per run and share it between translation "
+            "units (default on)."),
+   cl::init(true), cl::cat(Category));
+
 static cl::opt<std::string> OutputDir("outputdir",
                                       cl::desc("<path> output dir."),
                                       cl::cat(Category));
 
+static cl::opt<bool> Stats("stats",
+                           cl::desc("Print the run statistics on exit."),
+                           cl::cat(Category));
+
+static cl::opt<std::string> StatsJson(
+   "stats-json", cl::desc("Write the run statistics as JSON to <path>."),
+   cl::value_desc("path"), cl::cat(Category));
+
+static cl::opt<std::string> JsonLines(
+   "jsonl",
+   cl::desc("Stream diagnostics and fixes as JSON lines to <path> ('-' for "
+            "stdout)."),
+   cl::value_desc("path"), cl::cat(Category));
+
 static std::string GetOutputDir() {
    if (OutputDir.empty())
       return "";
@@ -89,31 +141,102 @@ static std::string GetOutputDir() {
 
 
 int main(int argc, const char** argv) {
-   CommonOptionsParser op(argc, argv, Category);
-   RefactoringTool     Tool(op.getCompilations(), op.getSourcePathList());
+   OptionsParser op(argc, argv, Category);
+
+   if (Stats || !StatsJson.empty())
+      EnableStatistics();
+
+   auto fileCache  = std::make_shared<SharedFileCache>();
+   auto fileSystem = CacheFiles ? createCachingFileSystem(fileCache)
+                                : vfs::getRealFileSystem();
+
+   ClangTool Tool(op.getCompilations(), op.getSourcePathList(),
+                  std::make_shared<PCHContainerOperations>(), fileSystem);
 
 
    auto diagConsumer = llvm::make_unique<IgnoringDiagConsumer>();
    if (Quiet)
       Tool.setDiagnosticConsumer(diagConsumer.get());
 
+   TransformActionFactory::CallbacksList callbacks;
+
+   std::unique_ptr<JsonLinesWriter>    jsonLines;
+   std::unique_ptr<JsonLinesCollector> collector;
+   if (!JsonLines.empty()) {
+      std::error_code EC;
+      jsonLines = llvm::make_unique<JsonLinesWriter>(JsonLines, EC);
+      if (EC) {
+         std::cerr << "Error opening file: " << EC.message() << "\n";
+         return 1;
+      }
+      collector = llvm::make_unique<JsonLinesCollector>(*jsonLines, Quiet);
+      Tool.setDiagnosticConsumer(collector.get());
+      callbacks.push_back(collector.get());
+   }
+
+   IncludeMap                          includeMap;
+   std::unique_ptr<IncludeMapRecorder> includeRecorder;
+   if (!op.getIncludeMapPath().empty()) {
+      std::string error;
+      includeMap.load(op.getIncludeMapPath(), error);
+      includeRecorder = llvm::make_unique<IncludeMapRecorder>(includeMap);
+      callbacks.push_back(includeRecorder.get());
+   }
+
    EncapsulateDataMemberOptions opts;
-   opts.Names = {Names.begin(), Names.end()};
-   opts.Case  = Case;
+   opts.Names            = {Names.begin(), Names.end()};
+   opts.Case             = Case;
+   opts.DeclarationsOnly = DeclarationsOnly;
 
    TransformContext      ctx;
    EncapsulateDataMember action(&ctx, &opts);
+   action.setTraversalKind(Traversal);
+   if (collector)
+      ctx.setRecords(&collector->records());
+
+   llvm::StringMap<llvm::TimeRecord>          matchTimes;
+   Transform::MatchFinder::MatchFinderOptions finderOptions;
+   if (ReportTime)
+      finderOptions.CheckProfiling.emplace(matchTimes);
 
-   Transform::MatchFinder Finder;
+   Transform::MatchFinder Finder(std::move(finderOptions));
 
    action.registerMatchers(&Finder);
 
-   int res = Tool.run(newFrontendActionFactory(&Finder).get());
+   bool                   skipFunctionBodies = !action.needsFunctionBodies();
+   TransformActionFactory Factory(&Finder, skipFunctionBodies, {&action},
+                                  callbacks);
+   AstCacheActionFactory  CachedFactory(&Factory, op.getAstCache());
+   if (includeRecorder)
+      CachedFactory.setIncludeMap(&includeMap);
+
+   auto start   = std::chrono::steady_clock::now();
+   int  res     = Tool.run(&CachedFactory);
+   auto elapsed = std::chrono::steady_clock::now() - start;
+
+   if (includeRecorder) {
+      std::string error;
+      if (!includeMap.save(op.getIncludeMapPath(), error))
+         std::cerr << error << "\n";
+   }
+
+   if (ReportTime) {
+      ReportElapsedTime(std::cerr, op.getSourcePathList().size(), elapsed,
+                        skipFunctionBodies);
+      ReportMatchTime(std::cerr, matchTimes, {&action});
+      if (CacheFiles)
+         fileCache->printStats(std::cerr);
+   }
 
    if (StdOut)
       ctx.PrintReplacements(std::cout, Tool);
    if (Export)
       ctx.ExportReplacements(GetOutputDir());
 
+   if (Stats)
+      PrintStatistics(std::cerr);
+   if (!StatsJson.empty())
+      WriteStatisticsJson(StatsJson);
+
    return res;
 }
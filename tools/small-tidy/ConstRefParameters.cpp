@@ -0,0 +1,292 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "ReadOnlyUses.hpp"
+#include "Transform.hpp"
+
+#include <vector>
+
+#include "clang/AST/AST.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+
+#include "llvm/ADT/DenseSet.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace tidy {
+
+static Statistic NumParameters("const-ref-parameters", "parameters",
+                               "Parameters passed by const reference");
+static Statistic NumRejectedWritten("const-ref-parameters", "rejected-written",
+                                    "Parameters modified or moved from");
+static Statistic NumRejectedSignature(
+   "const-ref-parameters", "rejected-signature",
+   "Virtual, lambda, clashing or address-taken functions");
+static Statistic NumReportedVisible(
+   "const-ref-parameters", "reported-visible",
+   "Parameters only reported, their function being declared elsewhere");
+
+/// Functions of a translation unit used other than by a direct call, e.g.
+/// through a pointer: their signature cannot change.
+class AddressTakenFinder : public RecursiveASTVisitor<AddressTakenFinder> {
+public:
+   AddressTakenFinder()
+      : m_callees()
+      , m_taken() {}
+
+   bool shouldVisitTemplateInstantiations() const {
+      return true;
+   }
+
+   bool shouldVisitImplicitCode() const {
+      return true;
+   }
+
+   // Callees are visited before their call, they are then known.
+   bool VisitCallExpr(CallExpr* call) {
+      if (auto callee = call->getCallee())
+         m_callees.insert(callee->IgnoreParenImpCasts());
+      return true;
+   }
+
+   bool VisitDeclRefExpr(DeclRefExpr* ref) {
+      if (auto fct = dyn_cast<FunctionDecl>(ref->getDecl())) {
+         if (!m_callees.count(ref))
+            m_taken.insert(fct->getCanonicalDecl());
+      }
+      return true;
+   }
+
+   // Names of overloads in templates, resolved at instantiation.
+   bool VisitOverloadExpr(OverloadExpr* ref) {
+      if (m_callees.count(ref))
+         return true;
+      for (auto decl : ref->decls()) {
+         if (auto fct = decl->getUnderlyingDecl()->getAsFunction())
+            m_taken.insert(fct->getCanonicalDecl());
+      }
+      return true;
+   }
+
+   llvm::DenseSet<const FunctionDecl*>& getTaken() {
+      return m_taken;
+   }
+
+private:
+   llvm::DenseSet<const Expr*>         m_callees;
+   llvm::DenseSet<const FunctionDecl*> m_taken;
+};
+
+// Return true when \p Param is neither modified nor moved from in \p Fct,
+// constructor initializers included.
+static bool IsReadOnly(const ParmVarDecl* Param, const FunctionDecl* Fct,
+                       ASTContext& Context) {
+   if (!HasOnlyReads(Param, *Fct->getBody(), Context))
+      return false;
+
+   if (auto ctor = dyn_cast<CXXConstructorDecl>(Fct)) {
+      for (auto init : ctor->inits()) {
+         if (init->getInit() &&
+             !HasOnlyReads(Param, *init->getInit(), Context))
+            return false;
+      }
+   }
+   return true;
+}
+
+// Return true when \p A and \p B only differ by the references and the
+// qualifiers of their parameters.
+static bool SameParameters(const FunctionDecl* A, const FunctionDecl* B,
+                           const ASTContext& Context) {
+   if (A->getNumParams() != B->getNumParams())
+      return false;
+   for (unsigned i = 0, n = A->getNumParams(); i < n; ++i) {
+      if (!Context.hasSameUnqualifiedType(
+             A->getParamDecl(i)->getType().getNonReferenceType(),
+             B->getParamDecl(i)->getType().getNonReferenceType()))
+         return false;
+   }
+   return true;
+}
+
+
+class ConstRefParameters : public Transform {
+public:
+   ConstRefParameters(llvm::StringRef CheckName, TransformContext* ctx)
+      : Transform(CheckName, ctx)
+      , m_addressTaken()
+      , m_addressTakenFound(false) {}
+
+   virtual void registerMatchers(MatchFinder* Finder) {
+      addMatcher(Finder,
+                 functionDecl(isDefinition(), isExpansionInMainFileLocked())
+                    .bind("fct"));
+   }
+
+   virtual bool isThreadSafe() const {
+      return true;
+   }
+
+   virtual void check(const MatchFinder::MatchResult& Result) {
+      auto  fct     = Result.Nodes.getNodeAs<FunctionDecl>("fct");
+      auto& context = *Result.Context;
+      if (!fct->getBody() || fct->isDefaulted() || fct->isMain() ||
+          fct->isDependentContext() ||
+          fct->getTemplatedKind() != FunctionDecl::TK_NonTemplate)
+         return;
+
+      std::vector<const ParmVarDecl*> candidates;
+      for (auto param : fct->parameters()) {
+         if (IsExpensiveToCopy(param->getType(), context))
+            candidates.push_back(param);
+      }
+      if (candidates.empty())
+         return;
+
+      if (!hasFreeSignature(fct, context)) {
+         ++NumRejectedSignature;
+         return;
+      }
+
+      bool local = HasLocalSignature(fct, *Result.SourceManager);
+      for (auto param : candidates) {
+         if (!IsReadOnly(param, fct, context)) {
+            ++NumRejectedWritten;
+            continue;
+         }
+
+         // The declarations of the other translation units are not seen,
+         // rewriting ours would break their calls or the link.
+         if (!local) {
+            ++NumReportedVisible;
+            diag(Result, param->getLocation(),
+                 "Consider passing the parameter by const reference, in "
+                 "every declaration of the function.");
+            continue;
+         }
+
+         std::vector<FixItHint> hints;
+         if (!rewriteRedeclarations(fct, param->getFunctionScopeIndex(),
+                                    *Result.SourceManager,
+                                    context.getLangOpts(), hints))
+            continue;
+
+         auto Diag = diag(Result, param->getLocation(),
+                          "Consider passing the parameter by const reference.");
+         if (Diag.dropsHints())
+            continue;
+
+         ++NumParameters;
+         for (auto& hint : hints)
+            Diag << hint;
+      }
+   }
+
+   // The declarations the set points to die with the translation unit.
+   virtual void endSourceFile() {
+      m_addressTaken.clear();
+      m_addressTakenFound = false;
+   }
+
+private:
+   // Return true when every declaration of \p fct belongs to this
+   // translation unit: it is not externally visible, or it is a method of a
+   // class defined in the main file.
+   static bool HasLocalSignature(const FunctionDecl*  fct,
+                                 const SourceManager& SM) {
+      if (!fct->isExternallyVisible())
+         return true;
+
+      auto method = dyn_cast<CXXMethodDecl>(fct);
+      if (!method)
+         return false;
+      auto record = method->getParent()->getDefinition();
+      return record &&
+             SM.isInMainFile(SM.getExpansionLoc(record->getLocation()));
+   }
+
+   // Return true when the signature of \p fct is only used by its direct
+   // calls, so that its parameters can change.
+   bool hasFreeSignature(const FunctionDecl* fct, ASTContext& context) {
+      if (auto method = dyn_cast<CXXMethodDecl>(fct)) {
+         if (method->isVirtual() || method->getParent()->isLambda())
+            return false;
+      }
+
+      // Another overload could clash with the new signature.
+      auto ctx = fct->getDeclContext()->getRedeclContext();
+      for (auto decl : ctx->lookup(fct->getDeclName())) {
+         auto other = dyn_cast<FunctionDecl>(decl);
+         if (other && other->getCanonicalDecl() != fct->getCanonicalDecl() &&
+             SameParameters(fct, other, context))
+            return false;
+      }
+
+      if (!m_addressTakenFound) {
+         AddressTakenFinder finder;
+         finder.TraverseDecl(context.getTranslationUnitDecl());
+         m_addressTaken      = std::move(finder.getTaken());
+         m_addressTakenFound = true;
+      }
+      return !m_addressTaken.count(fct->getCanonicalDecl());
+   }
+
+   // Hints turning the parameter \p index of every declaration of \p fct into
+   // a const reference. Return false when one cannot be rewritten.
+   static bool rewriteRedeclarations(const FunctionDecl*     fct,
+                                     unsigned                index,
+                                     const SourceManager&    SM,
+                                     const LangOptions&      LO,
+                                     std::vector<FixItHint>& hints) {
+      for (auto decl = fct->getMostRecentDecl(); decl;
+           decl      = decl->getPreviousDecl()) {
+         if (!ConstReferenceHints(decl->getParamDecl(index), SM, LO, hints))
+            return false;
+      }
+      return true;
+   }
+
+private:
+   llvm::DenseSet<const FunctionDecl*> m_addressTaken;
+   bool                                m_addressTakenFound;
+};
+
+struct ConstRefParametersFactory : public TransformFactory {
+   virtual ~ConstRefParametersFactory() {}
+   virtual std::unique_ptr<Transform> create(llvm::StringRef   CheckName,
+                                             TransformContext* context) const {
+      return llvm::make_unique<ConstRefParameters>(CheckName, context);
+   }
+};
+
+static TransformFactoryRegistry::Add<ConstRefParametersFactory>
+   X_ConstRefParameters("const-ref-parameters",
+                        "Pass by const reference the parameters expensive to "
+                        "copy which are only read.");
+
+}  // namespace tidy
@@ -0,0 +1,126 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "ReadOnlyUses.hpp"
+#include "Transform.hpp"
+
+#include <vector>
+
+#include "clang/AST/AST.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace tidy {
+
+static Statistic NumLoops("const-ref-range-for", "loops",
+                          "Loop variables taken by const reference");
+static Statistic NumRejectedWritten("const-ref-range-for", "rejected-written",
+                                    "Loop variables modified or moved from");
+static Statistic NumRejectedConversion(
+   "const-ref-range-for", "rejected-conversion",
+   "Loop variables converted from their element, or from a temporary");
+
+// Return true when \p Var is initialized by copying the element its loop
+// designates: a reference would bind to the element itself, not to a
+// temporary.
+static bool IsElementCopy(const VarDecl* Var) {
+   auto init = Var->getInit();
+   if (!init)
+      return false;
+
+   auto construct = dyn_cast<CXXConstructExpr>(init->IgnoreImplicit());
+   return construct && construct->getNumArgs() == 1 &&
+          construct->getConstructor()->isCopyConstructor() &&
+          construct->getArg(0)->isGLValue();
+}
+
+
+class ConstRefRangeFor : public Transform {
+public:
+   ConstRefRangeFor(llvm::StringRef CheckName, TransformContext* ctx)
+      : Transform(CheckName, ctx) {}
+
+   virtual void registerMatchers(MatchFinder* Finder) {
+      addMatcher(Finder,
+                 cxxForRangeStmt(isExpansionInMainFileLocked()).bind("loop"));
+   }
+
+   virtual bool isThreadSafe() const {
+      return true;
+   }
+
+   virtual void check(const MatchFinder::MatchResult& Result) {
+      auto  loop    = Result.Nodes.getNodeAs<CXXForRangeStmt>("loop");
+      auto  var     = loop->getLoopVariable();
+      auto& context = *Result.Context;
+
+      // Structured bindings are not plain variables.
+      if (var->getKind() != Decl::Var || var->getType()->isReferenceType() ||
+          !IsExpensiveToCopy(var->getType(), context))
+         return;
+
+      if (!IsElementCopy(var)) {
+         ++NumRejectedConversion;
+         return;
+      }
+      if (!HasOnlyReads(var, *loop->getBody(), context)) {
+         ++NumRejectedWritten;
+         return;
+      }
+
+      std::vector<FixItHint> hints;
+      if (!ConstReferenceHints(var, *Result.SourceManager,
+                               context.getLangOpts(), hints))
+         return;
+
+      auto Diag = diag(Result, var->getLocation(),
+                       "Consider iterating by const reference.");
+      if (Diag.dropsHints())
+         return;
+
+      ++NumLoops;
+      for (auto& hint : hints)
+         Diag << hint;
+   }
+};
+
+struct ConstRefRangeForFactory : public TransformFactory {
+   virtual ~ConstRefRangeForFactory() {}
+   virtual std::unique_ptr<Transform> create(llvm::StringRef   CheckName,
+                                             TransformContext* context) const {
+      return llvm::make_unique<ConstRefRangeFor>(CheckName, context);
+   }
+};
+
+static TransformFactoryRegistry::Add<ConstRefRangeForFactory>
+   X_ConstRefRangeFor("const-ref-range-for",
+                      "Iterate by const reference in the range-based for "
+                      "loops copying elements expensive to copy which are "
+                      "only read.");
+
+}  // namespace tidy
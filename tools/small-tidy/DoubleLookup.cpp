@@ -0,0 +1,623 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "ReadOnlyUses.hpp"
+#include "Transform.hpp"
+
+#include <string>
+#include <vector>
+
+#include "clang/AST/AST.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Lex/Lexer.h"
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/FoldingSet.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace tidy {
+
+static Statistic NumLookups("double-lookup", "lookups",
+                            "Lookups merged with the find of their test");
+static Statistic NumInsertions("double-lookup", "insertions",
+                               "Tests dropped before an insertion");
+static Statistic NumRejectedMutation(
+   "double-lookup", "rejected-mutation",
+   "Containers or keys which may change between the lookups");
+
+
+template <typename T>
+static llvm::StringRef CodeFragment(const T& Node, const SourceManager& SM,
+                                    const LangOptions& LangOpts) {
+   return Lexer::getSourceText(
+      CharSourceRange::getTokenRange(Node.getLocStart(), Node.getLocEnd()), SM,
+      LangOpts);
+}
+
+static const Expr* Strip(const Expr* E) {
+   while (true) {
+      auto stripped = E->IgnoreImplicit()->IgnoreParens();
+      if (stripped == E)
+         return E;
+      E = stripped;
+   }
+}
+
+// The key as written, without the conversion to the key type, e.g. the
+// std::string built from a literal.
+static const Expr* StripKey(const Expr* E) {
+   E = Strip(E);
+   while (auto construct = dyn_cast<CXXConstructExpr>(E)) {
+      if (construct->getNumArgs() != 1 || isa<CXXTemporaryObjectExpr>(E))
+         break;
+      E = Strip(construct->getArg(0));
+   }
+   return E;
+}
+
+static bool SameExpr(const Expr* A, const Expr* B, const ASTContext& Context) {
+   llvm::FoldingSetNodeID idA, idB;
+   A->Profile(idA, Context, true);
+   B->Profile(idB, Context, true);
+   return idA == idB;
+}
+
+// \p E as a call to the member \p Name of a standard associative container,
+// with \p Args arguments.
+static const CXXMemberCallExpr* ContainerCall(const Expr* E,
+                                              llvm::StringRef Name,
+                                              unsigned        Args) {
+   auto call = dyn_cast<CXXMemberCallExpr>(Strip(E));
+   if (!call || call->getNumArgs() != Args)
+      return nullptr;
+
+   auto method = call->getMethodDecl();
+   auto callee = dyn_cast<MemberExpr>(call->getCallee()->IgnoreParens());
+   if (!method || !callee || callee->isArrow() ||
+       method->getName() != Name)
+      return nullptr;
+
+   auto record = method->getParent();
+   if (!record->isInStdNamespace())
+      return nullptr;
+   auto name = record->getName();
+   return name == "map" || name == "unordered_map" || name == "set" ||
+                name == "unordered_set"
+             ? call
+             : nullptr;
+}
+
+static bool IsMap(const CXXMemberCallExpr* Call) {
+   auto name = Call->getMethodDecl()->getParent()->getName();
+   return name == "map" || name == "unordered_map";
+}
+
+static bool IsZero(const Expr* E, const ASTContext& Context) {
+   llvm::APSInt value;
+   return E->EvaluateAsInt(value, Context) && value == 0;
+}
+
+/// Membership test of a key in a container, e.g. m.find(k) != m.end().
+struct LookupTest {
+   const CXXMemberCallExpr* Call  = nullptr;  ///< find or count
+   bool                     Found = true;     ///< true when the key is in
+};
+
+static bool ParseTest(const Expr* Cond, LookupTest& Test,
+                      const ASTContext& Context) {
+   Cond = Strip(Cond);
+   if (auto op = dyn_cast<UnaryOperator>(Cond)) {
+      if (op->getOpcode() != UO_LNot || !ParseTest(op->getSubExpr(), Test,
+                                                   Context))
+         return false;
+      Test.Found = !Test.Found;
+      return true;
+   }
+
+   if (auto count = ContainerCall(Cond, "count", 1)) {
+      Test.Call  = count;
+      Test.Found = true;
+      return true;
+   }
+
+   // m.count(k) != 0, m.count(k) > 0 or m.count(k) == 0.
+   if (auto op = dyn_cast<BinaryOperator>(Cond)) {
+      auto count = ContainerCall(op->getLHS(), "count", 1);
+      if (!count || !IsZero(op->getRHS(), Context))
+         return false;
+      if (op->getOpcode() != BO_NE && op->getOpcode() != BO_GT &&
+          op->getOpcode() != BO_EQ)
+         return false;
+      Test.Call  = count;
+      Test.Found = op->getOpcode() != BO_EQ;
+      return true;
+   }
+
+   // m.find(k) != m.end(), either way round.
+   auto op = dyn_cast<CXXOperatorCallExpr>(Cond);
+   if (!op || op->getNumArgs() != 2 ||
+       (op->getOperator() != OO_ExclaimEqual &&
+        op->getOperator() != OO_EqualEqual))
+      return false;
+
+   auto find = ContainerCall(StripKey(op->getArg(0)), "find", 1);
+   auto end  = ContainerCall(StripKey(op->getArg(1)), "end", 0);
+   if (!find) {
+      find = ContainerCall(StripKey(op->getArg(1)), "find", 1);
+      end  = ContainerCall(StripKey(op->getArg(0)), "end", 0);
+   }
+   if (!find || !end ||
+       !SameExpr(Strip(find->getImplicitObjectArgument()),
+                 Strip(end->getImplicitObjectArgument()), Context))
+      return false;
+
+   Test.Call  = find;
+   Test.Found = op->getOperator() == OO_ExclaimEqual;
+   return true;
+}
+
+// Local variable or member of this holding the container \p E, whose
+// changes can be seen; null otherwise.
+static const ValueDecl* ContainerDecl(const Expr* E) {
+   E = Strip(E);
+   if (auto ref = dyn_cast<DeclRefExpr>(E)) {
+      auto var = dyn_cast<VarDecl>(ref->getDecl());
+      if (var && var->hasLocalStorage() && !var->getType()->isReferenceType())
+         return var;
+      return nullptr;
+   }
+   if (auto member = dyn_cast<MemberExpr>(E)) {
+      if (isa<CXXThisExpr>(Strip(member->getBase())))
+         return dyn_cast<FieldDecl>(member->getMemberDecl());
+   }
+   return nullptr;
+}
+
+// Return true when \p Decl is only read in \p Scope, but for the \p Exempt
+// uses.
+static bool OnlyReadIn(const ValueDecl* Decl, const Stmt& Scope,
+                       ASTContext&                        Context,
+                       const llvm::DenseSet<const Expr*>& Exempt) {
+   auto uses = match(
+      findAll(expr(anyOf(declRefExpr(to(equalsNode(Decl))),
+                         memberExpr(member(equalsNode(Decl)),
+                                    hasObjectExpression(ignoringParenImpCasts(
+                                       cxxThisExpr())))))
+                 .bind("use")),
+      Scope, Context);
+   for (auto& use : uses) {
+      auto expr = use.getNodeAs<Expr>("use");
+      if (!Exempt.count(expr) && !IsOnlyRead(expr, Context))
+         return false;
+   }
+   return true;
+}
+
+// Return true when a member function of this may write its members in
+// \p Scope.
+static bool MayWriteMembers(const Stmt& Scope, ASTContext& Context) {
+   auto calls = match(
+      findAll(cxxMemberCallExpr(on(ignoringParenImpCasts(cxxThisExpr())))
+                 .bind("call")),
+      Scope, Context);
+   for (auto& call : calls) {
+      auto method = call.getNodeAs<CXXMemberCallExpr>("call")->getMethodDecl();
+      if (!method || !method->isConst())
+         return true;
+   }
+
+   // This passed to a function.
+   auto thisUses = match(findAll(cxxThisExpr().bind("this")), Scope, Context);
+   for (auto& use : thisUses) {
+      auto parents = Context.getParents(*use.getNodeAs<CXXThisExpr>("this"));
+      if (parents.size() != 1 || !parents[0].get<MemberExpr>())
+         return true;
+   }
+   return false;
+}
+
+static std::string Indentation(SourceLocation Loc, const SourceManager& SM) {
+   bool        invalid = false;
+   const char* text    = SM.getCharacterData(Loc, &invalid);
+   auto        column  = SM.getSpellingColumnNumber(Loc, &invalid);
+   if (invalid || column == 0)
+      return "";
+
+   std::string indent(text - (column - 1), column - 1);
+   for (auto& c : indent) {
+      if (c != '\t')
+         c = ' ';
+   }
+   return indent;
+}
+
+
+class DoubleLookup : public Transform {
+public:
+   DoubleLookup(llvm::StringRef CheckName, TransformContext* ctx)
+      : Transform(CheckName, ctx) {}
+
+   virtual void registerMatchers(MatchFinder* Finder) {
+      addMatcher(Finder,
+                 ifStmt(isExpansionInMainFileLocked(), hasThen(stmt()))
+                    .bind("if"));
+   }
+
+   virtual bool isThreadSafe() const {
+      return true;
+   }
+
+   virtual void check(const MatchFinder::MatchResult& Result) {
+      auto lookupIf = Result.Nodes.getNodeAs<IfStmt>("if");
+      if (lookupIf->getIfLoc().isMacroID() || lookupIf->getConditionVariable())
+         return;
+#if !defined(CLANG_38)
+      if (lookupIf->getInit())
+         return;
+#endif
+
+      LookupTest test;
+      if (!ParseTest(lookupIf->getCond(), test, *Result.Context))
+         return;
+      auto key = StripKey(test.Call->getArg(0));
+      if (key->HasSideEffects(*Result.Context) ||
+          Strip(test.Call->getImplicitObjectArgument())
+             ->HasSideEffects(*Result.Context))
+         return;
+
+      if (test.Found)
+         mergeLookups(lookupIf, test, Result);
+      else
+         dropTest(lookupIf, test, Result);
+   }
+
+private:
+   /// Lookups of the tested key in the tested container, e.g. m[k].
+   void findLookups(const Stmt* S, const LookupTest& test,
+                    const ASTContext&         context,
+                    std::vector<const Expr*>& lookups) {
+      if (!S || isa<LambdaExpr>(S))
+         return;
+
+      const Expr* object = nullptr;
+      const Expr* key    = nullptr;
+      if (auto op = dyn_cast<CXXOperatorCallExpr>(S)) {
+         if (op->getOperator() == OO_Subscript && op->getNumArgs() == 2) {
+            object = op->getArg(0);
+            key    = op->getArg(1);
+         }
+      }
+      else if (isa<CXXMemberCallExpr>(S)) {
+         if (auto at = ContainerCall(cast<Expr>(S), "at", 1)) {
+            object = at->getImplicitObjectArgument();
+            key    = at->getArg(0);
+         }
+      }
+
+      if (object &&
+          SameExpr(Strip(object),
+                   Strip(test.Call->getImplicitObjectArgument()), context) &&
+          SameExpr(StripKey(key), StripKey(test.Call->getArg(0)), context)) {
+         lookups.push_back(cast<Expr>(S));
+         return;
+      }
+
+      for (auto child : S->children())
+         findLookups(child, test, context, lookups);
+   }
+
+   // Return true when neither the container nor the key may change in
+   // \p scope, but through the \p lookups.
+   bool isStable(const Stmt& scope, const LookupTest& test,
+                 const std::vector<const Expr*>& lookups,
+                 ASTContext&                     context) {
+      auto container = ContainerDecl(test.Call->getImplicitObjectArgument());
+      if (!container)
+         return false;
+
+      llvm::DenseSet<const Expr*> exempt;
+      for (auto lookup : lookups) {
+         if (auto op = dyn_cast<CXXOperatorCallExpr>(lookup))
+            exempt.insert(Strip(op->getArg(0)));
+         else if (auto at = dyn_cast<CXXMemberCallExpr>(lookup))
+            exempt.insert(Strip(at->getImplicitObjectArgument()));
+      }
+      if (!OnlyReadIn(container, scope, context, exempt))
+         return false;
+
+      bool members = isa<FieldDecl>(container);
+      auto names   = match(
+         findAll(expr(anyOf(declRefExpr(), memberExpr())).bind("name")),
+         *StripKey(test.Call->getArg(0)), context);
+      for (auto& name : names) {
+         const ValueDecl* decl = nullptr;
+         if (auto ref = name.getNodeAs<DeclRefExpr>("name"))
+            decl = ref->getDecl();
+         else
+            decl = name.getNodeAs<MemberExpr>("name")->getMemberDecl();
+         members |= isa<FieldDecl>(decl);
+         if (isa<VarDecl>(decl) || isa<FieldDecl>(decl)) {
+            if (!OnlyReadIn(decl, scope, context, {}))
+               return false;
+         }
+      }
+      return !members || !MayWriteMembers(scope, context);
+   }
+
+   /// if (m.find(k) != m.end()) v = m[k];
+   /// becomes
+   /// auto found = m.find(k);
+   /// if (found != m.end()) v = found->second;
+   void mergeLookups(const IfStmt* lookupIf, const LookupTest& test,
+                     const MatchFinder::MatchResult& Result) {
+      auto& context = *Result.Context;
+      auto& SM      = *Result.SourceManager;
+      auto& LO      = context.getLangOpts();
+      if (!IsMap(test.Call))
+         return;
+
+      // The iterator is declared before the if, in its block.
+      auto parents = context.getParents(*lookupIf);
+      auto block   = parents.size() == 1 ? parents[0].get<CompoundStmt>()
+                                         : nullptr;
+      if (!block)
+         return;
+
+      std::vector<const Expr*> lookups;
+      findLookups(lookupIf->getThen(), test, context, lookups);
+      if (lookups.empty())
+         return;
+      if (!isStable(*lookupIf->getThen(), test, lookups, context)) {
+         ++NumRejectedMutation;
+         return;
+      }
+
+      std::string name = freeName(*block, context);
+      if (name.empty())
+         return;
+
+      for (auto lookup : lookups) {
+         if (lookup->getLocStart().isMacroID() ||
+             lookup->getLocEnd().isMacroID())
+            return;
+      }
+
+      auto Diag = diag(Result, lookupIf->getIfLoc(),
+                       "Consider reusing the iterator of the lookup.");
+      if (Diag.dropsHints())
+         return;
+
+      ++NumLookups;
+      auto containerText =
+         CodeFragment(*test.Call->getImplicitObjectArgument(), SM, LO);
+      auto keyText = CodeFragment(*test.Call->getArg(0), SM, LO);
+      Diag << FixItHint::CreateInsertion(
+         lookupIf->getIfLoc(),
+         ("auto " + name + " = " + containerText + ".find(" + keyText +
+          ");\n" + Indentation(lookupIf->getIfLoc(), SM))
+            .str());
+      Diag << FixItHint::CreateReplacement(
+         lookupIf->getCond()->getSourceRange(),
+         (name + " != " + containerText + ".end()").str());
+      for (auto lookup : lookups) {
+         Diag << FixItHint::CreateReplacement(lookup->getSourceRange(),
+                                              name + "->second");
+      }
+   }
+
+   /// if (!m.count(k)) m[k] = v;
+   /// becomes
+   /// m.try_emplace(k, v);
+   /// or m.insert(std::make_pair(k, v)); before C++17, and
+   /// if (!m.count(k)) m.emplace(k, v);
+   /// becomes
+   /// m.try_emplace(k, v);
+   /// in C++17 only.
+   void dropTest(const IfStmt* lookupIf, const LookupTest& test,
+                 const MatchFinder::MatchResult& Result) {
+      auto& context = *Result.Context;
+      auto& SM      = *Result.SourceManager;
+      auto& LO      = context.getLangOpts();
+      if (lookupIf->getElse())
+         return;
+
+      auto then  = lookupIf->getThen();
+      auto block = dyn_cast<CompoundStmt>(then);
+      if (block) {
+         if (block->size() != 1)
+            return;
+         then = block->body_front();
+      }
+      auto insertion = dyn_cast<Expr>(then);
+      if (!insertion)
+         return;
+
+      auto        containerArg = test.Call->getImplicitObjectArgument();
+      auto        keyArg       = test.Call->getArg(0);
+      std::string text;
+
+      // m[k] = v, v being only evaluated when the key is absent: the rewrite
+      // evaluates it whatever the test, it must have no side effects.
+      const Expr* index = nullptr;
+      const Expr* value = nullptr;
+      if (auto op = dyn_cast<CXXOperatorCallExpr>(Strip(insertion))) {
+         if (op->getOperator() == OO_Equal && op->getNumArgs() == 2) {
+            index = op->getArg(0);
+            value = op->getArg(1);
+         }
+      }
+      else if (auto op = dyn_cast<BinaryOperator>(Strip(insertion))) {
+         if (op->getOpcode() == BO_Assign) {
+            index = op->getLHS();
+            value = op->getRHS();
+         }
+      }
+
+      std::vector<const Expr*> lookups;
+      if (index)
+         findLookups(index, test, context, lookups);
+
+      if (!lookups.empty() && lookups[0] == Strip(index) &&
+          isa<CXXOperatorCallExpr>(lookups[0])) {
+         if (StripKey(value)->HasSideEffects(context) ||
+             value->getLocStart().isMacroID() ||
+             value->getLocEnd().isMacroID())
+            return;
+         // Unlike emplace, neither allocates a node when the key is in.
+         auto container = CodeFragment(*containerArg, SM, LO).str();
+         auto entry     = CodeFragment(*keyArg, SM, LO).str() + ", " +
+                      CodeFragment(*value, SM, LO).str();
+         if (LO.CPlusPlus17)
+            text = container + ".try_emplace(" + entry + ");";
+         else
+            text = container + ".insert(std::make_pair(" + entry + "));";
+      }
+      // m.try_emplace(k, ...) and s.insert(k) do nothing when the key is in,
+      // m.emplace(k, v) and s.emplace(k) build a node first: they become
+      // try_emplace, when available, and insert.
+      else if (auto call = insertionCall(insertion, test, context)) {
+         if (call->getLocStart().isMacroID() || call->getLocEnd().isMacroID())
+            return;
+         // The arguments after the key were only evaluated when it is absent.
+         for (unsigned i = 1; i < call->getNumArgs(); ++i) {
+            if (StripKey(call->getArg(i))->HasSideEffects(context))
+               return;
+         }
+
+         auto name = call->getMethodDecl()->getName();
+         if (name == "emplace") {
+            if (!IsMap(test.Call))
+               name = "insert";
+            else if (LO.CPlusPlus17)
+               name = "try_emplace";
+            else
+               return;
+         }
+
+         text = (CodeFragment(*call->getImplicitObjectArgument(), SM, LO) +
+                 "." + name + "(")
+                   .str();
+         for (unsigned i = 0; i < call->getNumArgs(); ++i) {
+            if (i > 0)
+               text += ", ";
+            text += CodeFragment(*call->getArg(i), SM, LO).str();
+         }
+         text += ");";
+      }
+      else {
+         return;
+      }
+
+      auto range = ifRange(lookupIf, SM, LO);
+      if (range.isInvalid())
+         return;
+
+      auto Diag = diag(Result, lookupIf->getIfLoc(),
+                       "Consider inserting without testing the key first.");
+      if (Diag.dropsHints())
+         return;
+
+      ++NumInsertions;
+      Diag << FixItHint::CreateReplacement(range, text);
+   }
+
+   // \p E as an insertion of the tested key in the tested container, e.g.
+   // m.emplace(k, v); null otherwise.
+   static const CXXMemberCallExpr* insertionCall(const Expr*       E,
+                                                 const LookupTest& test,
+                                                 const ASTContext& context) {
+      auto call = dyn_cast<CXXMemberCallExpr>(Strip(E));
+      if (!call || call->getNumArgs() == 0 || !call->getMethodDecl())
+         return nullptr;
+
+      auto name = call->getMethodDecl()->getName();
+      bool map  = IsMap(test.Call);
+      if (!(map && (name == "emplace" || name == "try_emplace")) &&
+          !(!map && (name == "insert" || name == "emplace") &&
+            call->getNumArgs() == 1))
+         return nullptr;
+
+      bool same = ContainerCall(call, name, call->getNumArgs()) &&
+                  SameExpr(Strip(call->getImplicitObjectArgument()),
+                           Strip(test.Call->getImplicitObjectArgument()),
+                           context) &&
+                  SameExpr(StripKey(call->getArg(0)),
+                           StripKey(test.Call->getArg(0)), context);
+      return same ? call : nullptr;
+   }
+
+   // From the if keyword to the end of its then branch, semicolon included.
+   static CharSourceRange ifRange(const IfStmt*        lookupIf,
+                                  const SourceManager& SM,
+                                  const LangOptions&   LO) {
+      if (auto block = dyn_cast<CompoundStmt>(lookupIf->getThen())) {
+         if (block->getRBracLoc().isMacroID())
+            return CharSourceRange();
+         return CharSourceRange::getTokenRange(lookupIf->getIfLoc(),
+                                               block->getRBracLoc());
+      }
+
+      auto end = Lexer::findLocationAfterToken(
+         lookupIf->getThen()->getLocEnd(), tok::semi, SM, LO, false);
+      if (end.isInvalid())
+         return CharSourceRange();
+      return CharSourceRange::getCharRange(lookupIf->getIfLoc(), end);
+   }
+
+   // Name for the iterator, unused in \p block.
+   static std::string freeName(const CompoundStmt& block,
+                               ASTContext&         context) {
+      for (unsigned i = 1; i < 10; ++i) {
+         std::string name = i == 1 ? "found" : "found" + std::to_string(i);
+         auto        uses = match(
+            findAll(stmt(anyOf(
+               declStmt(has(varDecl(hasName(name)))),
+               declRefExpr(to(namedDecl(hasName(name)))),
+               memberExpr(member(hasName(name)))))),
+            block, context);
+         if (uses.empty())
+            return name;
+      }
+      return "";
+   }
+};
+
+struct DoubleLookupFactory : public TransformFactory {
+   virtual ~DoubleLookupFactory() {}
+   virtual std::unique_ptr<Transform> create(llvm::StringRef   CheckName,
+                                             TransformContext* context) const {
+      return llvm::make_unique<DoubleLookup>(CheckName, context);
+   }
+};
+
+static TransformFactoryRegistry::Add<DoubleLookupFactory> X_DoubleLookup(
+   "double-lookup",
+   "Look up a key once in the std::map, std::unordered_map, std::set and "
+   "std::unordered_set tested for it first.");
+
+}  // namespace tidy
@@ -36,6 +36,8 @@
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Tooling/Refactoring.h"
 
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/raw_os_ostream.h"
@@ -48,74 +50,253 @@ using namespace clang::tooling;
 using namespace tidy;
 
 
+static Statistic NumReturnWalks(
+   "early-return", "return-walks",
+   "Functions walked to find their return statements");
 
+/// Walk a function once, bottom-up, to find its return statements and the
+/// statements holding one.
 class ReturnStatementFinderASTVisitor
    : public clang::RecursiveASTVisitor<ReturnStatementFinderASTVisitor> {
+   using Base = clang::RecursiveASTVisitor<ReturnStatementFinderASTVisitor>;
+
 public:
-   ReturnStatementFinderASTVisitor() {}
+   ReturnStatementFinderASTVisitor()
+      : Returns()
+      , Returning()
+      , SawReturn(false)
+      , Hidden(0) {}
+
+   // Walk the same nodes as hasDescendant() does.
+   bool shouldVisitImplicitCode() const {
+      return true;
+   }
+
+   bool shouldVisitTemplateInstantiations() const {
+      return true;
+   }
 
-   /// Find the components of an expression and place them in a ComponentVector.
    void findReturns(const clang::FunctionDecl* Fct) {
       TraverseDecl(const_cast<clang::FunctionDecl*>(Fct));
    }
 
-   /// Accessor for Components.
+   /// Return statements written in the function, in source order.
    const std::vector<const ReturnStmt*>& getReturns() {
       return Returns;
    }
 
-   friend class clang::RecursiveASTVisitor<ReturnStatementFinderASTVisitor>;
+   /// Statements holding a return statement, implicit code included.
+   llvm::DenseSet<const Stmt*>& getReturning() {
+      return Returning;
+   }
+
+   bool TraverseDecl(Decl* D) {
+      bool hidden = D && D->isImplicit();
+      Hidden += hidden;
+      bool result = Base::TraverseDecl(D);
+      Hidden -= hidden;
+      return result;
+   }
+
+   bool TraverseStmt(Stmt* S) {
+      if (!S)
+         return true;
+
+      auto ret = dyn_cast<ReturnStmt>(S);
+      if (ret && !Hidden)
+         Returns.push_back(ret);
+
+      bool outer  = SawReturn;
+      SawReturn   = ret != nullptr;
+      bool result = Base::TraverseStmt(S);
+      if (SawReturn)
+         Returning.insert(S);
+      SawReturn |= outer;
+      return result;
+   }
 
 private:
    std::vector<const ReturnStmt*> Returns;
+   llvm::DenseSet<const Stmt*>    Returning;
+   bool                           SawReturn;
+   unsigned                       Hidden;  ///< depth in implicit declarations
+};
 
-   bool VisitReturnStmt(clang::ReturnStmt* Return) {
-      Returns.push_back(Return);
-      return true;
+/// Return statements of a function, as needed to write an early return.
+struct ReturnInfo {
+   const ReturnStmt* LastReturn = nullptr;  ///< last one found, if any
+   QualType          ReturnType;
+
+   /// Statements holding a return, e.g. then branches which cannot be
+   /// inverted.
+   llvm::DenseSet<const Stmt*> Returning;
+};
+
+/// Return statements of the function being checked, found on first use:
+/// most functions have no candidate if and are never walked.
+class FunctionReturns {
+public:
+   explicit FunctionReturns(const FunctionDecl* Fct)
+      : m_fct(Fct) {}
+
+   const ReturnInfo& get() {
+      if (m_info)
+         return *m_info;
+
+      ++NumReturnWalks;
+      ReturnStatementFinderASTVisitor returnFinder;
+      returnFinder.findReturns(m_fct);
+      auto& returns = returnFinder.getReturns();
+
+      ReturnInfo info;
+      info.ReturnType = m_fct->getReturnType();
+      if (!returns.empty())
+         info.LastReturn = returns.back();
+      info.Returning = std::move(returnFinder.getReturning());
+      m_info = std::move(info);
+      return *m_info;
    }
+
+private:
+   const FunctionDecl*        m_fct;
+   llvm::Optional<ReturnInfo> m_info;
 };
 
 static bool isTransformableLoc(const SourceLocation& Loc) {
    return !Loc.isInvalid() && !Loc.isMacroID();
 }
 
+// Same as isInTemplateInstantiation() on the statements of \p Fct, without
+// the parent map.
+static bool IsInInstantiation(const FunctionDecl* Fct) {
+   for (const DeclContext* DC = Fct; DC; DC = DC->getLexicalParent()) {
+      auto kind = TSK_Undeclared;
+      if (auto fct = dyn_cast<FunctionDecl>(DC))
+         kind = fct->getTemplateSpecializationKind();
+      else if (auto record = dyn_cast<CXXRecordDecl>(DC))
+         kind = record->getTemplateSpecializationKind();
+
+      if (kind == TSK_ImplicitInstantiation ||
+          kind == TSK_ExplicitInstantiationDefinition)
+         return true;
+   }
+   return false;
+}
+
 
 class EarlyReturn : public Transform {
 public:
    EarlyReturn(llvm::StringRef CheckName, TransformContext* ctx)
       : Transform(CheckName, ctx) {}
 
+   // Candidates are found from their function, walked once, rather than by
+   // matching each if with hasParent() and hasDescendant(): there is neither
+   // a subtree walk per if nor a parent map to build.
    virtual void registerMatchers(MatchFinder* Finder) {
-      Finder->addMatcher(
-         ifStmt(allOf(unless(hasElse(anything())),
-                      hasParent(compoundStmt(
-                                   hasParent(functionDecl().bind("early-fct")))
-                                   .bind("enclosing-if")),
-                      hasThen(allOf(compoundStmt().bind("compound-if"),
-                                    unless(hasDescendant(returnStmt()))))))
-            .bind("early-if"),
-         this);
+      Finder->addMatcher(functionDecl(isDefinition()).bind("early-fct"),
+                         callback());
+   }
+
+   virtual bool isThreadSafe() const {
+      return true;
    }
 
    virtual void check(const MatchFinder::MatchResult& Result) {
-      auto scopeIf = Result.Nodes.getNodeAs<CompoundStmt>("compound-if");
-      if (scopeIf->size() < 4)
+      auto earlyFct = Result.Nodes.getNodeAs<FunctionDecl>("early-fct");
+      auto body     = dyn_cast_or_null<CompoundStmt>(earlyFct->getBody());
+      if (!body || body->body_empty())
          return;
-
-      auto earlyIf     = Result.Nodes.getNodeAs<IfStmt>("early-if");
-      auto enclosingIf = Result.Nodes.getNodeAs<CompoundStmt>("enclosing-if");
-      auto pos =
-         std::find(enclosingIf->body_begin(), enclosingIf->body_end(), earlyIf);
-      if (std::distance(pos, enclosingIf->body_end()) > 2)
+      if (traversalKind() == TraversalKind::SpelledInSource &&
+          IsInInstantiation(earlyFct))
          return;
 
-      auto earlyFct = Result.Nodes.getNodeAs<FunctionDecl>("early-fct");
-      auto condLoc  = earlyIf->getCond()->getExprLoc();
+      FunctionReturns returns(earlyFct);
+      invertCascade(returns, body, 0, Exit::Return, Result);
+      invertLoops(returns, body, Result);
+   }
+
+private:
+   /// Statement written in place of an inverted then branch.
+   enum class Exit { Return, Continue };
+
+   /// Invert the candidate ifs of \p block, followed by \p trailing
+   /// statements once the enclosing ifs are inverted, then the candidates of
+   /// their then branches, which are flattened into \p block. A whole cascade
+   /// is planned at once, rather than one level per run.
+   void invertCascade(FunctionReturns& returns, const CompoundStmt* block,
+                      unsigned trailing, Exit exit,
+                      const MatchFinder::MatchResult& Result) {
+      // A continue skips what follows the if, a return repeats the last
+      // return of the function, which may follow it.
+      unsigned maxTrailing = exit == Exit::Return ? 1 : 0;
+
+      unsigned after = block->size() + trailing;
+      for (auto stmt : block->body()) {
+         if (--after > maxTrailing)
+            continue;
+
+         auto earlyIf = dyn_cast<IfStmt>(stmt);
+         if (!earlyIf || earlyIf->getElse() || earlyIf->getConditionVariable())
+            continue;
+#if !defined(CLANG_38)
+         if (earlyIf->getInit())
+            continue;
+#endif
+
+         auto scopeIf = dyn_cast<CompoundStmt>(earlyIf->getThen());
+         if (!scopeIf || scopeIf->size() < 4)
+            continue;
+         if (exit == Exit::Return && returns.get().Returning.count(scopeIf))
+            continue;
+
+         if (invert(returns, earlyIf, scopeIf, exit, Result))
+            invertCascade(returns, scopeIf, after, exit, Result);
+      }
+   }
+
+   /// Invert the ifs ending the loop bodies of \p S with a continue. Lambdas
+   /// are left to their own function.
+   void invertLoops(FunctionReturns& returns, const Stmt* S,
+                    const MatchFinder::MatchResult& Result) {
+      const Stmt* loopBody = nullptr;
+      if (auto loop = dyn_cast<ForStmt>(S))
+         loopBody = loop->getBody();
+      else if (auto loop = dyn_cast<CXXForRangeStmt>(S))
+         loopBody = loop->getBody();
+      else if (auto loop = dyn_cast<WhileStmt>(S))
+         loopBody = loop->getBody();
+      else if (auto loop = dyn_cast<DoStmt>(S))
+         loopBody = loop->getBody();
+
+      if (auto block = dyn_cast_or_null<CompoundStmt>(loopBody))
+         invertCascade(returns, block, 0, Exit::Continue, Result);
+
+      for (auto child : S->children()) {
+         if (child && !isa<LambdaExpr>(child))
+            invertLoops(returns, child, Result);
+      }
+   }
+
+   /// Return false when \p earlyIf cannot be rewritten, true when it is or
+   /// would be in a census.
+   bool invert(FunctionReturns&                returns,
+               const IfStmt*                   earlyIf,
+               const CompoundStmt*             scopeIf,
+               Exit                            exit,
+               const MatchFinder::MatchResult& Result) {
+      auto condLoc = earlyIf->getCond()->getExprLoc();
 
       if (!isTransformableLoc(earlyIf->getIfLoc()) ||
           !isTransformableLoc(scopeIf->getRBracLoc()) ||
           !isTransformableLoc(condLoc))
-         return;
+         return false;
+
+      auto Diag = diag(Result, earlyIf->getIfLoc(),
+                       exit == Exit::Return
+                          ? "Could be transform to early return if."
+                          : "Could be transform to early continue if.");
+      if (Diag.dropsHints())
+         return true;
 
       std::stringstream condTextBuffer;
       condTextBuffer << "!("
@@ -127,28 +308,27 @@ public:
                      << ")";
 
       auto condText   = condTextBuffer.str();
-      auto returnText = computeBestMatchReturn(earlyFct, Result);
+      auto returnText = exit == Exit::Return
+                           ? computeBestMatchReturn(returns.get(), Result)
+                           : std::string("continue;");
 
-      auto Diag = diag(Result, earlyIf->getIfLoc(),
-                       "Could be transform to early return if.");
       Diag << FixItHint::CreateRemoval(scopeIf->getRBracLoc())
            << FixItHint::CreateReplacement(earlyIf->getCond()->getSourceRange(),
                                            condText)
            << FixItHint::CreateReplacement(scopeIf->getLBracLoc(),
                                            returnText + "\n");
+      return true;
    }
 
-   std::string computeBestMatchReturn(
-      const FunctionDecl* fct, const MatchFinder::MatchResult& Result) const {
-      ReturnStatementFinderASTVisitor returnFinder;
-      returnFinder.findReturns(fct);
-      auto& returns = returnFinder.getReturns();
-      if (returns.empty())
+   std::string computeBestMatchReturn(const ReturnInfo&               returns,
+                                      const MatchFinder::MatchResult& Result) {
+      // A void function always returns with no value, even when its last
+      // return is e.g. "return f();" whose call must not be repeated.
+      if (!returns.LastReturn || returns.ReturnType->isVoidType())
          return "return;";
 
-      auto        lastReturn = returns[returns.size() - 1];
-      std::string text       = clang::Lexer::getSourceText(
-         CharSourceRange::getTokenRange(lastReturn->getSourceRange()),
+      std::string text = clang::Lexer::getSourceText(
+         CharSourceRange::getTokenRange(returns.LastReturn->getSourceRange()),
          *Result.SourceManager, Result.Context->getLangOpts());
       return text + ";";
    }
@@ -0,0 +1,239 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "AstCache.hpp"
+#include "SmallTidyOptions.hpp"
+#include "Transform.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "clang/AST/AST.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/Lexer.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace tidy {
+
+static llvm::cl::list<std::string> KeepFlushes(
+   "endl-keep", llvm::cl::CommaSeparated,
+   llvm::cl::desc("endl-to-newline: streams whose std::endl are kept, e.g. "
+                  "\"m_log,journal\"."),
+   llvm::cl::value_desc("names"), llvm::cl::cat(SmallTidyCategory));
+
+static Statistic NumKeptExit("endl-to-newline", "kept-exit",
+                             "Console flushes kept before the process exits");
+static Statistic NumKeptConfigured("endl-to-newline", "kept-configured",
+                                   "Flushes kept on the -endl-keep streams");
+
+
+// Stream written by \p E, a chain of << on it.
+static const Expr* StreamOf(const Expr* E) {
+   E = E->IgnoreParenImpCasts();
+   while (auto op = dyn_cast<CXXOperatorCallExpr>(E)) {
+      if (op->getOperator() != OO_LessLess || op->getNumArgs() != 2)
+         break;
+      E = op->getArg(0)->IgnoreParenImpCasts();
+   }
+   return E;
+}
+
+// Variable or member naming the stream \p E, if any.
+static const ValueDecl* StreamDecl(const Expr* E) {
+   if (auto ref = dyn_cast<DeclRefExpr>(E))
+      return ref->getDecl();
+   if (auto member = dyn_cast<MemberExpr>(E))
+      return member->getMemberDecl();
+   return nullptr;
+}
+
+static bool IsConsole(const ValueDecl* Decl) {
+   return Decl && Decl->isInStdNamespace() &&
+          (Decl->getName() == "cout" || Decl->getName() == "cerr" ||
+           Decl->getName() == "clog");
+}
+
+// File and string streams, and the std::ostream they are written through.
+static bool IsBufferedStream(QualType Type) {
+   auto record = Type.getNonReferenceType()->getAsCXXRecordDecl();
+   if (!record || !record->isInStdNamespace())
+      return false;
+
+   auto name = record->getName();
+   return name == "basic_ofstream" || name == "basic_fstream" ||
+          name == "basic_ostringstream" || name == "basic_stringstream" ||
+          (name == "basic_ostream" && Type->isReferenceType());
+}
+
+// Return true when the process ends just after \p S: the next statement of
+// its block exits, or \p S ends main.
+static bool EndsProcess(const Stmt* S, ASTContext& Context) {
+   while (true) {
+      auto parents = Context.getParents(*S);
+      if (parents.size() != 1)
+         return false;
+      if (auto block = parents[0].get<CompoundStmt>()) {
+         auto next = std::find(block->body_begin(), block->body_end(), S);
+         if (next != block->body_end())
+            ++next;
+
+         auto fctParents = Context.getParents(*block);
+         auto fct        = fctParents.size() == 1
+                              ? fctParents[0].get<FunctionDecl>()
+                              : nullptr;
+         bool inMain = fct && fct->isMain();
+         if (next == block->body_end())
+            return inMain;
+         if (isa<ReturnStmt>(*next))
+            return inMain;
+
+         auto expr   = dyn_cast<Expr>(*next);
+         auto call   = expr ? dyn_cast<CallExpr>(expr->IgnoreImplicit())
+                            : nullptr;
+         auto callee = call ? call->getDirectCallee() : nullptr;
+         if (!callee || !callee->getIdentifier())
+            return false;
+         auto name = callee->getName();
+         return name == "exit" || name == "_Exit" || name == "quick_exit" ||
+                name == "abort" || name == "terminate";
+      }
+      S = parents[0].get<Expr>();
+      if (!S)
+         return false;
+   }
+}
+
+
+class EndlToNewline : public Transform {
+public:
+   EndlToNewline(llvm::StringRef CheckName, TransformContext* ctx)
+      : Transform(CheckName, ctx)
+      , m_file()
+      , m_dropped(0) {}
+
+   virtual void registerMatchers(MatchFinder* Finder) {
+      addMatcher(
+         Finder,
+         cxxOperatorCallExpr(
+            hasOverloadedOperatorName("<<"), argumentCountIs(2),
+            hasArgument(1, ignoringParenImpCasts(
+                              declRefExpr(to(functionDecl(
+                                             hasName("::std::endl"))))
+                                 .bind("endl"))),
+            isExpansionInMainFileLocked())
+            .bind("write"));
+   }
+
+   virtual bool isThreadSafe() const {
+      return true;
+   }
+
+   virtual void check(const MatchFinder::MatchResult& Result) {
+      auto write   = Result.Nodes.getNodeAs<CXXOperatorCallExpr>("write");
+      auto endl    = Result.Nodes.getNodeAs<DeclRefExpr>("endl");
+      auto stream  = StreamOf(write->getArg(0));
+      auto decl    = StreamDecl(stream);
+      bool console = IsConsole(decl);
+      if (!console && !IsBufferedStream(stream->getType()) &&
+          !(decl && IsBufferedStream(decl->getType())))
+         return;
+
+      if (decl && std::find(KeepFlushes.begin(), KeepFlushes.end(),
+                            decl->getName()) != KeepFlushes.end()) {
+         ++NumKeptConfigured;
+         return;
+      }
+      if (console && EndsProcess(write, *Result.Context)) {
+         ++NumKeptExit;
+         return;
+      }
+
+      auto newline = newlineFor(endl);
+      if (newline.empty() || endl->getLocStart().isMacroID() ||
+          endl->getLocEnd().isMacroID())
+         return;
+
+      auto Diag = diag(Result, endl->getLocStart(),
+                       "Consider writing a new line without flushing.");
+      if (Diag.dropsHints())
+         return;
+
+      // A flush is only dropped once its fix is accepted.
+      Diag << FixItHint::CreateReplacement(endl->getSourceRange(), newline);
+      m_dropped += Diag.accepted();
+   }
+
+   virtual void beginSourceFile(CompilerInstance& CI) {
+      m_file    = GetMainSourceName(CI);
+      m_dropped = 0;
+   }
+
+   virtual void endSourceFile() {
+      if (m_dropped)
+         std::cerr << m_file << ": " << m_dropped << " flushes dropped\n";
+   }
+
+private:
+   // New line of the character type of the std::endl instance \p endl.
+   static std::string newlineFor(const DeclRefExpr* endl) {
+      auto fct  = dyn_cast<FunctionDecl>(endl->getDecl());
+      auto args = fct ? fct->getTemplateSpecializationArgs() : nullptr;
+      if (!args || args->size() == 0 ||
+          args->get(0).getKind() != TemplateArgument::Type)
+         return "";
+
+      auto type = args->get(0).getAsType();
+      if (type->isSpecificBuiltinType(BuiltinType::Char_S) ||
+          type->isSpecificBuiltinType(BuiltinType::Char_U))
+         return "'\\n'";
+      if (type->isWideCharType())
+         return "L'\\n'";
+      return "";
+   }
+
+private:
+   std::string m_file;
+   unsigned    m_dropped;
+};
+
+struct EndlToNewlineFactory : public TransformFactory {
+   virtual ~EndlToNewlineFactory() {}
+   virtual std::unique_ptr<Transform> create(llvm::StringRef   CheckName,
+                                             TransformContext* context) const {
+      return llvm::make_unique<EndlToNewline>(CheckName, context);
+   }
+};
+
+static TransformFactoryRegistry::Add<EndlToNewlineFactory> X_EndlToNewline(
+   "endl-to-newline",
+   "Replace std::endl with '\\n' on file and string streams, and on the "
+   "console unless the process exits just after.");
+
+}  // namespace tidy
@@ -59,9 +59,8 @@ public:
       : Transform(CheckName, ctx) {}
 
    virtual void registerMatchers(MatchFinder* Finder) {
-      Finder->addMatcher(evaluator_ref(), this);
-      Finder->addMatcher(functionDecl(hasName("legacy_function")).bind("fct"),
-                         this);
+      addMatcher(Finder, evaluator_ref());
+      addMatcher(Finder, functionDecl(hasName("legacy_function")).bind("fct"));
    }
 
    virtual void check(const MatchFinder::MatchResult& Result) {
@@ -73,6 +72,10 @@ public:
       //
       // ref->dumpColor();
    }
+
+   virtual bool isThreadSafe() const {
+      return true;
+   }
 };
 
 struct InitAtDeclareFactory : public TransformFactory {
@@ -0,0 +1,396 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "MemoryOperands.hpp"
+#include "Transform.hpp"
+
+#include <string>
+
+#include "clang/AST/AST.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Lex/Lexer.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace tidy {
+
+static Statistic NumCopies("loop-to-memcpy", "copies", "Copy loops rewritten");
+static Statistic NumFills("loop-to-memcpy", "fills", "Fill loops rewritten");
+
+static Statistic NumRejectedShape(
+   "loop-to-memcpy", "rejected-shape",
+   "Loops not written for (i = 0; i < n; ++i) a[i] = b[i] or a[i] = c");
+static Statistic NumRejectedSideEffects(
+   "loop-to-memcpy", "rejected-side-effects",
+   "Loops whose operands have side effects");
+static Statistic NumRejectedAlias(
+   "loop-to-memcpy", "rejected-alias",
+   "Loops whose counter or bound may be written through a pointer");
+static Statistic NumRejectedCounter("loop-to-memcpy", "rejected-counter",
+                                    "Counters used out of their loop");
+static Statistic NumRejectedOverlap("loop-to-memcpy", "rejected-overlap",
+                                    "Copies between arrays which may overlap");
+static Statistic NumRejectedType(
+   "loop-to-memcpy", "rejected-type",
+   "Elements not trivially copyable, or values memset cannot write");
+
+
+template <typename T>
+static llvm::StringRef CodeFragment(const T& Node, const SourceManager& SM,
+                                    const LangOptions& LangOpts) {
+   return Lexer::getSourceText(
+      CharSourceRange::getTokenRange(Node.getLocStart(), Node.getLocEnd()), SM,
+      LangOpts);
+}
+
+// Variable named by \p E, once parentheses and implicit casts are removed.
+static const VarDecl* NamedVariable(const Expr* E) {
+   auto ref = dyn_cast<DeclRefExpr>(E->IgnoreParenImpCasts());
+   return ref ? dyn_cast<VarDecl>(ref->getDecl()) : nullptr;
+}
+
+static bool Mentions(const Stmt* S, const VarDecl* Var) {
+   if (auto ref = dyn_cast<DeclRefExpr>(S)) {
+      if (ref->getDecl() == Var)
+         return true;
+   }
+   for (auto child : S->children()) {
+      if (child && Mentions(child, Var))
+         return true;
+   }
+   return false;
+}
+
+static bool IsZero(const Expr* E, const ASTContext& Context) {
+   if (auto floating = dyn_cast<FloatingLiteral>(E->IgnoreParenImpCasts()))
+      return floating->getValue().isPosZero();
+
+   llvm::APSInt value;
+   return E->IgnoreParenImpCasts()->EvaluateAsInt(value, Context) &&
+          value == 0;
+}
+
+// Return true when \p Var is a local variable which is only read or
+// assigned, so that no pointer can write it. Its uses out of \p Loop are
+// counted in \p usesOutOfLoop.
+static bool IsPrivateVariable(const VarDecl* Var, const ForStmt* Loop,
+                              ASTContext& Context, unsigned& usesOutOfLoop) {
+   auto fct = dyn_cast<FunctionDecl>(Var->getDeclContext());
+   if (!fct || !fct->getBody() || !Var->hasLocalStorage() ||
+       Var->getType()->isReferenceType() ||
+       Var->getType().isVolatileQualified())
+      return false;
+
+   auto uses = match(
+      findAll(declRefExpr(to(varDecl(equalsNode(Var)))).bind("use")),
+      *fct->getBody(), Context);
+   for (auto& use : uses) {
+      auto ref     = use.getNodeAs<DeclRefExpr>("use");
+      auto parents = Context.getParents(*ref);
+      if (parents.empty())
+         return false;
+
+      if (auto cast = parents[0].get<ImplicitCastExpr>()) {
+         if (cast->getCastKind() == CK_LValueToRValue)
+            continue;
+      }
+      else if (auto op = parents[0].get<UnaryOperator>()) {
+         if (op->isIncrementDecrementOp())
+            continue;
+      }
+      else if (auto op = parents[0].get<BinaryOperator>()) {
+         if (op->isAssignmentOp() && op->getLHS()->IgnoreParens() == ref)
+            continue;
+      }
+      return false;
+   }
+
+   auto inLoop = match(
+      findAll(declRefExpr(to(varDecl(equalsNode(Var)))).bind("use")), *Loop,
+      Context);
+   usesOutOfLoop = uses.size() - inLoop.size();
+   return true;
+}
+
+
+class LoopToMemcpy : public Transform {
+public:
+   LoopToMemcpy(llvm::StringRef CheckName, TransformContext* ctx)
+      : Transform(CheckName, ctx) {}
+
+   virtual void registerMatchers(MatchFinder* Finder) {
+      addMatcher(Finder, forStmt(hasCondition(binaryOperator(
+                                    hasOperatorName("<"))),
+                                 isExpansionInMainFileLocked())
+                            .bind("loop"));
+   }
+
+   virtual bool isThreadSafe() const {
+      return true;
+   }
+
+   virtual void check(const MatchFinder::MatchResult& Result) {
+      auto  loop    = Result.Nodes.getNodeAs<ForStmt>("loop");
+      auto& context = *Result.Context;
+
+      // for (i = 0; i < n; ++i)
+      const VarDecl* counter = nullptr;
+      const Expr*    first   = nullptr;
+      if (auto init = dyn_cast_or_null<DeclStmt>(loop->getInit())) {
+         if (init->isSingleDecl()) {
+            counter = dyn_cast<VarDecl>(init->getSingleDecl());
+            first   = counter ? counter->getInit() : nullptr;
+         }
+      }
+      else if (auto init = dyn_cast_or_null<BinaryOperator>(loop->getInit())) {
+         if (init->getOpcode() == BO_Assign) {
+            counter = NamedVariable(init->getLHS());
+            first   = init->getRHS();
+         }
+      }
+
+      auto condition = cast<BinaryOperator>(loop->getCond());
+      auto count     = condition->getRHS()->IgnoreParenImpCasts();
+      if (!counter || !counter->getType()->isIntegerType() || !first ||
+          !IsZero(first, context) ||
+          NamedVariable(condition->getLHS()) != counter ||
+          !isIncrement(loop->getInc(), counter, context)) {
+         ++NumRejectedShape;
+         return;
+      }
+
+      // dst[i] = src[i] or dst[i] = value, alone in the body.
+      const Stmt* body = loop->getBody();
+      if (auto block = dyn_cast<CompoundStmt>(body)) {
+         body = block->size() == 1 ? block->body_front() : nullptr;
+      }
+      auto assign = dyn_cast_or_null<BinaryOperator>(body);
+
+      const ArraySubscriptExpr* dst = nullptr;
+      if (assign && assign->getOpcode() == BO_Assign)
+         dst = dyn_cast<ArraySubscriptExpr>(assign->getLHS()->IgnoreParens());
+      if (!dst || NamedVariable(dst->getIdx()) != counter ||
+          Mentions(dst->getBase(), counter)) {
+         ++NumRejectedShape;
+         return;
+      }
+
+      auto src = dyn_cast<ArraySubscriptExpr>(
+         assign->getRHS()->IgnoreParenImpCasts());
+      auto value = src ? nullptr : assign->getRHS();
+      if (src && (NamedVariable(src->getIdx()) != counter ||
+                  Mentions(src->getBase(), counter))) {
+         ++NumRejectedShape;
+         return;
+      }
+      if (value && Mentions(value, counter)) {
+         ++NumRejectedShape;
+         return;
+      }
+
+      if (count->HasSideEffects(context) ||
+          dst->getBase()->HasSideEffects(context) ||
+          (src && src->getBase()->HasSideEffects(context)) ||
+          (value && value->HasSideEffects(context))) {
+         ++NumRejectedSideEffects;
+         return;
+      }
+
+      llvm::APSInt constantCount;
+      bool         isConstant = count->EvaluateAsInt(constantCount, context);
+
+      // A store through dst must not reach the counter nor the bound.
+      unsigned counterUses = 0;
+      unsigned boundUses   = 0;
+      auto     bound       = NamedVariable(count);
+      if (!IsPrivateVariable(counter, loop, context, counterUses) ||
+          (!isConstant &&
+           (!bound || !IsPrivateVariable(bound, loop, context, boundUses)))) {
+         ++NumRejectedAlias;
+         return;
+      }
+      // The rewrite does not leave the counter at n.
+      if (counterUses > 0) {
+         ++NumRejectedCounter;
+         return;
+      }
+
+      // Any byte but 0 and 1 would make an invalid bool.
+      auto element = dst->getType();
+      if (element.isVolatileQualified() || element->isBooleanType() ||
+          !element.isTriviallyCopyableType(context) ||
+          (src && !context.hasSameUnqualifiedType(src->getType(), element))) {
+         ++NumRejectedType;
+         return;
+      }
+
+      bool isByte = element->isIntegralOrEnumerationType() &&
+                    context.getTypeSize(element) == context.getCharWidth();
+      if (value && !isByte &&
+          !(IsZero(value, context) && element->isArithmeticType())) {
+         ++NumRejectedType;
+         return;
+      }
+
+      if (src && !disjoint(dst->getBase(), src->getBase())) {
+         ++NumRejectedOverlap;
+         return;
+      }
+
+      auto& SM    = *Result.SourceManager;
+      auto& LO    = context.getLangOpts();
+      auto  range = loopRange(loop, SM, LO);
+      if (range.isInvalid()) {
+         ++NumRejectedShape;
+         return;
+      }
+
+      // std::copy is not available in C, memcpy is given the size in bytes.
+      bool        useCopy = !value && !isByte && LO.CPlusPlus;
+      const char* message =
+         value ? "Consider replacing the fill loop with memset."
+               : useCopy ? "Consider replacing the copy loop with std::copy."
+                         : "Consider replacing the copy loop with memcpy.";
+      auto Diag = diag(Result, loop->getForLoc(), message);
+      if (Diag.dropsHints())
+         return;
+
+      auto dstText   = CodeFragment(*dst->getBase(), SM, LO);
+      auto countText = CodeFragment(*count, SM, LO).str();
+      if (!isa<DeclRefExpr>(count) && !isa<IntegerLiteral>(count))
+         countText = "(" + countText + ")";
+
+      std::string              buffer;
+      llvm::raw_string_ostream fragment(buffer);
+
+      // A loop on a negative signed bound does nothing, the calls take an
+      // unsigned size.
+      bool guarded = count->getType()->isSignedIntegerType() &&
+                     !(isConstant && constantCount > 0);
+      if (guarded)
+         fragment << "if (" << countText << " > 0) { ";
+
+      // The element type may have no name, e.g. an anonymous struct.
+      auto size = countText;
+      if (!isByte)
+         size += " * sizeof *" + dstText.str();
+      if (value) {
+         ++NumFills;
+         fragment << "memset(" << dstText << ", "
+                  << (isByte ? CodeFragment(*value, SM, LO) : "0") << ", "
+                  << size << ");";
+      }
+      else if (!useCopy) {
+         ++NumCopies;
+         fragment << "memcpy(" << dstText << ", "
+                  << CodeFragment(*src->getBase(), SM, LO) << ", " << size
+                  << ");";
+      }
+      else {
+         ++NumCopies;
+         auto srcText = CodeFragment(*src->getBase(), SM, LO);
+         fragment << "std::copy(" << srcText << ", " << srcText << " + "
+                  << countText << ", " << dstText << ");";
+      }
+      if (guarded)
+         fragment << " }";
+
+      auto header = useCopy ? "<algorithm>"
+                            : LO.CPlusPlus ? "<cstring>" : "<string.h>";
+      Diag << FixItHint::CreateReplacement(range, fragment.str());
+      if (auto include = includeHint(Result, header))
+         Diag << *include;
+   }
+
+private:
+   static bool isIncrement(const Expr* inc, const VarDecl* counter,
+                           const ASTContext& context) {
+      if (!inc)
+         return false;
+      if (auto op = dyn_cast<UnaryOperator>(inc)) {
+         return op->isIncrementOp() &&
+                NamedVariable(op->getSubExpr()) == counter;
+      }
+
+      auto op = dyn_cast<CompoundAssignOperator>(inc);
+      llvm::APSInt step;
+      return op && op->getOpcode() == BO_AddAssign &&
+             NamedVariable(op->getLHS()) == counter &&
+             op->getRHS()->EvaluateAsInt(step, context) && step == 1;
+   }
+
+   // Arrays of different variables, or restrict pointers.
+   static bool disjoint(const Expr* dst, const Expr* src) {
+      auto dstOwner = OwnerVariable(dst);
+      auto srcOwner = OwnerVariable(src);
+      if (dstOwner && srcOwner)
+         return dstOwner != srcOwner;
+
+      auto dstPointer = NamedVariable(dst);
+      auto srcPointer = NamedVariable(src);
+      return dstPointer && srcPointer && dstPointer != srcPointer &&
+             dstPointer->getType().isRestrictQualified() &&
+             srcPointer->getType().isRestrictQualified();
+   }
+
+   // From the for keyword to the end of its body, semicolon included.
+   static CharSourceRange loopRange(const ForStmt*       loop,
+                                    const SourceManager& SM,
+                                    const LangOptions&   LO) {
+      auto begin = loop->getForLoc();
+      if (begin.isMacroID())
+         return CharSourceRange();
+
+      if (auto block = dyn_cast<CompoundStmt>(loop->getBody())) {
+         if (block->getRBracLoc().isMacroID())
+            return CharSourceRange();
+         return CharSourceRange::getTokenRange(begin, block->getRBracLoc());
+      }
+
+      auto end = Lexer::findLocationAfterToken(
+         loop->getBody()->getLocEnd(), tok::semi, SM, LO, false);
+      if (end.isInvalid())
+         return CharSourceRange();
+      return CharSourceRange::getCharRange(begin, end);
+   }
+};
+
+struct LoopToMemcpyTransformFactory : public TransformFactory {
+   virtual ~LoopToMemcpyTransformFactory() {}
+   virtual std::unique_ptr<Transform> create(llvm::StringRef   CheckName,
+                                             TransformContext* context) const {
+      return llvm::make_unique<LoopToMemcpy>(CheckName, context);
+   }
+};
+
+static TransformFactoryRegistry::Add<LoopToMemcpyTransformFactory>
+   X_LoopToMemcpy("loop-to-memcpy",
+                  "Replace copy and fill loops over arrays with memcpy, memset "
+                  "or std::copy");
+}
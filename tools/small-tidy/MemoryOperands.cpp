@@ -0,0 +1,72 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "MemoryOperands.hpp"
+
+#include "clang/AST/Expr.h"
+
+using namespace clang;
+
+namespace tidy {
+
+const VarDecl* OwnerVariable(const Expr* E) {
+   while (true) {
+      E = E->IgnoreParenImpCasts();
+      if (auto op = dyn_cast<UnaryOperator>(E)) {
+         if (op->getOpcode() != UO_AddrOf)
+            return nullptr;
+         E = op->getSubExpr();
+      }
+      else if (auto subscript = dyn_cast<ArraySubscriptExpr>(E)) {
+         E = subscript->getBase();
+         if (!E->IgnoreParenImpCasts()->getType()->isArrayType())
+            return nullptr;
+      }
+      else if (auto member = dyn_cast<MemberExpr>(E)) {
+         if (member->isArrow())
+            return nullptr;
+         E = member->getBase();
+      }
+      else if (auto binary = dyn_cast<BinaryOperator>(E)) {
+         if (!binary->isAdditiveOp())
+            return nullptr;
+         E = binary->getLHS()->getType()->isPointerType() ? binary->getLHS()
+                                                          : binary->getRHS();
+         if (!E->IgnoreParenImpCasts()->getType()->isArrayType())
+            return nullptr;
+      }
+      else if (auto ref = dyn_cast<DeclRefExpr>(E)) {
+         auto var = dyn_cast<VarDecl>(ref->getDecl());
+         if (!var || var->getType()->isReferenceType() ||
+             var->getType()->isPointerType())
+            return nullptr;
+         return var;
+      }
+      else {
+         return nullptr;
+      }
+   }
+}
+
+}  // namespace tidy
@@ -57,8 +57,12 @@ public:
       : Transform(CheckName, ctx) {}
 
    virtual void registerMatchers(MatchFinder* Finder) {
-      Finder->addMatcher(
-         stringLiteral(containsNonAsciiOrNull()).bind("nonascii"), this);
+      addMatcher(Finder,
+                 stringLiteral(containsNonAsciiOrNull()).bind("nonascii"));
+   }
+
+   virtual bool isThreadSafe() const {
+      return true;
    }
 
    virtual void check(const MatchFinder::MatchResult& Result) {
@@ -67,6 +71,9 @@ public:
                           literal->getLocStart(),
                           "Non ascii char in string literal",
                           DiagnosticIDs::Warning);
+         if (Diag.dropsHints())
+            return;
+
          auto locEnd =
             literal->getLocationOfByte(literal->getByteLength(),
                                        *Result.SourceManager,
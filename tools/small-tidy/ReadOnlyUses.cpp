@@ -0,0 +1,204 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "ReadOnlyUses.hpp"
+#include "SmallTidyOptions.hpp"
+
+#include "clang/AST/AST.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Basic/CharInfo.h"
+#include "clang/Lex/Lexer.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace tidy {
+
+static llvm::cl::opt<unsigned> MinSize(
+   "const-ref-min-size",
+   llvm::cl::desc("const-ref-parameters and const-ref-range-for: take by "
+                  "const reference the trivially copyable records larger "
+                  "than <bytes> (default 16)."),
+   llvm::cl::value_desc("bytes"), llvm::cl::init(16),
+   llvm::cl::cat(SmallTidyCategory));
+
+// Return true when \p Type binds an argument without letting the callee
+// write it: by value or by const lvalue reference.
+static bool BindsAsRead(QualType Type) {
+   if (auto ref = Type->getAs<LValueReferenceType>())
+      return ref->getPointeeType().isConstQualified();
+   return !Type->isReferenceType();
+}
+
+static bool ArgumentIsRead(const FunctionDecl* Callee, unsigned Index) {
+   // Arguments passed to an ellipsis are copied.
+   if (Index >= Callee->getNumParams())
+      return Callee->isVariadic();
+   return BindsAsRead(Callee->getParamDecl(Index)->getType());
+}
+
+// Return true when the object \p E designates is only read by its parent:
+// copied, bound to a const reference or used through const member
+// functions. Clang has no mutation analyzer here, any other use is taken as
+// a write.
+bool IsOnlyRead(const Expr* E, ASTContext& Context) {
+   auto parents = Context.getParents(*E);
+   if (parents.size() != 1)
+      return false;
+
+   if (auto paren = parents[0].get<ParenExpr>())
+      return IsOnlyRead(paren, Context);
+
+   if (auto cast = parents[0].get<ImplicitCastExpr>()) {
+      switch (cast->getCastKind()) {
+      case CK_LValueToRValue:
+         return true;
+      // The implicit move of a returned parameter is a no-op cast to an
+      // xvalue, caught by the move constructor it is bound to.
+      case CK_NoOp:
+      case CK_DerivedToBase:
+      case CK_UncheckedDerivedToBase:
+         return IsOnlyRead(cast, Context);
+      default:
+         return false;
+      }
+   }
+
+   if (auto member = parents[0].get<MemberExpr>()) {
+      if (member->getBase() != E)
+         return false;
+      if (auto method = dyn_cast<CXXMethodDecl>(member->getMemberDecl()))
+         return method->isConst() || method->isStatic();
+      return isa<FieldDecl>(member->getMemberDecl()) &&
+             IsOnlyRead(member, Context);
+   }
+
+   if (auto call = parents[0].get<CallExpr>()) {
+      auto callee = call->getDirectCallee();
+      if (!callee)
+         return false;
+
+      // The object of a member operator is its first argument.
+      unsigned first = 0;
+      if (isa<CXXOperatorCallExpr>(call) && isa<CXXMethodDecl>(callee)) {
+         if (call->getArg(0) == E)
+            return cast<CXXMethodDecl>(callee)->isConst();
+         first = 1;
+      }
+      for (unsigned i = first, n = call->getNumArgs(); i < n; ++i) {
+         if (call->getArg(i) == E)
+            return ArgumentIsRead(callee, i - first);
+      }
+      return false;
+   }
+
+   if (auto construct = parents[0].get<CXXConstructExpr>()) {
+      for (unsigned i = 0, n = construct->getNumArgs(); i < n; ++i) {
+         if (construct->getArg(i) == E)
+            return ArgumentIsRead(construct->getConstructor(), i);
+      }
+      return false;
+   }
+
+   // A reference bound to the variable, e.g. const T& x = p.
+   if (auto var = parents[0].get<VarDecl>())
+      return var->getInit() == E && var->getType()->isReferenceType() &&
+             BindsAsRead(var->getType());
+
+   return false;
+}
+
+// Location after the "const" following \p Loc, as in "T const", or an
+// invalid location.
+static SourceLocation SkipEastConst(SourceLocation Loc,
+                                    const SourceManager& SM) {
+   bool        invalid = false;
+   const char* text    = SM.getCharacterData(Loc, &invalid);
+   if (invalid)
+      return SourceLocation();
+
+   unsigned offset = 0;
+   while (isWhitespace(text[offset]))
+      ++offset;
+   llvm::StringRef rest(text + offset);
+   if (!rest.startswith("const") || isIdentifierBody(rest[5]))
+      return SourceLocation();
+   return Loc.getLocWithOffset(offset + 5);
+}
+
+
+// Larger than two registers: smaller records are passed in registers.
+bool IsExpensiveToCopy(QualType Type, const ASTContext& Context) {
+   if (Type->isDependentType() || Type.isVolatileQualified())
+      return false;
+
+   auto record = Type->getAsCXXRecordDecl();
+   if (!record || !record->hasDefinition())
+      return false;
+
+   return !Type.isTriviallyCopyableType(Context) ||
+          Context.getTypeSizeInChars(Type).getQuantity() > MinSize;
+}
+
+bool HasOnlyReads(const VarDecl* Var, const Stmt& Scope,
+                  ASTContext& Context) {
+   auto uses = match(
+      findAll(declRefExpr(to(varDecl(equalsNode(Var)))).bind("use")), Scope,
+      Context);
+   for (auto& use : uses) {
+      if (!IsOnlyRead(use.getNodeAs<DeclRefExpr>("use"), Context))
+         return false;
+   }
+   return true;
+}
+
+bool ConstReferenceHints(const VarDecl*          Var,
+                         const SourceManager&    SM,
+                         const LangOptions&      LO,
+                         std::vector<FixItHint>& Hints) {
+   auto info = Var->getTypeSourceInfo();
+   if (!info)
+      return false;
+
+   auto begin = info->getTypeLoc().getLocStart();
+   auto end   = info->getTypeLoc().getLocEnd();
+   if (begin.isInvalid() || begin.isMacroID() || end.isMacroID() ||
+       SM.isInSystemHeader(begin))
+      return false;
+
+   auto after = Lexer::getLocForEndOfToken(end, 0, SM, LO);
+   if (after.isInvalid())
+      return false;
+
+   if (!Var->getType().isConstQualified())
+      Hints.push_back(FixItHint::CreateInsertion(begin, "const "));
+   else if (SkipEastConst(after, SM).isValid())
+      after = SkipEastConst(after, SM);
+   Hints.push_back(FixItHint::CreateInsertion(after, "&"));
+   return true;
+}
+
+}  // namespace tidy
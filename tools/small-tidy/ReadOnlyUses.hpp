@@ -0,0 +1,65 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef READ_ONLY_USES_HPP
+#define READ_ONLY_USES_HPP
+
+#include <vector>
+
+namespace clang {
+class ASTContext;
+class Expr;
+class FixItHint;
+class LangOptions;
+class QualType;
+class SourceManager;
+class Stmt;
+class VarDecl;
+}  // namespace clang
+
+namespace tidy {
+
+/// Return true for the records expensive to copy: non-trivial copies, or
+/// larger than -const-ref-min-size bytes.
+bool IsExpensiveToCopy(clang::QualType Type, const clang::ASTContext& Context);
+
+/// Return true when the object \p E designates is only read by its parent.
+bool IsOnlyRead(const clang::Expr* E, clang::ASTContext& Context);
+
+/// Return true when \p Var is neither modified nor moved from in \p Scope:
+/// it is only copied, bound to const references or used through const
+/// member functions.
+bool HasOnlyReads(const clang::VarDecl* Var, const clang::Stmt& Scope,
+                  clang::ASTContext& Context);
+
+/// Add to \p Hints the insertions turning the type of \p Var into a const
+/// reference. Return false when it cannot be rewritten, e.g. in a macro.
+bool ConstReferenceHints(const clang::VarDecl*          Var,
+                         const clang::SourceManager&    SM,
+                         const clang::LangOptions&      LO,
+                         std::vector<clang::FixItHint>& Hints);
+
+}  // namespace tidy
+
+#endif
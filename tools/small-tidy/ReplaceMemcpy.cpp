@@ -23,6 +23,7 @@
 // SOFTWARE.
 //
 
+#include "MemoryOperands.hpp"
 #include "Transform.hpp"
 
 #include <iostream>
@@ -44,16 +45,30 @@ using namespace clang::tooling;
 
 namespace tidy {
 
+static Statistic NumAssignments("replace-memcpy", "assignments",
+                                "Single object copies made assignments");
+static Statistic NumCopies("replace-memcpy", "copies",
+                           "Array copies made std::copy_n");
+static Statistic NumValueInits("replace-memcpy", "value-inits",
+                               "Single object clears made value-init");
+static Statistic NumFills("replace-memcpy", "fills",
+                          "Array clears made std::fill_n");
+
+static Statistic NumRejectedSize(
+   "replace-memcpy", "rejected-size",
+   "Sizes not written sizeof(T), N * sizeof(T) or sizeof(T) * N");
+static Statistic NumRejectedType(
+   "replace-memcpy", "rejected-type",
+   "Pointers not to the POD type of the size");
+static Statistic NumRejectedOverlap(
+   "replace-memcpy", "rejected-overlap",
+   "memmove of arrays which may overlap");
+static Statistic NumRejectedFill("replace-memcpy", "rejected-fill",
+                                 "memset to another value than zero");
+static Statistic NumRejectedUsed(
+   "replace-memcpy", "rejected-used",
+   "Calls which are not a statement of their own, e.g. whose result is used");
 
-// callExpr matcher remove implicitCast for us on argument.
-AST_MATCHER(Expr, pointerToPOD) {
-   auto type = Node.getType();
-   if (const PointerType* PT = dyn_cast<PointerType>(type)) {
-      auto pointee = PT->getPointeeType();
-      return pointee.isPODType(Finder->getASTContext());
-   }
-   return false;
-}
 
 template <typename T>
 static llvm::StringRef CodeFragment(const T& Node, const SourceManager& SM,
@@ -63,6 +78,73 @@ static llvm::StringRef CodeFragment(const T& Node, const SourceManager& SM,
       LangOpts);
 }
 
+// Type of sizeof(T) or sizeof(expr), null for anything else.
+static QualType SizeOfType(const Expr* E) {
+   auto sizeOf = dyn_cast<UnaryExprOrTypeTraitExpr>(E->IgnoreParenImpCasts());
+   if (!sizeOf || sizeOf->getKind() != UETT_SizeOf)
+      return QualType();
+   return sizeOf->getTypeOfArgument();
+}
+
+// Split a size written sizeof(T), N * sizeof(T) or sizeof(T) * N into T and
+// N, which stays null for a single object.
+static bool SplitSize(const Expr* size, QualType& type, const Expr*& count) {
+   count = nullptr;
+   type  = SizeOfType(size);
+   if (!type.isNull())
+      return true;
+
+   auto product = dyn_cast<BinaryOperator>(size->IgnoreParenImpCasts());
+   if (!product || product->getOpcode() != BO_Mul)
+      return false;
+
+   type  = SizeOfType(product->getRHS());
+   count = product->getLHS();
+   if (type.isNull()) {
+      type  = SizeOfType(product->getLHS());
+      count = product->getRHS();
+   }
+   return !type.isNull();
+}
+
+// Pointee of \p E, once the conversion to void* of the call is removed.
+static QualType PointeeType(const Expr* E) {
+   auto type = E->IgnoreParenImpCasts()->getType();
+   if (auto pointer = type->getAs<PointerType>())
+      return pointer->getPointeeType();
+   return QualType();
+}
+
+// Return true when \p tag can be named, e.g. not an anonymous struct, unless
+// a typedef gives it a name.
+static bool HasName(const TagDecl* tag) {
+   return tag->getDeclName() || tag->getTypedefNameForAnonDecl();
+}
+
+// Return true when \p call is a statement of its own: in a block, or the
+// body of an if or of a loop. The rewrites are expressions of another type,
+// e.g. an initializer or a returned value would not compile any more.
+static bool IsStatement(const CallExpr* call, ASTContext& context) {
+   auto parents = context.getParents(*call);
+   if (parents.size() != 1)
+      return false;
+
+   auto& parent = parents[0];
+   if (parent.get<CompoundStmt>())
+      return true;
+   if (auto ifStmt = parent.get<IfStmt>())
+      return ifStmt->getThen() == call || ifStmt->getElse() == call;
+   if (auto loop = parent.get<ForStmt>())
+      return loop->getBody() == call;
+   if (auto loop = parent.get<CXXForRangeStmt>())
+      return loop->getBody() == call;
+   if (auto loop = parent.get<WhileStmt>())
+      return loop->getBody() == call;
+   if (auto loop = parent.get<DoStmt>())
+      return loop->getBody() == call;
+   return false;
+}
+
 
 class ReplaceMemcpy : public Transform {
 public:
@@ -70,38 +152,183 @@ public:
       : Transform(CheckName, ctx) {}
 
    virtual void registerMatchers(MatchFinder* Finder) {
-      Finder->addMatcher(callExpr(callee(functionDecl(hasName("memcpy"))),
-                                  hasArgument(0, pointerToPOD()),
-                                  hasArgument(2, unaryExprOrTypeTraitExpr()),
-                                  isExpansionInMainFile())
-                            .bind("memcpy"),
-                         this);
+      addMatcher(Finder, callExpr(callee(functionDecl(anyOf(
+                                     hasName("memcpy"), hasName("memmove"),
+                                     hasName("memset")))),
+                                  argumentCountIs(3),
+                                  isExpansionInMainFileLocked())
+                            .bind("memcpy"));
+   }
+
+   virtual bool isThreadSafe() const {
+      return true;
    }
 
    virtual void check(const MatchFinder::MatchResult& Result) {
-      auto callMemcpy = Result.Nodes.getNodeAs<CallExpr>("memcpy");
+      // The rewrites use assignments of objects and the standard library.
+      if (!Result.Context->getLangOpts().CPlusPlus)
+         return;
 
-      auto Diag =
-         diag(Result,
-              callMemcpy->getExprLoc(),
-              "Consider replacing `memcpy(x, y, sizeof(T))` with copy.");
+      auto call = Result.Nodes.getNodeAs<CallExpr>("memcpy");
+      auto name = call->getDirectCallee()->getName();
 
-      auto dst = callMemcpy->getArg(0);
-      auto src = callMemcpy->getArg(1);
+      QualType    type;
+      const Expr* count = nullptr;
+      if (!SplitSize(call->getArg(2), type, count)) {
+         ++NumRejectedSize;
+         return;
+      }
 
+      auto& context = *Result.Context;
+      auto  dst     = PointeeType(call->getArg(0));
+      if (dst.isNull() ||
+          !context.hasSameUnqualifiedType(dst, type) ||
+          !type.isPODType(context)) {
+         ++NumRejectedType;
+         return;
+      }
+
+      if (!IsStatement(call, context)) {
+         ++NumRejectedUsed;
+         return;
+      }
+
+      if (name == "memset")
+         replaceMemset(call, type, count, Result);
+      else
+         replaceCopy(call, name == "memmove", type, count, Result);
+   }
+
+private:
+   void replaceCopy(const CallExpr* call, bool mayOverlap, QualType type,
+                    const Expr* count, const MatchFinder::MatchResult& Result) {
+      auto dst = call->getArg(0);
+      auto src = call->getArg(1);
+
+      auto srcType = PointeeType(src);
+      if (srcType.isNull() ||
+          !Result.Context->hasSameUnqualifiedType(srcType, type)) {
+         ++NumRejectedType;
+         return;
+      }
+
+      // Objects of the same type are either the same or apart, arrays of them
+      // may overlap unless they belong to different variables.
+      if (count && mayOverlap) {
+         auto dstOwner = OwnerVariable(dst);
+         auto srcOwner = OwnerVariable(src);
+         if (!dstOwner || !srcOwner || dstOwner == srcOwner) {
+            ++NumRejectedOverlap;
+            return;
+         }
+      }
+
+      auto name    = call->getDirectCallee()->getName().str();
+      auto message = count ? "Consider replacing `" + name +
+                                "(x, y, n * sizeof(T))` with std::copy_n."
+                           : "Consider replacing `" + name +
+                                "(x, y, sizeof(T))` with copy.";
+
+      auto Diag = diag(Result, call->getExprLoc(), message);
+      if (Diag.dropsHints())
+         return;
+
+      std::string              buffer;
+      llvm::raw_string_ostream fragment(buffer);
+
+      if (count) {
+         ++NumCopies;
+         fragment << "std::copy_n(" << argumentText(src, Result) << ", "
+                  << argumentText(count, Result) << ", "
+                  << argumentText(dst, Result) << ")";
+      }
+      else {
+         ++NumAssignments;
+         printArgumentReplacement(fragment, dst, Result);
+         fragment << " = ";
+         printArgumentReplacement(fragment, src, Result);
+      }
+
+      Diag << FixItHint::CreateReplacement(callRange(call), fragment.str());
+      if (count) {
+         if (auto include = includeHint(Result, "<algorithm>"))
+            Diag << *include;
+      }
+   }
+
+   void replaceMemset(const CallExpr* call, QualType type, const Expr* count,
+                      const MatchFinder::MatchResult& Result) {
+      llvm::APSInt value;
+      if (!call->getArg(1)->EvaluateAsInt(value, *Result.Context) ||
+          value != 0) {
+         ++NumRejectedFill;
+         return;
+      }
+
+      // Zero of the type. Pointers are left alone: 0 is not a null pointer
+      // once given to std::fill_n, and so are arrays, which cannot be
+      // assigned. A single object is assigned {}, whatever the name of its
+      // type, but std::fill_n deduces the type of its value and needs T().
+      std::string zero;
+      bool        isTag = type->isRecordType() || type->isEnumeralType();
+      if (type->isArithmeticType()) {
+         zero = "0";
+      }
+      else if (isTag && !count) {
+         zero = "{}";
+      }
+      else if (isTag && HasName(type->getAsTagDecl())) {
+         zero = type.getUnqualifiedType().getAsString(
+                   Result.Context->getPrintingPolicy()) +
+                "()";
+      }
+      else {
+         ++NumRejectedType;
+         return;
+      }
+
+      auto message =
+         count ? "Consider replacing `memset(x, 0, n * sizeof(T))` with "
+                 "std::fill_n."
+               : "Consider replacing `memset(x, 0, sizeof(T))` with "
+                 "value-initialization.";
+
+      auto Diag = diag(Result, call->getExprLoc(), message);
+      if (Diag.dropsHints())
+         return;
+
+      auto dst = call->getArg(0);
 
       std::string              buffer;
       llvm::raw_string_ostream fragment(buffer);
 
-      printArgumentReplacement(fragment, dst, Result);
-      fragment << " = ";
-      printArgumentReplacement(fragment, src, Result);
+      if (count) {
+         ++NumFills;
+         fragment << "std::fill_n(" << argumentText(dst, Result) << ", "
+                  << argumentText(count, Result) << ", " << zero << ")";
+      }
+      else {
+         ++NumValueInits;
+         printArgumentReplacement(fragment, dst, Result);
+         fragment << " = " << zero;
+      }
+
+      Diag << FixItHint::CreateReplacement(callRange(call), fragment.str());
+      if (count) {
+         if (auto include = includeHint(Result, "<algorithm>"))
+            Diag << *include;
+      }
+   }
+
+   static CharSourceRange callRange(const CallExpr* call) {
+      return CharSourceRange::getCharRange(
+         call->getLocStart(), call->getLocEnd().getLocWithOffset(1));
+   }
 
-      Diag << FixItHint::CreateReplacement(
-         CharSourceRange::getCharRange(
-            callMemcpy->getLocStart(),
-            callMemcpy->getLocEnd().getLocWithOffset(1)),
-         fragment.str());
+   static llvm::StringRef argumentText(const Expr*                     argument,
+                                       const MatchFinder::MatchResult& Result) {
+      return CodeFragment(*argument->IgnoreImpCasts(), *Result.SourceManager,
+                          Result.Context->getLangOpts());
    }
 
    void printArgumentReplacement(llvm::raw_ostream& out, const Expr* argument,
@@ -134,5 +361,7 @@ struct ReplaceMemcpyTransformFactory : public TransformFactory {
 };
 
 static TransformFactoryRegistry::Add<ReplaceMemcpyTransformFactory> X_Memcpy(
-   "replace-memcpy", "Replace memcpy to assignment operator on POD");
+   "replace-memcpy",
+   "Replace memcpy, memmove and memset of POD with typed assignments, "
+   "std::copy_n or std::fill_n");
 }
@@ -0,0 +1,353 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "ReadOnlyUses.hpp"
+#include "Transform.hpp"
+
+#include <string>
+#include <vector>
+
+#include "clang/AST/AST.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Lex/Lexer.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace tidy {
+
+static Statistic NumReserves("reserve-before-loop", "reserves",
+                             "Reserves inserted before a loop");
+static Statistic NumRejectedBound(
+   "reserve-before-loop", "rejected-bound",
+   "Bounds with side effects, or which may change in the loop");
+static Statistic NumRejectedExit("reserve-before-loop", "rejected-exit",
+                                 "Loops which may stop before their bound");
+static Statistic NumRejectedGrowth(
+   "reserve-before-loop", "rejected-growth",
+   "Containers not grown by one push_back per iteration");
+
+
+template <typename T>
+static llvm::StringRef CodeFragment(const T& Node, const SourceManager& SM,
+                                    const LangOptions& LangOpts) {
+   return Lexer::getSourceText(
+      CharSourceRange::getTokenRange(Node.getLocStart(), Node.getLocEnd()), SM,
+      LangOpts);
+}
+
+// Variable named by \p E, once parentheses and implicit casts are removed.
+static const VarDecl* NamedVariable(const Expr* E) {
+   auto ref = dyn_cast<DeclRefExpr>(E->IgnoreParenImpCasts());
+   return ref ? dyn_cast<VarDecl>(ref->getDecl()) : nullptr;
+}
+
+static bool IsZero(const Expr* E, const ASTContext& Context) {
+   llvm::APSInt value;
+   return E->IgnoreParenImpCasts()->EvaluateAsInt(value, Context) &&
+          value == 0;
+}
+
+// Empty std::vector or std::string declared by \p S.
+static const VarDecl* EmptyContainer(const Stmt* S) {
+   auto declStmt = dyn_cast<DeclStmt>(S);
+   if (!declStmt || !declStmt->isSingleDecl())
+      return nullptr;
+
+   auto var = dyn_cast<VarDecl>(declStmt->getSingleDecl());
+   if (!var || !var->hasLocalStorage() || var->getType()->isReferenceType())
+      return nullptr;
+
+   auto record = var->getType()->getAsCXXRecordDecl();
+   if (!record || !record->isInStdNamespace() ||
+       (record->getName() != "vector" && record->getName() != "basic_string"))
+      return nullptr;
+
+   auto init = dyn_cast_or_null<CXXConstructExpr>(var->getInit());
+   return init && init->getNumArgs() == 0 ? var : nullptr;
+}
+
+// Return true when \p E is computed from local variables only read in
+// \p Body, other than \p Container, without side effects.
+static bool IsStableBound(const Expr* E, const VarDecl* Container,
+                          const Stmt& Body, ASTContext& Context) {
+   E = E->IgnoreParenImpCasts();
+   if (isa<IntegerLiteral>(E) || isa<UnaryExprOrTypeTraitExpr>(E))
+      return true;
+
+   if (auto ref = dyn_cast<DeclRefExpr>(E)) {
+      if (isa<EnumConstantDecl>(ref->getDecl()))
+         return true;
+      auto var = dyn_cast<VarDecl>(ref->getDecl());
+      return var && var != Container && var->hasLocalStorage() &&
+             HasOnlyReads(var, Body, Context);
+   }
+
+   if (auto member = dyn_cast<MemberExpr>(E)) {
+      return !member->isArrow() && isa<FieldDecl>(member->getMemberDecl()) &&
+             IsStableBound(member->getBase(), Container, Body, Context);
+   }
+
+   // e.g. items.size()
+   if (auto call = dyn_cast<CXXMemberCallExpr>(E)) {
+      auto method = call->getMethodDecl();
+      auto callee = dyn_cast<MemberExpr>(call->getCallee()->IgnoreParens());
+      return method && method->isConst() && call->getNumArgs() == 0 &&
+             callee && !callee->isArrow() &&
+             IsStableBound(call->getImplicitObjectArgument(), Container, Body,
+                           Context);
+   }
+
+   if (auto op = dyn_cast<BinaryOperator>(E)) {
+      return (op->isAdditiveOp() || op->isMultiplicativeOp()) &&
+             IsStableBound(op->getLHS(), Container, Body, Context) &&
+             IsStableBound(op->getRHS(), Container, Body, Context);
+   }
+   return false;
+}
+
+static std::string Indentation(SourceLocation Loc, const SourceManager& SM) {
+   bool        invalid = false;
+   const char* text    = SM.getCharacterData(Loc, &invalid);
+   auto        column  = SM.getSpellingColumnNumber(Loc, &invalid);
+   if (invalid || column == 0)
+      return "";
+
+   std::string indent(text - (column - 1), column - 1);
+   for (auto& c : indent) {
+      if (c != '\t')
+         c = ' ';
+   }
+   return indent;
+}
+
+
+class ReserveBeforeLoop : public Transform {
+public:
+   ReserveBeforeLoop(llvm::StringRef CheckName, TransformContext* ctx)
+      : Transform(CheckName, ctx) {}
+
+   // Each container declared just before a loop in a block.
+   virtual void registerMatchers(MatchFinder* Finder) {
+      addMatcher(Finder,
+                 compoundStmt(isExpansionInMainFileLocked()).bind("block"));
+   }
+
+   virtual bool isThreadSafe() const {
+      return true;
+   }
+
+   virtual void check(const MatchFinder::MatchResult& Result) {
+      auto block = Result.Nodes.getNodeAs<CompoundStmt>("block");
+
+      const VarDecl* container = nullptr;
+      for (auto S : block->body()) {
+         if (container)
+            reserve(container, S, Result);
+         container = EmptyContainer(S);
+      }
+   }
+
+private:
+   void reserve(const VarDecl* container, const Stmt* loop,
+                const MatchFinder::MatchResult& Result) {
+      auto& context = *Result.Context;
+      auto& SM      = *Result.SourceManager;
+      auto& LO      = context.getLangOpts();
+
+      const Stmt* body  = nullptr;
+      const Expr* count = nullptr;
+      bool        guard = false;
+      if (auto forLoop = dyn_cast<ForStmt>(loop)) {
+         body  = forLoop->getBody();
+         count = countedBound(forLoop, context);
+         if (!count)
+            return;
+         if (!IsStableBound(count, container, *body, context)) {
+            ++NumRejectedBound;
+            return;
+         }
+         // A loop on a negative signed bound does nothing, reserve takes an
+         // unsigned size.
+         llvm::APSInt value;
+         guard = count->getType()->isSignedIntegerType() &&
+                 !(count->EvaluateAsInt(value, context) && value > 0);
+      }
+      else if (auto rangeLoop = dyn_cast<CXXForRangeStmt>(loop)) {
+         body  = rangeLoop->getBody();
+         count = rangeLoop->getRangeInit();
+         if (!isSizedRange(count, container, *body, context)) {
+            ++NumRejectedBound;
+            return;
+         }
+      }
+      else {
+         return;
+      }
+
+      auto exits = match(
+         findAll(stmt(anyOf(breakStmt(), continueStmt(), returnStmt(),
+                            gotoStmt(), cxxThrowExpr()))),
+         *body, context);
+      if (!exits.empty()) {
+         ++NumRejectedExit;
+         return;
+      }
+
+      if (!growsOncePerIteration(container, body, context)) {
+         ++NumRejectedGrowth;
+         return;
+      }
+
+      auto loc = loop->getLocStart();
+      if (loc.isMacroID() || count->getLocStart().isMacroID() ||
+          count->getLocEnd().isMacroID())
+         return;
+
+      auto Diag = diag(Result, loc,
+                       "Consider reserving the container before the loop.");
+      if (Diag.dropsHints())
+         return;
+
+      auto countText = CodeFragment(*count, SM, LO).str();
+      if (isa<CXXForRangeStmt>(loop))
+         countText += ".size()";
+      else if (!isa<DeclRefExpr>(count->IgnoreParenImpCasts()) &&
+               !isa<IntegerLiteral>(count->IgnoreParenImpCasts()) &&
+               !isa<CXXMemberCallExpr>(count->IgnoreParenImpCasts()))
+         countText = "(" + countText + ")";
+
+      std::string text = container->getName().str() + ".reserve(" +
+                         countText + ");\n" + Indentation(loc, SM);
+      if (guard)
+         text = "if (" + countText + " > 0) " + text;
+
+      ++NumReserves;
+      Diag << FixItHint::CreateInsertion(loc, text);
+   }
+
+   // Bound of a loop written for (i = 0; i < n; ++i).
+   static const Expr* countedBound(const ForStmt* loop, ASTContext& context) {
+      auto init = dyn_cast_or_null<DeclStmt>(loop->getInit());
+      if (!init || !init->isSingleDecl())
+         return nullptr;
+      auto counter = dyn_cast<VarDecl>(init->getSingleDecl());
+      if (!counter || !counter->getType()->isIntegerType() ||
+          !counter->getInit() || !IsZero(counter->getInit(), context))
+         return nullptr;
+
+      auto cond = dyn_cast_or_null<BinaryOperator>(loop->getCond());
+      if (!cond || (cond->getOpcode() != BO_LT && cond->getOpcode() != BO_NE) ||
+          NamedVariable(cond->getLHS()) != counter)
+         return nullptr;
+
+      auto inc = loop->getInc();
+      if (auto op = dyn_cast_or_null<UnaryOperator>(inc)) {
+         if (!op->isIncrementOp() || NamedVariable(op->getSubExpr()) != counter)
+            return nullptr;
+      }
+      else {
+         auto op = dyn_cast_or_null<CompoundAssignOperator>(inc);
+         llvm::APSInt step;
+         if (!op || op->getOpcode() != BO_AddAssign ||
+             NamedVariable(op->getLHS()) != counter ||
+             !op->getRHS()->EvaluateAsInt(step, context) || step != 1)
+            return nullptr;
+      }
+
+      // The counter only changes in the increment.
+      if (!HasOnlyReads(counter, *loop->getBody(), context))
+         return nullptr;
+      return cond->getRHS()->IgnoreParenImpCasts();
+   }
+
+   // A local range with a size, unchanged in the loop.
+   static bool isSizedRange(const Expr* range, const VarDecl* container,
+                            const Stmt& body, ASTContext& context) {
+      auto var = NamedVariable(range);
+      if (!var || var == container || !var->hasLocalStorage() ||
+          !HasOnlyReads(var, body, context))
+         return false;
+
+      auto record = var->getType().getNonReferenceType()->getAsCXXRecordDecl();
+      return record && record->hasDefinition() &&
+             !record->lookup(&context.Idents.get("size")).empty();
+   }
+
+   // Return true when the only growth of \p container in \p body is one
+   // unconditional push_back or emplace_back.
+   static bool growsOncePerIteration(const VarDecl* container,
+                                     const Stmt* body, ASTContext& context) {
+      std::vector<const Stmt*> statements;
+      if (auto block = dyn_cast<CompoundStmt>(body))
+         statements.assign(block->body_begin(), block->body_end());
+      else
+         statements.push_back(body);
+
+      const Expr* growth = nullptr;
+      for (auto S : statements) {
+         auto expr = dyn_cast<Expr>(S);
+         auto call = expr ? dyn_cast<CXXMemberCallExpr>(expr->IgnoreImplicit())
+                          : nullptr;
+         if (!call || !call->getMethodDecl() ||
+             NamedVariable(call->getImplicitObjectArgument()) != container)
+            continue;
+         auto name = call->getMethodDecl()->getName();
+         if (name != "push_back" && name != "emplace_back")
+            continue;
+         if (growth)
+            return false;
+         growth = call->getImplicitObjectArgument()->IgnoreParenImpCasts();
+      }
+      if (!growth)
+         return false;
+
+      auto uses = match(
+         findAll(declRefExpr(to(varDecl(equalsNode(container)))).bind("use")),
+         *body, context);
+      for (auto& use : uses) {
+         auto ref = use.getNodeAs<DeclRefExpr>("use");
+         if (ref != growth && !IsOnlyRead(ref, context))
+            return false;
+      }
+      return true;
+   }
+};
+
+struct ReserveBeforeLoopFactory : public TransformFactory {
+   virtual ~ReserveBeforeLoopFactory() {}
+   virtual std::unique_ptr<Transform> create(llvm::StringRef   CheckName,
+                                             TransformContext* context) const {
+      return llvm::make_unique<ReserveBeforeLoop>(CheckName, context);
+   }
+};
+
+static TransformFactoryRegistry::Add<ReserveBeforeLoopFactory>
+   X_ReserveBeforeLoop("reserve-before-loop",
+                       "Reserve the std::vector or std::string filled by a "
+                       "counted loop declared just after it.");
+
+}  // namespace tidy
@@ -54,12 +54,12 @@ public:
       : Transform(CheckName, ctx) {}
 
    virtual void registerMatchers(MatchFinder* Finder) {
-      Finder->addMatcher(
+      addMatcher(
+         Finder,
          callExpr(callee(functionDecl(hasName("foo"), parameterCountIs(2))),
                   hasArgument(0, ignoringImpCasts(
                                     unaryExprOrTypeTraitExpr().bind("1st"))))
-            .bind("call"),
-         this);
+            .bind("call"));
    }
 
    virtual void check(const MatchFinder::MatchResult& Result) {
@@ -69,6 +69,8 @@ public:
       auto Diag = diag(Result,
                        call->getExprLoc(),
                        "Consider use of non deprecated version of foo");
+      if (Diag.dropsHints())
+         return;
 
       auto* TSize     = Result.Nodes.getNodeAs<UnaryExprOrTypeTraitExpr>("1st");
       auto  TType     = TSize->getArgumentType();
@@ -87,6 +89,11 @@ public:
                                                      lastArg->getLocStart());
       Diag << FixItHint::CreateRemoval(charRange);
    }
+
+   // The matcher only reads the AST.
+   virtual bool isThreadSafe() const {
+      return true;
+   }
 };
 
 struct SampleTransformFactory : public TransformFactory {
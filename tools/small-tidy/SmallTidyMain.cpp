@@ -22,9 +22,10 @@
 // SOFTWARE.
 //
 
+#include "SmallTidyOptions.hpp"
 #include "Transform.hpp"
 
-#include "clang/Tooling/CommonOptionsParser.h"
+#include "OptionsParser.hpp"
 
 #include <iostream>
 #include <string>
@@ -34,10 +35,13 @@ using namespace clang::tooling;
 using namespace llvm;
 using namespace tidy;
 
-namespace {
+namespace tidy {
+
+cl::OptionCategory SmallTidyCategory("small tidy code options");
 
-static cl::OptionCategory SmallTidyCategory("small tidy code options");
+}  // namespace tidy
 
+namespace {
 
 static cl::opt<bool> Quiet("quiet", cl::desc("Discard clang warnings."),
                            cl::cat(SmallTidyCategory));
@@ -52,10 +56,78 @@ static cl::opt<bool> AllTransformation("all",
                                        cl::desc("Apply all transformations"),
                                        cl::cat(SmallTidyCategory));
 
+static cl::opt<bool> ReportTime("report-time",
+                                cl::desc("Report time spent on the run."),
+                                cl::cat(SmallTidyCategory));
+
+static cl::opt<bool> CacheFiles(
+   "cache-files",
+   cl::desc("Read each file once per run and share it between translation "
+            "units (default on)."),
+   cl::init(true), cl::cat(SmallTidyCategory));
+
+static cl::opt<bool> CensusOnly(
+   "census",
+   cl::desc("Only count the sites each transform would touch, per directory, "
+            "without producing any fix."),
+   cl::cat(SmallTidyCategory));
+
+static cl::opt<unsigned> CensusDepth(
+   "census-depth",
+   cl::desc("Number of directory levels in the census histogram (default 2)."),
+   cl::init(2), cl::cat(SmallTidyCategory));
+
 static cl::opt<std::string> OutputDir("outputdir",
                                       cl::desc("<path> output dir."),
                                       cl::cat(SmallTidyCategory));
 
+static cl::opt<bool> Stats("stats",
+                           cl::desc("Print the run statistics on exit."),
+                           cl::cat(SmallTidyCategory));
+
+static cl::opt<std::string> StatsJson(
+   "stats-json", cl::desc("Write the run statistics as JSON to <path>."),
+   cl::value_desc("path"), cl::cat(SmallTidyCategory));
+
+static cl::opt<std::string> JsonLines(
+   "jsonl",
+   cl::desc("Stream diagnostics and fixes as JSON lines to <path> ('-' for "
+            "stdout)."),
+   cl::value_desc("path"), cl::cat(SmallTidyCategory));
+
+static cl::opt<unsigned> Workers(
+   "workers",
+   cl::desc("Process the sources in <N> worker processes, so that a crash "
+            "only loses its source (POSIX only)."),
+   cl::value_desc("N"), cl::init(0), cl::cat(SmallTidyCategory));
+
+static cl::opt<unsigned> MatchThreads(
+   "match-threads",
+   cl::desc("Match the top-level declarations of big translation units from "
+            "<N> threads."),
+   cl::value_desc("N"), cl::init(0), cl::cat(SmallTidyCategory));
+
+static cl::list<std::string> Pipeline(
+   "pipeline",
+   cl::desc("Run the transforms <a,b,...> in sequence, each one on the output "
+            "of the previous ones, instead of the selected transforms."),
+   cl::value_desc("a,b,..."), cl::CommaSeparated, cl::cat(SmallTidyCategory));
+
+static cl::opt<TraversalKind> Traversal(
+   "traversal",
+   cl::desc("Force how the transforms traverse template instantiations, "
+            "instead of their own setting:"),
+   cl::values(clEnumValN(TraversalKind::AsIs, "as-is",
+                         "match the template instantiations too."),
+              clEnumValN(TraversalKind::SpelledInSource, "spelled-in-source",
+                         "only match the code spelled in the source.")
+#if defined(CLANG_38)
+                 ,
+              clEnumValEnd
+#endif
+              ),
+   cl::cat(SmallTidyCategory));
+
 std::string GetOutputDir() {
    if (OutputDir.empty())
       return "";
@@ -74,10 +146,36 @@ int main(int argc, const char** argv) {
    Transforms transforms;
    transforms.registerOptions(SmallTidyCategory);
 
-   CommonOptionsParser op(argc, argv, SmallTidyCategory);
-
-   transforms.apply(op.getCompilations(), op.getSourcePathList(), Quiet, StdOut,
-                    Export, GetOutputDir());
-
-   return 0;
+   OptionsParser op(argc, argv, SmallTidyCategory);
+
+   if (Stats || !StatsJson.empty())
+      EnableStatistics();
+
+   ApplyOptions options;
+   options.Quiet        = Quiet;
+   options.StdOut       = StdOut;
+   options.Export       = Export;
+   options.ReportTime   = ReportTime;
+   options.CacheFiles   = CacheFiles;
+   options.CensusOnly   = CensusOnly;
+   options.CensusDepth  = CensusDepth;
+   options.Workers      = Workers;
+   options.MatchThreads = MatchThreads;
+   options.OutputDir    = GetOutputDir();
+   options.JsonLines    = JsonLines;
+   options.IncludeMap   = op.getIncludeMapPath();
+   options.Cache        = op.getAstCache();
+   options.Pipeline.assign(Pipeline.begin(), Pipeline.end());
+   if (Traversal.getNumOccurrences())
+      options.Traversal = Traversal.getValue();
+
+   int res =
+      transforms.apply(op.getCompilations(), op.getSourcePathList(), options);
+
+   if (Stats)
+      PrintStatistics(std::cerr);
+   if (!StatsJson.empty())
+      WriteStatisticsJson(StatsJson);
+
+   return res;
 }
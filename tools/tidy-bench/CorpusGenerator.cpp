@@ -0,0 +1,192 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "CorpusGenerator.hpp"
+
+#include <functional>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace tidy {
+
+namespace {
+
+const char* const Header = R"(#ifndef BENCH_HPP
+#define BENCH_HPP
+
+extern "C" void* memcpy(void* dst, const void* src, decltype(sizeof(0)) n);
+
+struct Pod {
+   int    a;
+   double b;
+};
+
+struct Holder {
+   int value;
+};
+
+void sink(int);
+void print(const char*);
+
+#endif
+)";
+
+std::string JsonString(StringRef s) {
+   std::string out = "\"";
+   for (char c : s) {
+      if (c == '"' || c == '\\')
+         out += '\\';
+      out += c;
+   }
+   return out + "\"";
+}
+
+bool WriteFile(StringRef Path, std::string& ErrorMessage,
+               const std::function<void(raw_ostream&)>& Write) {
+   std::error_code EC;
+   raw_fd_ostream  out(Path, EC, sys::fs::F_Text);
+   if (EC) {
+      ErrorMessage = "Cannot write " + Path.str() + ": " + EC.message();
+      return false;
+   }
+   Write(out);
+   return true;
+}
+
+void WriteTranslationUnit(raw_ostream& out, unsigned file,
+                          const CorpusOptions& Options) {
+   out << "#include \"bench.hpp\"\n";
+
+   // Last statement of the function, without else nor return: candidate for
+   // early-return.
+   for (unsigned i = 0; i < Options.EarlyReturns; ++i) {
+      out << "\nvoid early_return_" << file << "_" << i << "(int value) {\n"
+          << "   int total = value;\n"
+          << "   if (value > " << i << ") {\n"
+          << "      total += 1;\n"
+          << "      total *= 2;\n"
+          << "      total -= 3;\n"
+          << "      sink(total);\n"
+          << "   }\n"
+          << "}\n";
+   }
+
+   // A single function made of many ifs, each one matched by early-return.
+   if (Options.EarlyReturnIfs > 0) {
+      out << "\nvoid early_return_ifs_" << file << "(int value) {\n"
+          << "   int total = value;\n";
+      for (unsigned i = 0; i < Options.EarlyReturnIfs; ++i) {
+         out << "   if (value > " << i << ") {\n"
+             << "      total += " << i << ";\n"
+             << "      total *= 2;\n"
+             << "      total -= 3;\n"
+             << "      sink(total);\n"
+             << "   }\n";
+      }
+      out << "}\n";
+   }
+
+   for (unsigned i = 0; i < Options.Memcpys; ++i) {
+      out << "\nvoid replace_memcpy_" << file << "_" << i
+          << "(Pod* dst, const Pod* src) {\n"
+          << "   memcpy(dst, src, sizeof(Pod));\n"
+          << "}\n";
+   }
+
+   for (unsigned i = 0; i < Options.NonAsciiLiterals; ++i) {
+      out << "\nconst char* nonascii_" << file << "_" << i << "() {\n"
+          << "   return \"caf\xc3\xa9 " << i << "\";\n"
+          << "}\n";
+   }
+
+   // Every variable of the chain can be made const.
+   for (unsigned i = 0; i < Options.CharChains; ++i) {
+      out << "\nvoid char_chain_" << file << "_" << i << "(char* p0) {\n";
+      for (unsigned j = 1; j <= Options.ChainLength; ++j)
+         out << "   char* p" << j << " = p" << j - 1 << ";\n";
+      out << "   print(p" << Options.ChainLength << ");\n"
+          << "}\n";
+   }
+
+   for (unsigned i = 0; i < Options.MemberAccesses; ++i) {
+      out << "\nint member_access_" << file << "_" << i
+          << "(Holder& holder) {\n"
+          << "   holder.value = " << i << ";\n"
+          << "   ++holder.value;\n"
+          << "   return holder.value;\n"
+          << "}\n";
+   }
+}
+
+}  // namespace
+
+bool GenerateCorpus(StringRef Directory, const CorpusOptions& Options,
+                    std::string& ErrorMessage) {
+   if (std::error_code EC = sys::fs::create_directories(Directory)) {
+      ErrorMessage = "Cannot create " + Directory.str() + ": " + EC.message();
+      return false;
+   }
+
+   SmallString<256> AbsoluteDirectory(Directory);
+   sys::fs::make_absolute(AbsoluteDirectory);
+
+   SmallString<256> HeaderPath(AbsoluteDirectory);
+   sys::path::append(HeaderPath, "bench.hpp");
+   if (!WriteFile(HeaderPath, ErrorMessage,
+                  [](raw_ostream& out) { out << Header; }))
+      return false;
+
+   for (unsigned file = 0; file < Options.Files; ++file) {
+      SmallString<256> SourcePath(AbsoluteDirectory);
+      sys::path::append(SourcePath, "bench_" + std::to_string(file) + ".cpp");
+      if (!WriteFile(SourcePath, ErrorMessage, [&](raw_ostream& out) {
+             WriteTranslationUnit(out, file, Options);
+          }))
+         return false;
+   }
+
+   SmallString<256> DatabasePath(AbsoluteDirectory);
+   sys::path::append(DatabasePath, "compile_commands.json");
+   return WriteFile(DatabasePath, ErrorMessage, [&](raw_ostream& out) {
+      out << "[\n";
+      for (unsigned file = 0; file < Options.Files; ++file) {
+         auto source = "bench_" + std::to_string(file) + ".cpp";
+         out << "   {\n"
+             << "      \"directory\": " << JsonString(AbsoluteDirectory)
+             << ",\n"
+             << "      \"command\": \"clang++ -std=c++11 -c " << source
+             << "\",\n"
+             << "      \"file\": " << JsonString(source) << "\n"
+             << "   }" << (file + 1 < Options.Files ? "," : "") << "\n";
+      }
+      out << "]\n";
+   });
+}
+
+}  // namespace tidy
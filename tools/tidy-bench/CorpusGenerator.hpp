@@ -0,0 +1,53 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#ifndef CORPUS_GENERATOR_HPP
+#define CORPUS_GENERATOR_HPP
+
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace tidy {
+
+/// Knobs of the synthetic corpus, counts are per translation unit.
+struct CorpusOptions {
+   unsigned Files            = 1;
+   unsigned EarlyReturns     = 50;  ///< early-return candidate functions
+   unsigned EarlyReturnIfs   = 0;   ///< ifs of one big function, if any
+   unsigned Memcpys          = 50;  ///< memcpy of a POD
+   unsigned NonAsciiLiterals = 50;  ///< string literals with non-ASCII chars
+   unsigned CharChains       = 20;  ///< functions with char* chains
+   unsigned ChainLength      = 10;  ///< assignments in each chain
+   unsigned MemberAccesses   = 50;  ///< functions accessing Holder::value
+};
+
+/// Write the translation units of a synthetic corpus, their shared header
+/// and a compile_commands.json in \p Directory.
+bool GenerateCorpus(llvm::StringRef Directory, const CorpusOptions& Options,
+                    std::string& ErrorMessage);
+
+}  // namespace tidy
+
+#endif
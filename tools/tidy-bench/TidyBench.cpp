@@ -0,0 +1,369 @@
+//
+// MIT License
+//
+// Copyright (c) 2017 Jeremy Demeule
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+/*
+ * Benchmark of the tidy tools over synthetic corpora of several sizes.
+ *
+ * Each tool is run as a child process on every corpus; wall time, CPU time,
+ * peak memory and matches per second are reported as JSON so runs can be
+ * compared across commits.
+ */
+
+#include "CorpusGenerator.hpp"
+#include "JsonLines.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+using namespace tidy;
+
+namespace {
+
+static cl::OptionCategory BenchCategory("tidy-bench options");
+
+static cl::list<unsigned> Sizes(
+   "sizes", cl::desc("Number of translation units of each corpus."),
+   cl::CommaSeparated, cl::cat(BenchCategory));
+
+static cl::list<std::string> Tools(
+   "tools",
+   cl::desc("Tools to run (default: small-tidy, encapsulate-datamember, "
+            "clang-constifier)."),
+   cl::CommaSeparated, cl::cat(BenchCategory));
+
+static cl::opt<unsigned> EarlyReturns(
+   "early-returns", cl::desc("Early-return candidates per file."),
+   cl::init(50), cl::cat(BenchCategory));
+
+static cl::opt<unsigned> EarlyReturnIfs(
+   "early-return-ifs",
+   cl::desc("Ifs of a single big function per file (default none)."),
+   cl::init(0), cl::cat(BenchCategory));
+
+static cl::opt<unsigned> Memcpys("memcpys",
+                                 cl::desc("memcpy of POD calls per file."),
+                                 cl::init(50), cl::cat(BenchCategory));
+
+static cl::opt<unsigned> NonAsciiLiterals(
+   "nonascii-literals", cl::desc("Non-ASCII string literals per file."),
+   cl::init(50), cl::cat(BenchCategory));
+
+static cl::opt<unsigned> CharChains("char-chains",
+                                    cl::desc("char* chains per file."),
+                                    cl::init(20), cl::cat(BenchCategory));
+
+static cl::opt<unsigned> ChainLength(
+   "chain-length", cl::desc("Assignments in each char* chain."),
+   cl::init(10), cl::cat(BenchCategory));
+
+static cl::opt<unsigned> MemberAccesses(
+   "member-accesses", cl::desc("Functions accessing a data member per file."),
+   cl::init(50), cl::cat(BenchCategory));
+
+static cl::opt<std::string> ToolsDir(
+   "tools-dir",
+   cl::desc("Directory of the tools (default: next to tidy-bench)."),
+   cl::cat(BenchCategory));
+
+static cl::opt<std::string> WorkDir(
+   "work-dir",
+   cl::desc("Directory of the generated corpora (default: a temporary one)."),
+   cl::cat(BenchCategory));
+
+static cl::opt<std::string> Output("output",
+                                   cl::desc("JSON report path ('-' for stdout)."),
+                                   cl::init("tidy-bench.json"),
+                                   cl::cat(BenchCategory));
+
+static cl::opt<std::string> Label(
+   "label", cl::desc("Label of the run in the report, e.g. a commit id."),
+   cl::cat(BenchCategory));
+
+
+struct ToolCase {
+   const char* Name;
+   const char* Arguments;  ///< space separated, before -jsonl
+   const char* Matches;    ///< kind of jsonl record counted as a match
+};
+
+const ToolCase ToolCases[] = {
+   {"small-tidy", "-quiet -early-return -replace-memcpy -nonascii-literal",
+    "diagnostic"},
+   {"encapsulate-datamember", "-quiet -names=Holder::value", "diagnostic"},
+   {"clang-constifier", "", "fix"},
+};
+
+struct RunResult {
+   int    ExitCode = -1;
+   double WallMs   = 0;
+   double UserMs   = 0;
+   double SystemMs = 0;
+   long   MaxRssKb = 0;
+};
+
+struct BenchResult {
+   std::string   Tool;
+   unsigned      Size;
+   RunResult     Run;
+   unsigned long Matches;
+};
+
+#ifndef _WIN32
+double Milliseconds(const timeval& tv) {
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+#endif
+
+RunResult Run(const std::string& Program, std::vector<std::string> Arguments) {
+   std::vector<const char*> argv;
+   argv.push_back(Program.c_str());
+   for (auto& a : Arguments)
+      argv.push_back(a.c_str());
+   argv.push_back(nullptr);
+
+   RunResult result;
+   auto      start = std::chrono::steady_clock::now();
+
+#ifndef _WIN32
+   // fork/wait4 rather than ExecuteAndWait to get the resource usage of the
+   // child only.
+   pid_t pid = fork();
+   if (pid == 0) {
+      int devnull = open("/dev/null", O_WRONLY);
+      if (devnull >= 0) {
+         dup2(devnull, STDOUT_FILENO);
+         dup2(devnull, STDERR_FILENO);
+      }
+      execv(Program.c_str(), const_cast<char* const*>(argv.data()));
+      _exit(127);
+   }
+
+   int           status = 0;
+   struct rusage usage;
+   if (pid < 0 || wait4(pid, &status, 0, &usage) < 0)
+      return result;
+
+   result.ExitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+   result.UserMs   = Milliseconds(usage.ru_utime);
+   result.SystemMs = Milliseconds(usage.ru_stime);
+#if defined(__APPLE__)
+   result.MaxRssKb = usage.ru_maxrss / 1024;
+#else
+   result.MaxRssKb = usage.ru_maxrss;
+#endif
+#else
+   result.ExitCode = sys::ExecuteAndWait(Program, argv.data());
+#endif
+
+   result.WallMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+   return result;
+}
+
+unsigned long CountRecords(StringRef Path, StringRef Kind) {
+   auto Buffer = MemoryBuffer::getFile(Path);
+   if (!Buffer)
+      return 0;
+
+   std::string prefix = "{\"kind\":\"" + Kind.str() + "\"";
+
+   unsigned long count = 0;
+   StringRef     rest  = (*Buffer)->getBuffer();
+   while (!rest.empty()) {
+      auto line = rest.split('\n');
+      if (line.first.startswith(prefix))
+         ++count;
+      rest = line.second;
+   }
+   return count;
+}
+
+std::string ToolPath(StringRef Name, const char* Argv0) {
+   SmallString<256> path;
+   if (!ToolsDir.empty()) {
+      path = ToolsDir;
+   }
+   else {
+      static int anchor;
+      path = sys::path::parent_path(sys::fs::getMainExecutable(Argv0, &anchor));
+   }
+   sys::path::append(path, Name);
+   return path.str().str();
+}
+
+std::string JsonString(StringRef s) {
+   std::string quoted;
+   AppendJsonString(quoted, s);
+   return quoted;
+}
+
+void WriteReport(raw_ostream& out, const std::vector<BenchResult>& results) {
+   out << "{\n"
+       << "   \"label\": " << JsonString(Label) << ",\n"
+       << "   \"results\": [\n";
+   for (std::size_t i = 0; i < results.size(); ++i) {
+      auto& r      = results[i];
+      auto  perSec = r.Run.WallMs > 0 ? r.Matches * 1000.0 / r.Run.WallMs : 0;
+      out << "      {\"tool\": " << JsonString(r.Tool)
+          << ", \"size\": " << r.Size
+          << ", \"exit_code\": " << r.Run.ExitCode
+          << ", \"wall_ms\": " << format("%.3f", r.Run.WallMs)
+          << ", \"user_ms\": " << format("%.3f", r.Run.UserMs)
+          << ", \"sys_ms\": " << format("%.3f", r.Run.SystemMs)
+          << ", \"max_rss_kb\": " << r.Run.MaxRssKb
+          << ", \"matches\": " << r.Matches
+          << ", \"matches_per_second\": " << format("%.1f", perSec) << "}"
+          << (i + 1 < results.size() ? "," : "") << "\n";
+   }
+   out << "   ]\n"
+       << "}\n";
+}
+
+/// Remove a temporary work directory and the corpora it holds when the run
+/// ends, whatever its outcome.
+class TemporaryDirectory {
+public:
+   explicit TemporaryDirectory(StringRef Path)
+      : m_path(Path) {}
+
+   ~TemporaryDirectory() {
+      if (!m_path.empty())
+         sys::fs::remove_directories(m_path);
+   }
+
+private:
+   std::string m_path;
+};
+
+}  // namespace
+
+
+int main(int argc, const char** argv) {
+   cl::HideUnrelatedOptions(BenchCategory);
+   cl::ParseCommandLineOptions(argc, argv, "tidy tools benchmark\n");
+
+   std::vector<unsigned> sizes(Sizes.begin(), Sizes.end());
+   if (sizes.empty())
+      sizes = {1, 8, 32};
+
+   std::vector<const ToolCase*> cases;
+   for (auto& c : ToolCases) {
+      if (Tools.empty() ||
+          std::find(Tools.begin(), Tools.end(), c.Name) != Tools.end())
+         cases.push_back(&c);
+   }
+
+   SmallString<256> workDir(WorkDir);
+   if (workDir.empty()) {
+      if (std::error_code EC =
+             sys::fs::createUniqueDirectory("tidy-bench", workDir)) {
+         std::cerr << "Cannot create work directory: " << EC.message() << "\n";
+         return 1;
+      }
+   }
+   // A directory given with -work-dir is kept, e.g. to look at the corpora.
+   TemporaryDirectory temporary(WorkDir.empty() ? workDir.str() : "");
+
+   std::vector<BenchResult> results;
+   for (auto size : sizes) {
+      CorpusOptions options;
+      options.Files            = size;
+      options.EarlyReturns     = EarlyReturns;
+      options.EarlyReturnIfs   = EarlyReturnIfs;
+      options.Memcpys          = Memcpys;
+      options.NonAsciiLiterals = NonAsciiLiterals;
+      options.CharChains       = CharChains;
+      options.ChainLength      = ChainLength;
+      options.MemberAccesses   = MemberAccesses;
+
+      SmallString<256> corpus(workDir);
+      sys::path::append(corpus, "size-" + std::to_string(size));
+
+      std::string error;
+      if (!GenerateCorpus(corpus, options, error)) {
+         std::cerr << error << "\n";
+         return 1;
+      }
+
+      for (auto c : cases) {
+         SmallString<256> jsonl(corpus);
+         sys::path::append(jsonl, std::string(c->Name) + ".jsonl");
+
+         std::vector<std::string> arguments;
+         arguments.push_back("-p=" + corpus.str().str());
+         arguments.push_back("-filter=bench_");
+         SmallVector<StringRef, 8> extra;
+         StringRef(c->Arguments).split(extra, ' ', -1, false);
+         for (auto& e : extra)
+            arguments.push_back(e.str());
+         arguments.push_back("-jsonl=" + jsonl.str().str());
+
+         BenchResult result;
+         result.Tool    = c->Name;
+         result.Size    = size;
+         result.Run     = Run(ToolPath(c->Name, argv[0]), arguments);
+         result.Matches = CountRecords(jsonl, c->Matches);
+
+         std::cerr << c->Name << " [" << size << " file(s)]: "
+                   << result.Run.WallMs << " ms, " << result.Run.MaxRssKb
+                   << " KB, " << result.Matches << " matches";
+         if (result.Run.ExitCode != 0)
+            std::cerr << " (exit code " << result.Run.ExitCode << ")";
+         std::cerr << "\n";
+
+         results.push_back(result);
+      }
+   }
+
+   std::error_code EC;
+   raw_fd_ostream  out(Output, EC, sys::fs::F_Text);
+   if (EC) {
+      std::cerr << "Error opening file: " << EC.message() << "\n";
+      return 1;
+   }
+   WriteReport(out, results);
+   return 0;
+}